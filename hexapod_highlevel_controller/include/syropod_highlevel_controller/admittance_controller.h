@@ -12,10 +12,75 @@
 #include "standard_includes.h"
 #include "parameters_and_states.h"
 #include <boost/numeric/odeint.hpp>
+#include <ros/callback_queue.h>
 
 #include "model.h"
 
 #define ADMITTANCE_DEADBAND 0.0
+#define MAX_ADMITTANCE_DELTA 0.2 ///< Max magnitude of admittance tip position offset per axis (m)
+#define TRIPLE_BUFFER_FRESH 4    ///< Flag bit of triple buffer shared index denoting unread data
+
+typedef Eigen::Array<double, 3 * MAX_LEG_COUNT, 1> AdmittanceLanes; ///< A value for each tip axis (lane) of each leg
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> JointVector; ///< A value for each joint of leg
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Structure-of-arrays storage of the discrete admittance model of every tip axis of every leg, where each tip axis
+/// is a lane at index (leg id number * 3 + axis). Holding each state variable and discrete system coefficient in a
+/// single aligned array allows the models of all legs to be advanced together with vectorised (SIMD) array operations.
+/// The discrete system of each lane is the exact zero-order-hold discretisation of the mass/spring/damper admittance
+/// model over the integrator step time, in which the force input is held constant across the step. The model inputs
+/// from which the discrete system coefficients were generated are stored such that they are only regenerated when
+/// these inputs change. Unused lanes hold zero state.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct AdmittanceLaneArrays
+{
+  /// Returns true if the discrete system coefficients were generated from the input model characteristics.
+  /// @param[in] mass The virtual mass of the model
+  /// @param[in] stiffness The virtual stiffness of the model of each lane
+  /// @param[in] damping_ratio The virtual damping ratio of the model
+  /// @param[in] step_time The integrator step time
+  /// @return Flag denoting if the discrete system coefficients are valid for the input model characteristics
+  inline bool isValid(const double& mass, const AdmittanceLanes& stiffness,
+                      const double& damping_ratio, const double& step_time) const
+  {
+    return (mass_ == mass && damping_ratio_ == damping_ratio && step_time_ == step_time &&
+            (stiffness_ == stiffness).all());
+  };
+
+  /// Generates the discrete system coefficients of all lanes from the closed form of the matrix exponential of the
+  /// augmented continuous system [A, B; 0, 0] * step_time, which depends on the damping regime of the model. Since the
+  /// mass and damping ratio are common to all lanes the regime is shared and the coefficients of all lanes are
+  /// generated together with vectorised array operations. The virtual stiffness of each lane must be positive.
+  /// Ref: https://en.wikipedia.org/wiki/Discretization#Discretization_of_linear_state_space_models
+  /// @param[in] mass The virtual mass of the model
+  /// @param[in] stiffness The virtual stiffness of the model of each lane
+  /// @param[in] damping_ratio The virtual damping ratio of the model
+  /// @param[in] step_time The integrator step time
+  void generate(const double& mass, const AdmittanceLanes& stiffness,
+                const double& damping_ratio, const double& step_time);
+
+  /// Advances the state of all lanes by one integrator step from the input force of each lane (limited to positive
+  /// values) and generates the resulting tip position offset of each lane, clamped and deadbanded in the same pass.
+  /// @param[in] force_input The scaled tip force input of each lane
+  /// @return The clamped and deadbanded admittance tip position offset of each lane
+  AdmittanceLanes advance(const AdmittanceLanes& force_input);
+
+  double mass_ = 0.0;                                         ///< The virtual mass of the discrete system
+  double damping_ratio_ = 0.0;                                ///< The virtual damping ratio of the discrete system
+  double step_time_ = 0.0;                                    ///< The integrator step time of the discrete system
+  AdmittanceLanes stiffness_ = AdmittanceLanes::Ones();       ///< The virtual stiffness of the system of each lane
+  AdmittanceLanes position_ = AdmittanceLanes::Zero();        ///< The position state of each lane
+  AdmittanceLanes velocity_ = AdmittanceLanes::Zero();        ///< The velocity state of each lane
+  AdmittanceLanes force_ = AdmittanceLanes::Zero();           ///< The scaled tip force input of each lane
+  AdmittanceLanes state_matrix_00_ = AdmittanceLanes::Ones(); ///< Discrete state transition matrix element (0, 0)
+  AdmittanceLanes state_matrix_01_ = AdmittanceLanes::Zero(); ///< Discrete state transition matrix element (0, 1)
+  AdmittanceLanes state_matrix_10_ = AdmittanceLanes::Zero(); ///< Discrete state transition matrix element (1, 0)
+  AdmittanceLanes state_matrix_11_ = AdmittanceLanes::Ones(); ///< Discrete state transition matrix element (1, 1)
+  AdmittanceLanes input_matrix_0_ = AdmittanceLanes::Zero();  ///< Discrete force input matrix element 0
+  AdmittanceLanes input_matrix_1_ = AdmittanceLanes::Zero();  ///< Discrete force input matrix element 1
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles the application of an admittance controller to the robot model. Specifically it calculates a
@@ -36,8 +101,11 @@ public:
   AdmittanceController(std::shared_ptr<Model> model, const Parameters& params);
   
   /// Iterates through legs in the robot model and updates the tip position offset value for each.
-  /// The calculation is achieved through the use of a classical Runge-Kutta ODE solver with a force input
-  /// acquired from a tip force callback OR from estimation from joint effort values.
+  /// The calculation is achieved through the use of a classical Runge-Kutta ODE solver OR the exact discretisation of
+  /// the admittance model (if parameterised) with a force input acquired from a tip force callback OR from estimation
+  /// from joint effort values. The Runge-Kutta solver advances a single model state per leg once for each tip axis,
+  /// whereas the exact discretisation holds an independent model state for each tip axis, hence the modes differ in
+  /// response for anything but a single axis model.
   /// @todo Implement admittance control in x/y axis
   void updateAdmittance(void);
   
@@ -61,9 +129,192 @@ public:
   void updateStiffness(std::shared_ptr<WalkController> walker);
 
 private:
+  /// Advances the admittance model of every tip axis of every leg in a single vectorised pass over the lanes of the
+  /// admittance lane arrays using the cached exact discretisation of the admittance model of each lane. The discrete
+  /// system coefficients of all lanes are regenerated together, also vectorised, only if the model of any leg has
+  /// changed (e.g. stiffness scaled by updateStiffness). Clamping and deadbanding of the resulting tip position offsets
+  /// are applied in the same pass.
+  void updateDiscreteAdmittance(void);
+
+  /// Applies deadband to an input admittance tip position offset.
+  /// @param[in] delta The input admittance tip position offset
+  /// @return The deadbanded admittance tip position offset
+  double applyDeadband(const double& delta);
+
   std::shared_ptr<Model> model_; ///< Pointer to the robot model object
   const Parameters &params_;     ///< Pointer to parameter data structure for storing parameter variables
 
+  AdmittanceLaneArrays lanes_; ///< Admittance model of each tip axis of each leg
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Lock-free exchange of the latest value of an object from a single writing thread to a single reading thread. The
+/// writer and reader each own one of three buffers and swap it atomically with the shared third buffer, such that
+/// neither thread ever waits on the other and the reader always receives the most recently completed write.
+/// Ref: https://en.wikipedia.org/wiki/Multiple_buffering#Triple_buffering
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class TripleBuffer
+{
+public:
+  /// Writes a value to the buffer (writing thread only).
+  /// @param[in] value The value to write
+  inline void write(const T& value)
+  {
+    buffers_[write_index_] = value;
+    write_index_ = shared_index_.exchange(write_index_ | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+    write_index_ &= ~TRIPLE_BUFFER_FRESH;
+  };
+
+  /// Reads the most recently written value from the buffer (reading thread only).
+  /// @param[out] value The most recently written value (unmodified if nothing has been written)
+  /// @return Flag denoting if a value was written since the last read
+  inline bool read(T* value)
+  {
+    bool fresh = (shared_index_.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH);
+    if (fresh)
+    {
+      read_index_ = shared_index_.exchange(read_index_, std::memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+      *value = buffers_[read_index_];
+    }
+    return fresh;
+  };
+
+private:
+  T buffers_[3];                       ///< The buffers owned by the writer, reader and shared between them
+  int write_index_ = 0;                ///< The index of the buffer owned by the writing thread
+  int read_index_ = 1;                 ///< The index of the buffer owned by the reading thread
+  std::atomic<int> shared_index_{2};   ///< The index of the shared buffer (with flag bit denoting unread data)
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// The state of a leg from the main control loop required by the compliance loop, generated each main loop iteration.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct ComplianceLegInput
+{
+  int joint_count_ = 0;                  ///< The number of joints of the leg (zero if no such leg)
+  bool apply_delta_ = false;             ///< Flag denoting if admittance offset was applied in main loop desired pose
+  TipForceMap force_map_;                ///< Map from joint efforts to tip force about current leg configuration
+  LinearJacobianInverse delta_map_;      ///< Map from tip position delta to joint position delta
+  Eigen::Vector3d delta_axis_;           ///< Tip axis onto which the admittance offset is projected (as per Leg)
+  Eigen::Vector3d admittance_delta_;     ///< The admittance tip position offset applied in main loop IK
+  Eigen::Vector3d tip_force_measured_;   ///< The current measured tip force of the leg
+  double stiffness_ = 0.0;               ///< The current virtual stiffness of the leg
+  JointVector desired_position_;         ///< The desired position of each joint from main loop IK
+  JointVector desired_velocity_;         ///< The desired velocity of each joint from main loop IK
+  JointVector desired_effort_;           ///< The desired effort of each joint
+  JointVector min_position_;             ///< The min position limit of each joint
+  JointVector max_position_;             ///< The max position limit of each joint
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// The input to the compliance loop from the main control loop, consisting of the state of each leg (by id number) and
+/// the parameters of the admittance model at the time the input was generated.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct ComplianceInput
+{
+  bool active_ = false;                   ///< Flag denoting if compliance loop publishes desired joint positions
+  bool use_joint_effort_ = false;         ///< Flag denoting if tip force is estimated from joint efforts
+  bool clamp_joint_positions_ = false;    ///< Flag denoting if desired joint positions are clamped to limits
+  double time_delta_ = 0.0;               ///< The period of the main control loop
+  double integrator_step_time_ = 0.0;     ///< The integrator step time of the admittance model per main loop period
+  double mass_ = 0.0;                     ///< The virtual mass of the admittance model
+  double damping_ratio_ = 0.0;            ///< The virtual damping ratio of the admittance model
+  double force_gain_ = 0.0;               ///< The gain applied to tip force
+  ComplianceLegInput legs_[MAX_LEG_COUNT]; ///< The state of each leg by id number
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// The output of the compliance loop to the main control loop.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct ComplianceOutput
+{
+  Eigen::Vector3d admittance_delta_[MAX_LEG_COUNT]; ///< The admittance tip position offset of each leg by id number
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class runs the inner compliance loop on a dedicated thread at a higher rate than the main control loop. Each
+/// iteration it receives the latest joint efforts on its own callback queue, updates the tip force estimate and the
+/// exactly discretised admittance model of each leg and publishes the desired joint positions of the last main loop
+/// iteration, corrected via first order inverse kinematics for the change in admittance tip position offset since.
+/// State is exchanged with the main control loop only through lock-free triple buffers, such that the compliance loop
+/// never waits on gait and pose planning and never accesses the robot model.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class ComplianceLoop
+{
+public:
+  /// ComplianceLoop class constructor. Generates joint lookup data and publishers from the robot model, subscribes to
+  /// joint states on the compliance loop callback queue and starts the compliance loop thread.
+  /// @param[in] model Pointer to the robot model class object
+  /// @param[in] params Pointer to the parameter struct object
+  /// @param[in] desired_joint_state_publisher The publisher of combined desired joint states
+  ComplianceLoop(std::shared_ptr<Model> model, const Parameters& params,
+                 const ros::Publisher& desired_joint_state_publisher);
+
+  /// ComplianceLoop class destructor. Stops and joins the compliance loop thread.
+  ~ComplianceLoop(void);
+
+  /// Hands the latest state of the main control loop to the compliance loop (main control loop thread only).
+  /// @param[in] input The compliance loop input generated by the main control loop
+  inline void setInput(const ComplianceInput& input) { input_buffer_.write(input); };
+
+  /// Receives the latest output of the compliance loop (main control loop thread only).
+  /// @param[out] output The latest compliance loop output (unmodified if none since the last call)
+  /// @return Flag denoting if a new output was received
+  inline bool getOutput(ComplianceOutput* output) { return output_buffer_.read(output); };
+
+private:
+  /// Runs compliance loop iterations at the parameterised rate until stopped.
+  void run(void);
+
+  /// Iterates the compliance loop.
+  /// @param[in] time_delta The period of the compliance loop
+  void iterate(const double& time_delta);
+
+  /// Callback handling the joint state message, storing the latest effort of each joint.
+  /// @param[in] joint_states The JointState sensor message provided by the subscribed ros topic "/joint_states"
+  void jointStatesCallback(const sensor_msgs::JointState& joint_states);
+
+  /// Publishes the corrected desired joint positions via the parameterised control interface/s.
+  void publishDesiredJointState(void);
+
+  const Parameters& params_; ///< Pointer to parameter data structure for storing parameter variables
+  double rate_;              ///< The rate of the compliance loop (Hz)
+
+  ros::CallbackQueue callback_queue_;            ///< Callback queue of compliance loop subscriptions
+  ros::Subscriber joint_state_subscriber_;       ///< Subscriber for topic /joint_states
+  ros::Publisher desired_joint_state_publisher_; ///< Publisher for topic /desired_joint_states
+
+  std::map<std::string, std::pair<int, int>> joint_indices_;    ///< Leg id and joint index of each joint by name
+  std::string joint_names_[MAX_LEG_COUNT][MAX_JOINT_COUNT];     ///< The name of each joint of each leg
+  double joint_offsets_[MAX_LEG_COUNT][MAX_JOINT_COUNT];        ///< The position offset of each joint of each leg
+  ros::Publisher joint_publishers_[MAX_LEG_COUNT][MAX_JOINT_COUNT]; ///< Desired position publisher of each joint
+  Eigen::Array<double, MAX_LEG_COUNT, MAX_JOINT_COUNT> joint_efforts_; ///< The latest effort of each joint of each leg
+
+  TripleBuffer<ComplianceInput> input_buffer_;   ///< Lock-free buffer of input from the main control loop
+  TripleBuffer<ComplianceOutput> output_buffer_; ///< Lock-free buffer of output to the main control loop
+  ComplianceInput input_;                        ///< The latest input from the main control loop
+  ComplianceOutput output_;                      ///< The compliance loop output of the current iteration
+  JointVector desired_positions_[MAX_LEG_COUNT]; ///< The corrected desired position of each joint of each leg
+  Eigen::Vector3d tip_forces_[MAX_LEG_COUNT];    ///< The tip force input of each leg (filtered if calculated)
+
+  AdmittanceLaneArrays lanes_; ///< Admittance model of each tip axis of each leg
+
+  std::atomic<bool> running_; ///< Flag denoting if the compliance loop thread should continue running
+  std::thread thread_;        ///< The compliance loop thread
+
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
@@ -18,11 +18,25 @@
 #define HALF_BODY_DEPTH 0.05        ///< Threshold used to estimate if leg tip has broken the plane of the robot body(m)
 #define DLS_COEFFICIENT 0.02        ///< Coefficient used in Damped Least Squares method for inverse kinematics
 #define JOINT_LIMIT_COST_WEIGHT 0.1 ///< Gain used in determining cost weight for joints approaching limits
+#define TIP_FORCE_SMOOTHING 0.15    ///< Smoothing factor of low pass filter applied to calculated tip force
+#define ANALYTIC_IK_TOLERANCE 1e-3  ///< Tolerance on DH alpha values for a leg to be solvable via analytic IK (rad)
+#define MAX_JOINT_COUNT 6           ///< Maximum number of joints per leg, bounding fixed size kinematic storage
+#define MAX_LEG_COUNT 8             ///< Maximum number of legs, bounding fixed size storage used in batched kinematics
+#define MAX_TIP_BATCH_SIZE 16       ///< Maximum number of tip positions evaluated in a batched reachability query
 
-#define BEARING_STEP 45          ///< Step to increment bearing in workspace generation algorithm (deg)
+#define DEFAULT_BEARING_STEP 45  ///< Default step between bearings of workspace planes (deg)
 #define MAX_POSITION_DELTA 0.002 ///< Position delta to increment search position in workspace generation algorithm (m)
 #define MAX_WORKSPACE_RADIUS 1.0 ///< Maximum radius allowed in workspace polygedron plane (m)
-#define WORKSPACE_LAYERS 10      ///< Number of planes in workspace polyhedron
+#define WORKSPACE_BISECTION_TOLERANCE 0.001  ///< Bracket width at which bisection workspace search completes (m)
+#define WORKSPACE_SEARCH_IK_ITERATIONS 10    ///< Max IK iterations to converge to each bisection workspace search check
+#define WORKSPACE_SEARCH_IK_TOLERANCE 0.0005 ///< Tip error at which bisection workspace search IK has converged (m)
+#define WORKSPACE_SEARCH_IK_STALL_RATIO 0.9  ///< Ratio of change between iterations at which search IK has stalled
+#define WORKSPACE_MAX_SEARCH_STEP 0.05       ///< Max step to bracket limits in bisection workspace search (m)
+#define WORKSPACE_SEARCH_MARGIN_RATIO 0.5    ///< Ratio of joint limit margin a bisection search step may consume
+
+#define WORKSPACE_CACHE_VERSION 5                 ///< Version of workspace cache file format and generation algorithm
+#define WORKSPACE_CACHE_PRECISION 3               ///< Decimal places of default joint positions/body pose in cache hash
+#define WORKSPACE_CACHE_DIRECTORY "shc_workspace" ///< Name of workspace cache directory within ROS home directory
 
 class Leg;
 class Joint;
@@ -49,12 +63,159 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This struct contains contiguous (structure of arrays) storage of the joint, link and transform data for every leg of
+/// the robot model. Joint, Link and Tip objects are views which reference elements of this storage rather than owning
+/// the data, allowing data for all legs to be iterated without traversing object containers. Arrays are indexed by leg
+/// identification number and element identification number (joint/link 0 refers to the origin of the kinematic chain)
+/// and are stored column-major, such that data for a given element index is contiguous across all legs. Storage is
+/// allocated once on construction and never reallocated, hence references to elements remain valid.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> TransformCache;
+struct ModelStorage
+{
+public:
+  /// Constructor for model storage object. Allocates and initialises storage for all legs in robot model.
+  /// @param[in] leg_count The number of legs in the robot model
+  ModelStorage(const int& leg_count);
+
+  /// Returns the index of the transform of an element of a leg in the transform storage.
+  /// @param[in] leg_id_number The identification number of the leg
+  /// @param[in] element_index The index of the element in the kinematic chain (0 = origin, 1-N = joints, N+1 = tip)
+  /// @return The index of the requested transform in transform storage
+  inline int getTransformIndex(const int& leg_id_number, const int& element_index) const
+  {
+    return leg_id_number * (MAX_JOINT_COUNT + 2) + element_index;
+  };
+
+  const int leg_count_;                 ///< The number of legs stored
+
+  Eigen::ArrayXXd dh_parameter_r_;      ///< The DH parameter 'r' of each link of each leg
+  Eigen::ArrayXXd dh_parameter_theta_;  ///< The DH parameter 'theta' of each link of each leg
+  Eigen::ArrayXXd dh_parameter_d_;      ///< The DH parameter 'd' of each link of each leg
+  Eigen::ArrayXXd dh_parameter_alpha_;  ///< The DH parameter 'alpha' of each link of each leg
+
+  Eigen::ArrayXXd min_position_;        ///< The minimum position allowed for each joint of each leg
+  Eigen::ArrayXXd max_position_;        ///< The maximum position allowed for each joint of each leg
+  Eigen::ArrayXXd max_angular_speed_;   ///< The maximum angular speed of each joint of each leg
+
+  Eigen::ArrayXXd desired_position_;      ///< The desired angular position of each joint of each leg
+  Eigen::ArrayXXd desired_velocity_;      ///< The desired angular velocity of each joint of each leg
+  Eigen::ArrayXXd desired_effort_;        ///< The desired angular effort of each joint of each leg
+  Eigen::ArrayXXd prev_desired_position_; ///< The desired angular position of each joint at the previous iteration
+  Eigen::ArrayXXd prev_desired_velocity_; ///< The desired angular velocity of each joint at the previous iteration
+  Eigen::ArrayXXd prev_desired_effort_;   ///< The desired angular effort of each joint at the previous iteration
+
+  Eigen::ArrayXXd current_position_;    ///< The current position of each joint of each leg according to hardware
+  Eigen::ArrayXXd current_velocity_;    ///< The current velocity of each joint of each leg according to hardware
+  Eigen::ArrayXXd current_effort_;      ///< The current effort of each joint of each leg according to hardware
+
+  Eigen::ArrayXXd default_position_;    ///< The default position of each joint of each leg
+  Eigen::ArrayXXd default_velocity_;    ///< The default velocity of each joint of each leg
+  Eigen::ArrayXXd default_effort_;      ///< The default effort of each joint of each leg
+
+  TransformCache current_transforms_;   ///< The current transform between previous joint and each joint/tip of each leg
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class contains the workspace polyhedron of a leg, defined by a set of horizontal workplanes at heights relative
+/// to the workspace origin. Each workplane defines the radius of the workspace along bearings (deg) at a regular step
+/// from 0 to 360 inclusive. Radii are stored in a dense row-major array (workplane x bearing) such that the radii of a
+/// workplane are contiguous, and radii between workplanes/bearings are found via bilinear interpolation.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef Eigen::ArrayXd Workplane;
+typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> WorkspaceRadii;
+class Workspace
+{
+public:
+  /// Constructor for workspace object. Initialises an empty workspace.
+  /// @param[in] bearing_step The step between bearings of each workplane (deg) - must be a divisor of 360
+  Workspace(const int& bearing_step = DEFAULT_BEARING_STEP);
+
+  /// Accessor for the step between bearings of each workplane.
+  /// @return The step between bearings of each workplane (deg)
+  inline int getBearingStep(void) const { return bearing_step_; };
+
+  /// Accessor for the number of bearings of each workplane (including both 0 and 360 degrees).
+  /// @return The number of bearings of each workplane
+  inline int getBearingCount(void) const { return bearing_count_; };
+
+  /// Accessor for the number of workplanes in the workspace.
+  /// @return The number of workplanes in the workspace
+  inline int getWorkplaneCount(void) const { return heights_.size(); };
+
+  /// Returns true if the workspace contains no workplanes.
+  /// @return Bool denoting if the workspace contains no workplanes
+  inline bool empty(void) const { return heights_.empty(); };
+
+  /// Accessor for the height of a workplane.
+  /// @param[in] workplane_index The index of the workplane (ordered by ascending height)
+  /// @return The height of the workplane relative to the workspace origin
+  inline double getHeight(const int& workplane_index) const { return heights_[workplane_index]; };
+
+  /// Accessor for the minimum height of the workspace.
+  /// @return The height of the lowest workplane relative to the workspace origin
+  inline double getMinHeight(void) const { return heights_.front(); };
+
+  /// Accessor for the maximum height of the workspace.
+  /// @return The height of the highest workplane relative to the workspace origin
+  inline double getMaxHeight(void) const { return heights_.back(); };
+
+  /// Accessor for the bearing associated with a bearing index.
+  /// @param[in] bearing_index The index of the bearing within each workplane
+  /// @return The bearing (deg)
+  inline int getBearing(const int& bearing_index) const { return bearing_index * bearing_step_; };
+
+  /// Accessor for the radius of a workplane along a bearing.
+  /// @param[in] workplane_index The index of the workplane (ordered by ascending height)
+  /// @param[in] bearing_index The index of the bearing within the workplane
+  /// @return A reference to the radius of the workplane along the bearing
+  inline double& getRadius(const int& workplane_index, const int& bearing_index)
+  {
+    return radii_(workplane_index, bearing_index);
+  };
+
+  /// Adds a workplane at the given height with constant radius. If a workplane already exists at this height it is
+  /// left unchanged. Indices of existing workplanes above the given height are incremented.
+  /// @param[in] height The height of the new workplane relative to the workspace origin
+  /// @param[in] radius The radius of the new workplane along every bearing
+  /// @return The index of the workplane at the given height
+  int addWorkplane(const double& height, const double& radius);
+
+  /// Returns the radius of the workspace at the given height and bearing, bilinearly interpolated between the
+  /// bounding workplanes and bearings. Heights beyond the workspace are clamped to the lowest/highest workplane.
+  /// @param[in] height The height relative to the workspace origin
+  /// @param[in] bearing The bearing (deg)
+  /// @return The interpolated radius of the workspace
+  double interpolateRadius(const double& height, const double& bearing) const;
+
+  /// Generates interpolated workplane at given height. Heights beyond the workspace are clamped to the lowest/highest
+  /// workplane.
+  /// @param[in] height The height relative to the workspace origin
+  /// @return The interpolated radius along each bearing of the workplane
+  Workplane getWorkplane(const double& height) const;
+
+private:
+  /// Finds the workplanes bounding the given height and the interpolation control input between them.
+  /// @param[in] height The height relative to the workspace origin
+  /// @param[out] lower_index The index of the lower bounding workplane
+  /// @param[out] upper_index The index of the upper bounding workplane
+  /// @param[out] control_input The interpolation control input of the height between the bounding workplanes
+  void getBoundingWorkplanes(const double& height, int* lower_index, int* upper_index, double* control_input) const;
+
+  int bearing_step_;             ///< The step between bearings of each workplane (deg)
+  int bearing_count_;            ///< The number of bearings of each workplane (including both 0 and 360 degrees)
+  std::vector<double> heights_;  ///< The height of each workplane relative to the workspace origin (ascending)
+  WorkspaceRadii radii_;         ///< The radius of each workplane (row) along each bearing (column)
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class serves as the top-level parent of each leg object and associated tip/joint/link objects. It contains data
 /// which is relevant to the robot body or the robot as a whole rather than leg dependent data.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef Eigen::aligned_allocator<std::pair<const int, std::shared_ptr<Leg>>> LegAlignedAllocator;
 typedef std::map<int, std::shared_ptr<Leg>, std::less<int>, LegAlignedAllocator> LegContainer;
+typedef std::vector<Pose, Eigen::aligned_allocator<Pose>> PoseArray;
 class Model : public std::enable_shared_from_this<Model>
 {
 public:
@@ -70,6 +231,10 @@ public:
   /// Accessor for leg object container.
   /// @return Pointer to leg container object
   inline LegContainer* getLegContainer(void) { return &leg_container_; };
+
+  /// Accessor for contiguous model storage, which is referenced by the Joint, Link and Tip objects of each leg.
+  /// @return Pointer to model storage object
+  inline ModelStorage* getStorage(void) { return &storage_; };
   
   /// Accessor for debug visualiser pointer.
   /// @return Pointer to debug visualiser object
@@ -102,6 +267,7 @@ public:
   /// Generates child leg objects and copies state from reference model if provided.
   /// Separated from constructor due to shared_from_this() constraints.
   /// @param[in] model A pointer to a existing reference robot model object
+  /// @throw std::runtime_error If the model parameters exceed the bounds of fixed size storage
   void generate(std::shared_ptr<Model> model = NULL);
 
   /// Iterate through legs in robot model and have them run their initialisation.
@@ -119,8 +285,12 @@ public:
 
   /// Returns pointer to leg requested via identification number input.
   /// @param[in] leg_id_num The identification number of the requested leg object pointer
-  /// @return The Pointer to leg requested via identification number input
-  inline std::shared_ptr<Leg> getLegByIDNumber(const int& leg_id_num) { return leg_container_[leg_id_num]; };
+  /// @return The Pointer to leg requested via identification number input (NULL if no such leg exists)
+  inline std::shared_ptr<Leg> getLegByIDNumber(const int& leg_id_num)
+  {
+    LegContainer::iterator leg_it = leg_container_.find(leg_id_num);
+    return (leg_it != leg_container_.end() ? leg_it->second : NULL);
+  };
 
   /// Returns pointer to leg requsted via identification name string input.
   /// @param[in] leg_id_name The identification name of the requested leg object pointer
@@ -138,6 +308,10 @@ public:
     }
     return imu_data;
   };
+
+  /// Returns true if imu data has been received (i.e. imu orientation is defined).
+  /// @return Flag denoting if imu data has been received
+  inline bool hasImuData(void) { return !imu_data_.orientation.isApprox(UNDEFINED_ROTATION); };
   
   /// Modifier for imu data.
   /// @param[in] orientation The orientation to be set as the orientation of the imu
@@ -155,18 +329,53 @@ public:
   /// Updates joint default positions for each leg according to current joint positions of each leg.
   void updateDefaultConfiguration(void);
   
-  /// Generates workspace polyhedron for each leg in model.
+  /// Generates workspace polyhedron for each leg in model. Workspaces are loaded from the workspace cache if previously
+  /// generated for identical kinematic parameters, otherwise they are searched for and then saved to the cache.
   void generateWorkspaces(void);
   
   /// Updates model configuration by applying inverse kinematics to solve desired tip poses generated from walk/pose
   /// controllers.
   void updateModel(void);
   
+  /// Applies forward kinematics to the actual joint positions (from motor outputs) of all legs at once. The joint
+  /// transforms and tip poses of the model are left unmodified.
+  /// @return Pointer to the actual tip pose of each leg in the robot frame, indexed by leg identification number
+  PoseArray* applyActualFK(void);
+
+  /// Accessor for tip poses of all legs generated from actual joint positions in the last call of applyActualFK.
+  /// @return Pointer to array of tip poses (by leg id number)
+  inline PoseArray* getActualTipPoses(void) { return &actual_tip_poses_; };
+
   /// Estimates the acceleration vector due to gravity from pitch and roll orientations from IMU data
   /// @return The estimated acceleration vector due to gravity.
   Eigen::Vector3d estimateGravity(void);
 
 private:
+  /// Generates a hash of all parameters which affect the workspace of each leg (leg DH/joint parameters, stance
+  /// positions, body clearance, rough terrain mode, workspace resolution, search mode/constants and cache version)
+  /// and of the state the workspace is searched from (default joint positions of each leg and current body pose).
+  /// @return The hash of workspace parameters
+  uint64_t generateWorkspaceHash(void);
+
+  /// Loads the workspace of each leg in model from a workspace cache file. The file is memory mapped and validated
+  /// against the cache version, workspace hash and leg count before any workspace is set.
+  /// @param[in] file_name The path of the workspace cache file
+  /// @param[in] hash The expected workspace hash
+  /// @return Flag denoting if workspaces were successfully loaded from the cache file
+  bool loadWorkspaces(const std::string& file_name, const uint64_t& hash);
+
+  /// Saves the workspace of each leg in model to a workspace cache file. The file is written in full before atomically
+  /// replacing any existing file, such that an interrupted write never leaves a partial cache file.
+  /// @param[in] file_name The path of the workspace cache file
+  /// @param[in] hash The workspace hash
+  void saveWorkspaces(const std::string& file_name, const uint64_t& hash);
+
+  /// Generates the transform of each joint and tip of every leg from input joint positions. Each index along the
+  /// kinematic chain is evaluated for all legs together, allowing trigonometric functions to be vectorised across legs.
+  /// @param[in] joint_positions The position of each joint of each leg, arranged as per model storage
+  /// @param[out] transforms The generated transforms, arranged as per model storage
+  void generateTransforms(const Eigen::ArrayXXd& joint_positions, TransformCache* transforms);
+
   const Parameters& params_;                     ///< Pointer to parameter structure for storing parameter variables
   std::shared_ptr<DebugVisualiser> debug_visualiser_; ///< Pointer to debug visualiser object
   LegContainer leg_container_;                   ///< The container map for all robot model leg objects
@@ -176,6 +385,10 @@ private:
   Pose current_pose_;            ///< Current pose of robot model body (i.e. walk_plane -> base_link)
   Pose default_pose_;            ///< Default pose of robot model body (i.e. only body clearance above walk plane)
   ImuData imu_data_;             ///< Imu data structure
+  ModelStorage storage_;         ///< Contiguous storage of joint, link and transform data of all legs
+
+  TransformCache actual_transforms_; ///< Joint and tip transforms of all legs generated from actual joint positions
+  PoseArray actual_tip_poses_;       ///< Tip poses of all legs generated from actual joint positions
   
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -187,12 +400,32 @@ public:
 /// associated with the leg.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef std::vector<double> state_type; // Impedance state used in admittance controller
-typedef std::map<int, double> Workplane;
-typedef std::map<double, Workplane> Workspace;
 typedef Eigen::aligned_allocator<std::pair<const int, std::shared_ptr<Joint>>> JointAlignedAllocator;
 typedef std::map<int, std::shared_ptr<Joint>, std::less<int>, JointAlignedAllocator> JointContainer;
 typedef Eigen::aligned_allocator<std::pair<const int, std::shared_ptr<Link>>> LinkAlignedAllocator;
 typedef std::map<int, std::shared_ptr<Link>, std::less<int>, LinkAlignedAllocator> LinkContainer;
+typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, MAX_JOINT_COUNT> Jacobian;
+typedef Eigen::Matrix<double, Eigen::Dynamic, 6, 0, MAX_JOINT_COUNT, 6> JacobianInverse;
+typedef Eigen::Matrix<double, Eigen::Dynamic, 3, 0, MAX_JOINT_COUNT, 3> LinearJacobianInverse;
+typedef Eigen::Matrix<double, 3, Eigen::Dynamic, 0, 3, MAX_JOINT_COUNT> TipForceMap;
+typedef Eigen::Matrix<double, 3, Eigen::Dynamic, 0, 3, MAX_TIP_BATCH_SIZE> TipPositionBatch;
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_TIP_BATCH_SIZE, 1> TipMarginBatch;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This struct contains the kinematic state of a leg derived from its current joint transforms. It is generated at most
+/// once per change in joint positions and shared between inverse kinematics and tip force estimation.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct KinematicState
+{
+public:
+  Jacobian jacobian;                          ///< Jacobian (linear/angular velocity rows) in the first joint frame
+  JacobianInverse dls_inverse;                ///< Damped least squares pseudo-inverse of the full jacobian
+  LinearJacobianInverse position_dls_inverse; ///< Damped least squares pseudo-inverse of the linear velocity rows
+  bool valid = false;                         ///< Flag denoting if state matches current joint transforms
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
 class Leg : public std::enable_shared_from_this<Leg>
 {
 public:
@@ -219,13 +452,17 @@ public:
   /// @return The number of child joint objects of the leg
   inline int getJointCount(void) { return joint_count_; };
 
+  /// Accessor for the contiguous storage of the parent robot model, which holds the data of this leg's joints/links.
+  /// @return Pointer to the model storage object of the parent robot model
+  inline ModelStorage* getModelStorage(void) { return model_->getStorage(); };
+
   /// Accessor for the step coordination group of this leg.
   /// @return the step coordination group of the leg
   inline int getGroup(void) { return group_; };
   
   /// Accessor for the workspace polyhedron.
-  /// @return the workspace polyhedron of the leg
-  inline Workspace getWorkspace(void) { return workspace_; };
+  /// @return A pointer to the workspace polyhedron of the leg
+  inline Workspace* getWorkspace(void) { return &workspace_; };
 
   /// Accessor for the cuurent state of this leg.
   /// @return The current state of the leg
@@ -234,6 +471,28 @@ public:
   /// Accessor for the current calculated force vector on the tip of this leg.
   /// @return The current calculated force vector on the tip of the leg
   inline Eigen::Vector3d getTipForceCalculated(void) { return tip_force_calculated_; };
+
+  /// Accessor for the kinematic state (jacobian and pseudo-inverses) of this leg, regenerating it first if joint
+  /// transforms have changed since it was last generated.
+  /// @return The current kinematic state of this leg
+  inline const KinematicState& getKinematicState(void)
+  {
+    if (!kinematic_state_.valid)
+    {
+      updateKinematicState();
+    }
+    return kinematic_state_;
+  };
+
+  /// Generates the linear map from joint efforts to (unfiltered and unscaled) tip force used in tip force estimation,
+  /// from the kinematic state of this leg.
+  /// @return The map from joint efforts to tip force
+  TipForceMap getTipForceMap(void);
+
+  /// Generates the linear map from a change in tip position (robot frame) to the change in joint positions, as per
+  /// the first order (damped least squares) inverse kinematics of this leg about the current kinematic state.
+  /// @return The map from tip position delta to joint position delta
+  LinearJacobianInverse getTipDeltaMap(void);
   
   /// Accessor for the current measured force vector on the tip of this leg. 
   /// @return The current measured force vector on the tip of the leg
@@ -255,6 +514,11 @@ public:
   /// @return The current admittance control position offset for the leg
   inline Eigen::Vector3d getAdmittanceDelta(void) { return admittance_delta_; };
 
+  /// Accessor for the flag denoting if the admittance control position offset was applied to the current desired tip
+  /// pose of this leg.
+  /// @return Flag denoting if the admittance control position offset was applied to the current desired tip pose
+  inline bool getAdmittanceDeltaApplied(void) { return admittance_delta_applied_; };
+
   /// Accessor for the virtual mass value used in the admittance control model of this leg.
   /// @return The virtual mass value used in the admittance control model of the leg
   inline double getVirtualMass(void) { return virtual_mass_; };
@@ -401,16 +665,32 @@ public:
   /// Generates workspace polyhedron for this leg by searching for kinematic limitations.
   /// @return The generated workspace object
   Workspace generateWorkspace(void);
+
+  /// Searches along the line from the origin to the target tip position for the kinematic limit of this leg by
+  /// bracketing the limit with steps sized from the joint limit margins and joint rates along the search direction,
+  /// halving any infeasible step down to the linear search step, and then bisecting the bracket. Each check resumes
+  /// from the last feasible joint configuration, such that the leg remains on the kinematic branch of its configuration
+  /// at the origin. The leg is left in the furthest feasible configuration found.
+  /// @param[in] origin_tip_position The tip position at the origin of the search, which the leg is assumed to be at
+  /// @param[in] target_tip_position The tip position at the extent of the search
+  void bisectWorkspaceLimit(const Eigen::Vector3d& origin_tip_position, const Eigen::Vector3d& target_tip_position);
   
   /// Generates interpolated workplane within workspace from given height above workspace origin.
   /// @param[in] height The desired workplane height from workspace origin
-  /// @return The interpolated workplane at input height
+  /// @return The interpolated workplane at input height (empty if height is beyond the workspace)
   Workplane getWorkplane(const double& height);
   
   /// Generates a reachable tip position from an input test tip position within the workspace of this leg.
   /// @param[in] reference_tip_position The tip position to use as reference to generate a reachable tip position
   /// @return A reachable tip position which lies within the leg workspace based on the input reference tip position
   Eigen::Vector3d makeReachable(const Eigen::Vector3d& reference_tip_position);
+
+  /// Calculates the margin of each of a batch of test tip positions from the workspace limit of this leg, measured in
+  /// the same manner as makeReachable (i.e. a test tip position is left unchanged by makeReachable if its margin is
+  /// non-negative). The model pose transform is applied once to the entire batch.
+  /// @param[in] tip_positions The test tip positions (one per column) to evaluate
+  /// @param[out] margins The distance of each test tip position within the workspace limit (negative if beyond limit)
+  void calculateReachabilityMargins(const TipPositionBatch& tip_positions, TipMarginBatch* margins);
   
   /// Updates joint default positions according to current joint positions.
   void updateDefaultConfiguration(void);
@@ -451,6 +731,10 @@ public:
   /// @param[in] tip_velocity The new tip velocity of this leg object
   inline void setDesiredTipVelocity(const Eigen::Vector3d& tip_velocity) { desired_tip_velocity_ = tip_velocity; };
   
+  /// Generates the kinematic state of this leg (jacobian and damped least squares pseudo-inverses) from the current
+  /// joint transforms.
+  void updateKinematicState(void);
+
   /// Calculates an estimate for the tip force vector acting on this leg, using the calculated state jacobian and 
   /// values for the torque on each joint in the leg.
   /// @todo Implement rotation to tip frame
@@ -463,18 +747,28 @@ public:
   /// Applies inverse kinematics to calculate required joint positions to achieve desired tip pose. Inverse
   /// kinematics is generated via the calculation of a jacobian for the current state of the leg, which is used as per
   /// the Damped Least Squares method to generate a change in joint position for each joint.
+  /// Templated on leg DOF so that fixed size matrices are used (Eigen::Dynamic for legs outside of 3-6 DOF).
   /// @param[in] delta The iterative change in tip position and rotation
   /// @param[in] solve_rotation Flag denoting if IK should solve for rotation as well rather than just position
   /// @return The position delta for each joint in the model to achieve desired tip position delta. 
   /// @todo Calculate optimal DLS coefficient (this value currently works sufficiently)
-  Eigen::VectorXd solveIK(const Eigen::MatrixXd& delta, const bool& solve_rotation);
+  template <int DOF>
+  Eigen::Matrix<double, DOF, 1> solveIK(const Eigen::Matrix<double, 6, 1>& delta, const bool& solve_rotation);
+
+  /// Calculates joint position changes required to achieve a desired tip position via a closed form geometric
+  /// solution of a 3 DOF (coxa/femur/tibia) leg, derived from link DH parameters. Of the two possible knee
+  /// configurations, the one closest to the current configuration is chosen.
+  /// @param[in] target_tip_position The desired tip position in the frame of the first joint of the leg
+  /// @param[out] joint_position_delta The change in position of each joint to achieve the desired tip position
+  /// @return Flag denoting if a solution was found (false if target is unreachable or at a singularity)
+  bool solveAnalyticIK(const Eigen::Vector3d& target_tip_position, Eigen::Vector3d* joint_position_delta);
   
   /// Updates the joint positions of each joint in this leg based on the input vector. Clamps joint velocities and
   /// positions based on limits and calculates a ratio of proximity of joint position to limits.
   /// @param[in] delta The iterative change in joint position for each joint
   /// @param[in] simulation Flag denoting if this execution is for simulation purposes rather than normal use
   /// @return The ratio of the proximity of the joint position to it's limits (i.e. 0.0 = at limit, 1.0 = furthest away)
-  double updateJointPositions(const Eigen::VectorXd& delta, const bool& simulation);
+  double updateJointPositions(const Eigen::Ref<const Eigen::VectorXd>& delta, const bool& simulation);
 
   /// Applies inverse kinematics solution to achieve desired tip position. Clamps joint positions and velocities
   /// within limits and applies forward kinematics to update tip position. Returns an estimate of the chance of solving
@@ -482,7 +776,57 @@ public:
   /// @param[in] simulation Flag denoting if this execution is for simulation purposes rather than normal use
   /// @return A double between 0.0 and 1.0 which estimates the chance of solving IK within thresholds on the next 
   /// iteration. 0.0 denotes failure on THIS iteration.
-  double applyIK(const bool& simulation = false);
+  inline double applyIK(const bool& simulation = false) { return (this->*ik_kernel_)(simulation); };
+
+  /// DOF specific implementation of applyIK, selected for this leg at generation according to leg DOF.
+  /// @param[in] simulation Flag denoting if this execution is for simulation purposes rather than normal use
+  /// @return A double between 0.0 and 1.0 which estimates the chance of solving IK within thresholds on the next 
+  /// iteration. 0.0 denotes failure on THIS iteration.
+  template <int DOF>
+  double applyIKKernel(const bool& simulation);
+
+  /// Returns the transformation matrix between two elements of the kinematic chain of this leg from the cache of
+  /// cumulative transforms, regenerating the cache first if it has been invalidated.
+  /// @param[in] target_index Index of the element at the start of the transformation (0 = origin, 1-N = joints, 
+  /// N+1 = tip)
+  /// @param[in] index Index of the element at the end of the transformation (1-N = joints, N+1 = tip)
+  /// @return The transformation matrix from the target element to the requested element
+  inline Eigen::Matrix4d getCachedTransform(const int& target_index, const int& index)
+  {
+    if (!transform_cache_valid_)
+    {
+      updateTransformCache();
+    }
+    if (target_index == 0)
+    {
+      return base_transforms_[index];
+    }
+    return inverse_base_transforms_[target_index] * base_transforms_[index];
+  };
+
+  /// Returns the inverse of the transformation matrix from the origin to an element of the kinematic chain of this leg
+  /// from the cache of cumulative transforms, regenerating the cache first if it has been invalidated.
+  /// @param[in] index Index of the element at the end of the transformation (1-N = joints, N+1 = tip)
+  /// @return The transformation matrix from the requested element to the origin of the kinematic chain
+  inline Eigen::Matrix4d getCachedInverseTransform(const int& index)
+  {
+    if (!transform_cache_valid_)
+    {
+      updateTransformCache();
+    }
+    return inverse_base_transforms_[index];
+  };
+
+  /// Marks the cache of cumulative transforms as invalid, forcing regeneration on next access.
+  inline void invalidateTransformCache(void)
+  {
+    transform_cache_valid_ = false;
+    kinematic_state_.valid = false;
+  };
+
+  /// Regenerates the cache of cumulative transforms (and their inverses) from the origin of the kinematic chain to
+  /// each joint and the tip of this leg, using the current transform of each joint and tip.
+  void updateTransformCache(void);
 
   /// Updates joint transforms and applies forward kinematics to calculate a new tip pose. 
   /// Sets leg current tip pose to new pose if requested.
@@ -504,14 +848,22 @@ private:
   const int id_number_;         ///< The identification number for this leg
   const std::string id_name_;   ///< The identification name for this leg
   const int joint_count_;       ///< The number of child Joint objects associated with this leg
+  double (Leg::*ik_kernel_)(const bool&); ///< The DOF specific inverse kinematics kernel used by this leg
+  bool analytic_ik_compatible_ = false;   ///< Flag denoting if leg geometry allows analytic inverse kinematics
   LegState leg_state_;          ///< The current state of this leg
   
   Workspace workspace_;         ///< Polyhedron (planes of radii) representing workspace of this leg
 
+  TransformCache base_transforms_;         ///< Cached transforms from origin to each joint/tip in kinematic chain
+  TransformCache inverse_base_transforms_; ///< Cached inverse transforms from each joint/tip to origin
+  bool transform_cache_valid_ = false;     ///< Flag denoting if cached transforms match current joint transforms
+  KinematicState kinematic_state_;         ///< Kinematic state shared between inverse kinematics and force estimation
+
   ros::Publisher leg_state_publisher_;     ///< The ros publisher object that publishes state messages for this leg
   ros::Publisher asc_leg_state_publisher_; ///< The ros publisher object that publishes ASC state messages for this leg
 
   Eigen::Vector3d admittance_delta_; ///< The admittance controller tip position offset vector
+  bool admittance_delta_applied_;    ///< Flag denoting if admittance offset was applied to the desired tip pose
   double virtual_mass_;              ///< The virtual mass of the admittance controller virtual model of this leg
   double virtual_stiffness_;         ///< The virtual stiffness of the admittance controller virtual model of this leg
   double virtual_damping_ratio_;     ///< The virtual damping ratio of the admittance controller virtual model of leg
@@ -537,7 +889,7 @@ public:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles data for each 'link' of a parent leg object. This data includes the DH parameters which define
 /// the transformation between the actuating joint at the beginning of this link (in the kinematic chain) and the next
-/// joint for which this link is the reference.
+/// joint for which this link is the reference. DH parameters reference the contiguous storage of the robot model.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 class Link
 {
@@ -549,7 +901,8 @@ public:
   /// @param[in] params A pointer to the parameter data structure
   Link(std::shared_ptr<Leg> leg,std::shared_ptr<Joint> actuating_joint, const int& id_number, const Parameters& params);
   
-  /// Copy Constructor for Link object. Initialises member variables from existing Link object.
+  /// Copy Constructor for Link object. Initialises member variables from existing Link object, referencing the same
+  /// elements of model storage.
   /// @param[in] link A pointer to an existing link object
   Link(std::shared_ptr<Link> link);
 
@@ -557,10 +910,10 @@ public:
   const std::shared_ptr<Joint> actuating_joint_; ///< A pointer to the actuating Joint object associated with this link
   const int id_number_;                          ///< The identification number for this link
   const std::string id_name_;                    ///< The identification name for this link
-  const double dh_parameter_r_;                  ///< The DH parameter 'r' associated with this link
-  const double dh_parameter_theta_;              ///< The DH parameter 'theta' associated with this link
-  const double dh_parameter_d_;                  ///< The DH parameter 'd' associated with this link
-  const double dh_parameter_alpha_;              ///< The DH parameter 'alpha' associated with this link
+  const double& dh_parameter_r_;                 ///< The DH parameter 'r' associated with this link
+  const double& dh_parameter_theta_;             ///< The DH parameter 'theta' associated with this link
+  const double& dh_parameter_d_;                 ///< The DH parameter 'd' associated with this link
+  const double& dh_parameter_alpha_;             ///< The DH parameter 'alpha' associated with this link
   
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -568,7 +921,8 @@ public:
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles data for each 'joint' of a parent leg object and contains functions which allow the 
-/// transformation of positions between the robot frame and the joint frame along the kinematic chain.
+/// transformation of positions between the robot frame and the joint frame along the kinematic chain. Joint limits,
+/// state and transform reference the contiguous storage of the robot model.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 class Joint
 {
@@ -580,22 +934,18 @@ public:
   /// @param[in] params A pointer to the parameter data structure
   Joint(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link, const int& id_number, const Parameters& params);
   
-  /// Copy Constructor for Joint object. Initialises member variables from existing Joint object.
-  /// @param[in] joint A pointer to an existing Joint object
-  Joint(std::shared_ptr<Joint> joint);
-  
   /// Constructor for null joint object. Acts as a null joint object for use in ending kinematic chains.
-  Joint(void);
+  /// @param[in] storage The model storage containing the origin element (index 0) referenced by this null joint
+  /// @param[in] leg_id_number The identification number of the leg for which this null joint acts as origin
+  Joint(ModelStorage* storage, const int& leg_id_number);
 
   /// Returns the transformation matrix from the specified target joint of the robot model to this joint. 
-  /// Target joint defaults to the origin of the kinematic chain.
+  /// Target joint defaults to the origin of the kinematic chain. Retrieved from the parent leg transform cache.
   /// @param[in] target_joint_id ID number of joint object defining the target joint for the transformation
   /// @return The transformation matrix from target joint to this joint
   inline Eigen::Matrix4d getTransformFromJoint(const int& target_joint_id = 0) const
   {
-    std::shared_ptr<Joint> next_joint = reference_link_->actuating_joint_;
-    bool at_target = (target_joint_id == next_joint->id_number_);
-    return at_target ? current_transform_ : next_joint->getTransformFromJoint(target_joint_id) * current_transform_;
+    return parent_leg_->getCachedTransform(target_joint_id, id_number_);
   };
 
   /// Returns the pose of (or a pose relative to) the origin of this joint in the frame of the robot model.
@@ -612,40 +962,40 @@ public:
   /// @return The input pose transformed into the frame of this joint
   inline Pose getPoseJointFrame(const Pose& robot_frame_pose = Pose::Identity()) const
   {
-    Eigen::MatrixXd transform = getTransformFromJoint();
-    return robot_frame_pose.transform(transform.inverse());
+    Eigen::Matrix4d transform = parent_leg_->getCachedInverseTransform(id_number_);
+    return robot_frame_pose.transform(transform);
   };
 
   const std::shared_ptr<Leg> parent_leg_;      ///< A pointer to the parent leg object associated with this joint
   const std::shared_ptr<Link> reference_link_; ///< A pointer to the reference Link object associated with this joint
   const int id_number_;                        ///< The identification number for this joint
   const std::string id_name_;                  ///< The identification name for this joint
-  Eigen::Matrix4d current_transform_;          ///< The current transformation matrix between previous joint and joint
+  Eigen::Matrix4d& current_transform_;         ///< The current transformation matrix between previous joint and joint
   Eigen::Matrix4d identity_transform_;         ///< The identity transformation matrix between previous joint and joint
 
   ros::Publisher desired_position_publisher_;  ///< The ros publisher for publishing desired position values
 
-  const double min_position_ = 0.0;            ///< The minimum position allowed for this joint
-  const double max_position_ = 0.0;            ///< The maximum position allowed for this joint
+  const double& min_position_;                 ///< The minimum position allowed for this joint
+  const double& max_position_;                 ///< The maximum position allowed for this joint
   const double offset_ = 0.0;                  ///< The position offset applied at output of SHC
   std::vector<double> packed_positions_ ;      ///< The defined position of this joint in a 'packed' state
   const double unpacked_position_ = 0.0;       ///< The defined position of this joint in an 'unpacked' state
-  const double max_angular_speed_ = 0.0;       ///< The maximum angular speed of this joint
-
-  double desired_position_ = 0.0;      ///< The desired angular position of this joint
-  double desired_velocity_ = 0.0;      ///< The desired angular velocity of this joint
-  double desired_effort_ = 0.0;        ///< The desired angular effort of this joint
-  double prev_desired_position_ = 0.0; ///< The desired angular position of this joint at the previous iteration
-  double prev_desired_velocity_ = 0.0; ///< The desired angular velocity of this joint at the previous iteration
-  double prev_desired_effort_ = 0.0;   ///< The desired angular effort of this joint at the previous iteration
-
-  double current_position_ = UNASSIGNED_VALUE; ///< The current position of this joint according to hardware
-  double current_velocity_ = 0.0;              ///< The current velocity of this joint according to hardware
-  double current_effort_ = 0.0;                ///< The current effort of this joint according to hardware
+  const double& max_angular_speed_;            ///< The maximum angular speed of this joint
+
+  double& desired_position_;      ///< The desired angular position of this joint
+  double& desired_velocity_;      ///< The desired angular velocity of this joint
+  double& desired_effort_;        ///< The desired angular effort of this joint
+  double& prev_desired_position_; ///< The desired angular position of this joint at the previous iteration
+  double& prev_desired_velocity_; ///< The desired angular velocity of this joint at the previous iteration
+  double& prev_desired_effort_;   ///< The desired angular effort of this joint at the previous iteration
+
+  double& current_position_;      ///< The current position of this joint according to hardware
+  double& current_velocity_;      ///< The current velocity of this joint according to hardware
+  double& current_effort_;        ///< The current effort of this joint according to hardware
   
-  double default_position_ = UNASSIGNED_VALUE; ///< The default position of this joint
-  double default_velocity_ = 0.0;              ///< The default velocity of this joint
-  double default_effort_ = 0.0;                ///< The default effort of this joint
+  double& default_position_;      ///< The default position of this joint
+  double& default_velocity_;      ///< The default velocity of this joint
+  double& default_effort_;        ///< The default effort of this joint
 
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -653,7 +1003,8 @@ public:
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles data for the 'tip' of a parent leg object and contains functions which allow the transformation
-/// of positions between the robot frame and the tip frame along the kinematic chain.
+/// of positions between the robot frame and the tip frame along the kinematic chain. The tip transform references the
+/// contiguous storage of the robot model.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 class Tip
 {
@@ -663,19 +1014,13 @@ public:
   /// @param[in] reference_link A pointer to the reference link object, which is attached to this tip object
   Tip(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link);
   
-  /// Copy Constructor for Tip object. Initialises member variables from existing Tip object.
-  /// @param[in] tip A pointer to an existing tip object
-  Tip(std::shared_ptr<Tip> tip);
-
   /// Returns the transformation matrix from the specified target joint  of the robot model to the tip. 
-  /// Target joint defaults to the origin of the kinematic chain.
+  /// Target joint defaults to the origin of the kinematic chain. Retrieved from the parent leg transform cache.
   /// @param[in] target_joint_id ID number of joint object defining the target joint for the transformation
   /// @return The transformation matrix from target joint to the tip
   inline Eigen::Matrix4d getTransformFromJoint(const int& target_joint_id = 0) const
   {
-    std::shared_ptr<Joint> next_joint = reference_link_->actuating_joint_;
-    bool at_target = (target_joint_id == next_joint->id_number_);
-    return at_target ? current_transform_ : next_joint->getTransformFromJoint(target_joint_id) * current_transform_;
+    return parent_leg_->getCachedTransform(target_joint_id, parent_leg_->getJointCount() + 1);
   };
 
   /// Returns the pose of (or a pose relative to) the origin of the tip in the frame of the robot model.
@@ -692,14 +1037,14 @@ public:
   /// @return The input pose transformed into the tip frame
   inline Pose getPoseTipFrame(const Pose& robot_frame_pose = Pose::Identity()) const
   {
-    Eigen::Matrix4d transform = getTransformFromJoint();
-    return robot_frame_pose.transform(transform.inverse());
+    Eigen::Matrix4d transform = parent_leg_->getCachedInverseTransform(parent_leg_->getJointCount() + 1);
+    return robot_frame_pose.transform(transform);
   };
 
   const std::shared_ptr<Leg> parent_leg_;      ///< A pointer to the parent leg object associated with the tip
   const std::shared_ptr<Link> reference_link_; ///< A pointer to the reference Link object associated with the tip
   const std::string id_name_;                  ///< The identification name for the tip
-  Eigen::Matrix4d current_transform_;          ///< The current transformation matrix between previous joint and tip
+  Eigen::Matrix4d& current_transform_;         ///< The current transformation matrix between previous joint and tip
   Eigen::Matrix4d identity_transform_;         ///< The identity transformation matrix between previous joint and tip
 
 public:
@@ -294,6 +294,10 @@ struct Parameters
   Parameter<bool> clamp_joint_positions;           ///< A bool denoting if joint position limits are adhered to
   Parameter<bool> clamp_joint_velocities;          ///< A bool denoting if joint velocity limits are adhered to
   Parameter<bool> ignore_IK_warnings;              ///< A bool denoting if IK deviation warnings are displayed to user
+  Parameter<bool> use_analytic_IK;                 ///< A bool denoting if closed form IK is used for 3 DOF legs
+  Parameter<bool> bisect_workspace_search;         ///< A bool denoting if workspace limits are found via bisection
+  Parameter<int> workspace_bearing_step;           ///< The step between bearings of each workspace plane (deg)
+  Parameter<int> workspace_layers;                 ///< The number of planes within the workspace polyhedron
 
   Parameter<std::map<std::string, double>> joint_parameters[8][6]; ///< Array of maps of joint parameter names & values*
   Parameter<std::map<std::string, double>> link_parameters[8][7];  ///< Array of maps of link parameter names & values*
@@ -301,6 +305,9 @@ struct Parameters
 
   // Walk controller parameters
   Parameter<std::string> gait_type;                 ///< The default selected gait type
+  Parameter<double> gait_transition_cycles;         ///< Step cycles over which gait changes are blended whilst walking
+  Parameter<bool> free_gait;                        ///< Flag denoting if legs decide when to lift off independently
+  Parameter<double> free_gait_stability_margin;     ///< Min stability margin of support polygon to permit liftoff
   Parameter<double> body_clearance;                 ///< The requested height of the robot body above ground
   AdjustableParameter step_frequency;               ///< The frequency of complete step cycles (Hz)
   AdjustableParameter swing_height;                 ///< Vertical displacement of swing trajectory above default
@@ -317,6 +324,9 @@ struct Parameters
   Parameter<bool> gravity_aligned_tips;             ///< Flag denoting if tip should align with gravity direction
   Parameter<double> touchdown_threshold;            ///< Threshold of tip force before touchdown is recognized
   Parameter<double> liftoff_threshold;              ///< Threshold of tip force before liftoff is recognized
+  Parameter<double> walk_plane_outlier_threshold;   ///< Tip residual from walk plane beyond which tip is down-weighted
+  Parameter<int> footstep_candidates;               ///< Number of candidate footholds evaluated per swing
+  Parameter<double> footstep_search_radius;         ///< Distance of candidate footholds from nominal swing target
   Parameter<std::map<std::string, double>> linear_cruise_velocity;  ///< Set values used in cruise control mode if used
   Parameter<std::map<std::string, double>> leg_stance_positions[8]; ///< Array of maps of default tip stance positions
 
@@ -336,6 +346,8 @@ struct Parameters
   Parameter<bool> dynamic_stiffness;         ///< Flag denoting whether the virtual stiffness variable is dynamic
   Parameter<bool> use_joint_effort;          ///< Flag denoting whether the tip force input is derived from joint effort
   Parameter<double> integrator_step_time;    ///< The step time used in admittance controller calculations
+  Parameter<bool> exact_admittance_integrator; ///< Flag denoting if admittance uses exact (ZOH) discretisation
+  Parameter<double> compliance_loop_rate;    ///< The rate of the inner compliance loop thread (Hz, 0 to disable)
   AdjustableParameter virtual_mass;          ///< The virtual mass value used in admittance controller calculations
   AdjustableParameter virtual_stiffness;     ///< The virtual stiffness value used in admittance controller calculations
   Parameter<double> load_stiffness_scaler;   ///< The value used to scale the virtual stiffness value for loaded legs
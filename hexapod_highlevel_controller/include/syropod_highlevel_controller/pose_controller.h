@@ -22,6 +22,9 @@
 #define VERTICAL_TRANSITION_TIME 3.0   ///< Body raise time during vertical transtion (seconds @ step frequency == 1.0)
 #define STABILITY_THRESHOLD 100        ///< Rotation correction magnitude threshold, ensuring imu posing PID is not unstable.
 #define TRANSITION_STEP_THRESHOLD 20   ///< Number of allowed transition steps before executeSequence() deemed a failure
+#define SEQUENCE_CACHE_VERSION 1       ///< Version of transition sequence cache file format and discovery algorithm
+#define SEQUENCE_CACHE_DIRECTORY "shc_sequence" ///< Name of sequence cache directory within ROS home directory
+#define SEQUENCE_CACHE_PRECISION 4     ///< Decimal places of tip positions used in generating sequence hash
 #define IMU_POSING_DEADBAND 0.0        ///< Rotation deadband for which imu posing assumes correct rotation (radians)
 
 class AutoPoser;
@@ -39,6 +42,7 @@ class AutoPoser;
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef Eigen::aligned_allocator<std::shared_ptr<AutoPoser>> AutoPoserAlignedAllocator;
 typedef std::vector<std::shared_ptr<AutoPoser>, AutoPoserAlignedAllocator> AutoPoserContainer;
+typedef std::map<int, sensor_msgs::JointState> ConfigurationMap; ///< Joint configurations keyed by leg id number
 class PoseController : public std::enable_shared_from_this<PoseController>
 {
 public:
@@ -67,9 +71,9 @@ public:
   /// @return The phase length of the auto posing cycle
   inline int getPhaseLength(void) { return pose_phase_length_; };
 
-  /// Accessor for normaliser value.
-  /// @return The normaliser value (The value used to scale base posing cycle start/end ratios)
-  inline int getNormaliser(void) { return normaliser_; };
+  /// Accessor for pose phase delta.
+  /// @return The phase advanced by the auto posing cycle each iteration
+  inline double getPhaseDelta(void) { return pose_phase_delta_; };
 
   /// Accessor for pose frequency.
   /// @return The pose frequence (The frequency used in determining auto-pose phase length)
@@ -94,10 +98,9 @@ public:
   /// @param[in] phase_length The phase length to be set as the phase length of the auto posing cycle
   inline void setPhaseLength(const int &phase_length) { pose_phase_length_ = phase_length; };
 
-  /// Modifier for normalisation value.
-  /// @param[in] normaliser The value to be set as the normaliser value (The value used to scale base posing cycle
-  /// start/end ratios)
-  inline void setNormaliser(const int &normaliser) { normaliser_ = normaliser; };
+  /// Modifier for pose phase delta.
+  /// @param[in] phase_delta The value to be set as the phase advanced by the auto posing cycle each iteration
+  inline void setPhaseDelta(const double &phase_delta) { pose_phase_delta_ = phase_delta; };
 
   /// Modifier for pose reset mode.
   /// @param[in] mode The mode to be set as the pose reset mode (Mode for controlling which posing axes to reset
@@ -169,9 +172,19 @@ public:
   /// their current tip position to its default tip position (as defined by the walk controller). The joint states for
   /// each leg are saved for the deafult tip position and then the joint moved inpdependently from initial position to
   /// saved default positions. This motion completes in a time limit defined by the parameter time_to_start.
+  /// The simulation runs on a background thread whilst the robot holds its current pose, reporting zero progress.
   /// @return Returns an int from 0 to 100 signifying the progress of the sequence (100 meaning 100% complete)
   int directStartup(void);
 
+  /// Simulates each leg of a planning model copy moving its tip linearly to the default tip position and records the
+  /// resulting joint configuration. Runs on a worker thread so must only access the given model copy.
+  /// @param[in] plan_model Copy of the robot model, initialised at the default joint positions, to be simulated
+  /// @param[in] target_pose The body pose used when stepping tips to default tip positions
+  /// @param[in] time_to_start The time period over which the simulated tip trajectories are generated
+  /// @return Map of default joint configurations for each leg, keyed by leg id number
+  static ConfigurationMap planDefaultConfigurations(std::shared_ptr<Model> plan_model, const Pose target_pose,
+                                                    const double time_to_start);
+
   /// Iterates through legs in robot model and attempts to step each from their current tip position to their default
   /// tip position (as defined by the walk controller). The stepping motion is coordinated such that half of the legs
   /// execute the step at any one time (for a hexapod this results in a Tripod stepping coordination). The time period
@@ -237,9 +250,10 @@ public:
   void updateWalkPlanePose(void);
 
   /// Updates the auto pose by feeding each Auto Poser object a phase value and combining the output of each Auto Poser
-  /// object into a single pose. The input master phase is either an iteration of the pose phase or synced to the step
-  /// phase from the Walk Controller. This function also iterates through all leg objects in the robot model and updates
-  /// each Leg Poser's specific Auto Poser pose (this pose is used when the leg needs to ignore the default auto pose)
+  /// object into a single pose. The input master phase is either the continuous pose phase (advanced each iteration
+  /// according to pose frequency) or synced to the step phase from the Walk Controller. This function also iterates
+  /// through all leg objects in the robot model and updates each Leg Poser's specific Auto Poser pose (this pose is
+  /// used when the leg needs to ignore the default auto pose)
   void updateAutoPose(void);
 
   /// Attempts to generate a pose (pitch/roll rotation only) for the robot model to 'correct' any differences between
@@ -260,6 +274,24 @@ public:
   /// manually manipulated (non-load bearing) legs and remain balanced.
   void calculateDefaultPose(void);
 
+  /// Generates a hash of all parameters affecting discovery of the start up transition sequence. This includes the
+  /// stepping parameters, the kinematic parameters of each leg and the target tip positions of the sequence.
+  /// @return The hash of transition sequence parameters
+  uint64_t generateSequenceHash(void);
+
+  /// Loads the transition poses of each leg from a transition sequence cache file. The file is validated against the
+  /// cache version, sequence hash, leg count and current tip pose of each leg before any transition pose is added.
+  /// @param[in] file_name The path of the transition sequence cache file
+  /// @param[in] hash The expected transition sequence hash
+  /// @return Flag denoting if the transition sequence was successfully loaded from the cache file
+  bool loadTransitionSequence(const std::string &file_name, const uint64_t &hash);
+
+  /// Saves the transition poses of each leg to a transition sequence cache file. The file is written in full before
+  /// atomically replacing any existing file.
+  /// @param[in] file_name The path of the transition sequence cache file
+  /// @param[in] hash The transition sequence hash
+  void saveTransitionSequence(const std::string &file_name, const uint64_t &hash);
+
 private:
   std::shared_ptr<Model> model_; ///< Pointer to robot model object
   const Parameters &params_;     ///< Pointer to parameter data structure for storing parameter variables
@@ -292,6 +324,7 @@ private:
   Pose target_body_pose_;                        ///< Target body pose from planner to be transitioned to
 
   bool executing_transition_ = false; ///< Flag denoting if the pose controller is executing a transition
+  std::future<ConfigurationMap> default_configuration_plan_; ///< Pending result of background direct startup planner
 
   int transition_step_ = 0;                     ///< The current transition step in the sequence being executed
   int transition_step_count_ = 0;               ///< Total number of transition steps in the sequence being executed
@@ -302,15 +335,17 @@ private:
   bool vertical_transition_complete_ = false;   ///< Flags if the vertical transition has completed without error
   bool first_sequence_execution_ = true;        ///< Flags if the controller has executed its first sequence
   bool reset_transition_sequence_ = true;       ///< Flags if the saved transition sequence needs to be regenerated
+  std::string sequence_cache_file_name_;        ///< Cache file to save the transition sequence to once discovered
+  uint64_t sequence_hash_ = 0;                  ///< Hash of parameters used in discovering the transition sequence
 
   std::vector<double> default_joint_positions_[8]; ///< Joint positions for default stance used in Direct Startup
 
   AutoPoserContainer auto_poser_container_;         ///< Object containing all Auto Poser objects
   PosingState auto_posing_state_ = POSING_COMPLETE; ///< The state of auto posing
-  int pose_phase_ = 0;                              ///< The current phase used in auto posing if not synced to walk
-  double pose_frequency_ = 0.0;                     ///< The frequency used in determining auto-pose phase length
+  double pose_phase_ = 0.0;                         ///< The current phase used in auto posing if not synced to walk
+  double pose_frequency_ = 0.0;                     ///< The frequency used in determining auto-pose phase delta
   int pose_phase_length_ = 0;                       ///< The phase length of the auto posing cycle
-  int normaliser_ = 1;                              ///< The value used to scale base posing cycle start/end ratios
+  double pose_phase_delta_ = 0.0;                   ///< The phase advanced by the auto posing cycle each iteration
 
   Eigen::Vector3d rotation_absement_error_; ///< Difference btw. current & desired rotation absement for IMU posing PID
   Eigen::Vector3d rotation_position_error_; ///< Difference btw. current & desired rotation position for IMU posing PID
@@ -398,7 +433,7 @@ public:
   /// which defines the output pose
   /// @return The component of auto pose contributed by this Auto Poser object's posing cycle defined by user parameters
   /// @see config/auto_pose.yaml
-  Pose updatePose(int phase);
+  Pose updatePose(double phase);
 
 private:
   std::shared_ptr<PoseController> poser_; ///< Pointer to pose controller object
@@ -523,6 +558,10 @@ public:
   /// @return Flag denoting whether the transition pose of the requested index exists
   inline bool hasTransitionPose(const int &index) { return int(transition_poses_.size()) > index; };
 
+  /// Accessor for the number of transition tip poses.
+  /// @return The number of transition tip poses
+  inline int getTransitionPoseCount(void) { return int(transition_poses_.size()); };
+
   /// Adds tip position to vector of transition tip poses.
   /// @param[in] transition Transition pose to be added to the vector of transition tip poses
   inline void addTransitionPose(const Pose &transition) { transition_poses_.push_back(transition); };
@@ -565,7 +604,7 @@ public:
   /// period which is used to interpolate to/from is defined by the negation transition ratio parameter.
   /// @param[in] phase The phase is the input value which is used to determine the progression along the bezier curves
   /// which define the output pose
-  void updateAutoPose(const int &phase);
+  void updateAutoPose(const double &phase);
 
 private:
   std::shared_ptr<PoseController> poser_;   ///< Pointer to pose controller object
@@ -32,6 +32,8 @@
 #include <geometry_msgs/Transform.h>
 #include <geometry_msgs/TransformStamped.h>
 
+#include <nav_msgs/Odometry.h>
+
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
 
@@ -48,6 +50,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <cstdint>
+#include <sys/stat.h>
 
 #define UNASSIGNED_VALUE double(INT_MAX) ///< Value used to determine if variable has been assigned
 #define PROGRESS_COMPLETE 100            ///< Value denoting 100% and a completion of progress of various functions
@@ -58,6 +66,9 @@
 
 #define GRAVITY_ACCELERATION -9.81 ///< Approximate gravitational acceleration (m/s/s)
 
+#define FNV_OFFSET_BASIS 14695981039346656037ULL ///< Initial value of 64 bit FNV-1a hash
+#define FNV_PRIME 1099511628211ULL               ///< Multiplier of 64 bit FNV-1a hash
+
 /// Converts Degrees to Radians.
 /// @param[in] degrees Value in degrees to be converted to radians
 /// @return Value converted to radians from degrees
@@ -75,6 +86,17 @@ inline double radiansToDegrees(const double& radians) { return (radians / (2.0 *
 template <class T>
 inline T mod(const T& a, const T& b) { return (a % b + b) % b; }
 
+/// Performs the floating point modulo operation with adherence to Euclidean division.
+/// @param[in] a The dividend for the operation
+/// @param[in] b The divisor for the operation
+/// @return The result after performing modulo operation with adherence to Euclidean division (0.0 -> b)
+inline double mod(const double& a, const double& b)
+{
+  double result = std::fmod(a, b);
+  result = (result < 0.0 ? result + b : result);
+  return (result < b ? result : 0.0);
+}
+
 /// Performs the square operation.
 /// @param[in] val The value to be squared
 /// @return The result after squaring the value
@@ -92,11 +114,6 @@ inline T sign(const T& val) { return (val > 0 ? 1 : -1); }
 /// @return Nearest integer to the input number
 inline int roundToInt(const double& x) { return (x >= 0 ? int(x + 0.5) : -int(0.5 - x)); }
 
-/// Rounds the input number to the nearest EVEN integer.
-/// @param[in] x The input number
-/// @return Nearest even integer to the input number
-inline int roundToEvenInt(const double& x) { return (int(x) % 2 == 0 ? int(x) : int(x) + 1); }
-
 /// Returns the input value 'clamped' within min and max limits.
 /// @param[in] value The input value
 /// @param[in] min_value The minimum limit
@@ -136,6 +153,76 @@ inline T clamped(const T& value, const T& limit)
   return result;
 }
 
+/// Updates a 64 bit FNV-1a hash with raw bytes of data.
+/// @param[in] data Pointer to the data to be hashed
+/// @param[in] size The size of the data in bytes
+/// @param[in] hash The hash to be updated
+/// @return The updated hash
+inline uint64_t hashBytes(const void* data, const size_t& size, const uint64_t& hash = FNV_OFFSET_BASIS)
+{
+  uint64_t result = hash;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    result = (result ^ bytes[i]) * FNV_PRIME;
+  }
+  return result;
+}
+
+/// Updates a 64 bit FNV-1a hash with an input value.
+/// @param[in] value The input value (of trivially copyable type)
+/// @param[in] hash The hash to be updated
+/// @return The updated hash
+template <class T>
+inline uint64_t hashValue(const T& value, const uint64_t& hash = FNV_OFFSET_BASIS)
+{
+  return hashBytes(&value, sizeof(T), hash);
+}
+
+/// Updates a 64 bit FNV-1a hash with an input string.
+/// @param[in] value The input string
+/// @param[in] hash The hash to be updated
+/// @return The updated hash
+inline uint64_t hashValue(const std::string& value, const uint64_t& hash = FNV_OFFSET_BASIS)
+{
+  return hashBytes(value.data(), value.size(), hashValue(value.size(), hash));
+}
+
+/// Updates a 64 bit FNV-1a hash with each key and value of an input map.
+/// @param[in] value The input map
+/// @param[in] hash The hash to be updated
+/// @return The updated hash
+template <class T>
+inline uint64_t hashValue(const std::map<std::string, T>& value, const uint64_t& hash = FNV_OFFSET_BASIS)
+{
+  uint64_t result = hashValue(value.size(), hash);
+  typename std::map<std::string, T>::const_iterator it;
+  for (it = value.begin(); it != value.end(); ++it)
+  {
+    result = hashValue(it->second, hashValue(it->first, result));
+  }
+  return result;
+}
+
+/// Returns the path of a directory for persistent cache files within the ROS home directory ($ROS_HOME or ~/.ros),
+/// creating the directory if it does not exist.
+/// @param[in] name The name of the cache directory
+/// @return The path of the cache directory (empty if the ROS home directory is unknown)
+inline std::string getCacheDirectory(const std::string& name)
+{
+  const char* ros_home = getenv("ROS_HOME");
+  const char* home = getenv("HOME");
+  std::string ros_home_directory = ros_home ? std::string(ros_home) : (home ? std::string(home) + "/.ros" : "");
+  if (ros_home_directory.empty())
+  {
+    return "";
+  }
+  mkdir(ros_home_directory.c_str(), 0755);
+  std::string cache_directory = ros_home_directory + "/" + name;
+  mkdir(cache_directory.c_str(), 0755);
+  return cache_directory;
+}
+
 /// Returns the input value with a precision defined by the precision input. (Eg: 1.00001 @ precision = 3 -> 1.000)
 /// @param[in] value The input value
 /// @param[in] precision The required precision
@@ -419,6 +506,20 @@ inline T quarticBezierDot(const T* points, const double& t)
           12.0 * s * t * t * (points[3] - points[2]) + 4.0 * t * t * t * (points[4] - points[3]));
 }
 
+/// Returns the weight of each control node of a 4th order bezier curve in the derivative of the curve at a given time
+/// input, such that the derivative is the weighted sum of the control nodes.
+/// @param[in] t A time input from 0.0 to 1.0
+/// @return The weight of each control node in the derivative of the bezier curve at the time input
+inline Eigen::Matrix<double, 5, 1> quarticBezierDotWeights(const double& t)
+{
+  double s = 1.0 - t;
+  double a = 4.0 * s * s * s;
+  double b = 12.0 * s * s * t;
+  double c = 12.0 * s * t * t;
+  double d = 4.0 * t * t * t;
+  return (Eigen::Matrix<double, 5, 1>() << -a, a - b, b - c, c - d, d).finished();
+}
+
 /// Returns a vector representing a 3d point at a given time input along a 4th order bezier curve defined by input
 /// control nodes. Depending on the complexity of the target curve, it will generate points that will pass through
 /// the defined control points. If the target curve is too complex the generate point will approximately go near
@@ -473,6 +574,17 @@ inline Eigen::Matrix4d createDHMatrix(const double& d, const double& theta, cons
   return m;
 }
 
+/// Inverts a homogeneous transformation matrix consisting of only rotation and translation (such as a DH matrix).
+/// @param[in] transform The rigid homogeneous transformation matrix to invert
+/// @return The inverse of the input transformation matrix
+inline Eigen::Matrix4d invertRigidTransform(const Eigen::Matrix4d& transform)
+{
+  Eigen::Matrix4d inverse = Eigen::Matrix4d::Identity();
+  inverse.block<3, 3>(0, 0) = transform.block<3, 3>(0, 0).transpose();
+  inverse.block<3, 1>(0, 3) = -inverse.block<3, 3>(0, 0) * transform.block<3, 1>(0, 3);
+  return inverse;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #endif // SYROPOD_HIGHLEVEL_CONTROLLER_STANDARD_INCLUDES_H
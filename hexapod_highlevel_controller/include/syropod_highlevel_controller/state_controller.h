@@ -98,9 +98,11 @@ public:
   /// @todo Implement smooth "whilst walking" adjustment of step_frequency and body_clearance
   void adjustParameter(void);
 
-  /// Handles a gait change event. Forces robot velocity input to zero until it is in a STOPPED walk state and then
-  /// updates gait parameters based on the new gait selection and reinitialises the walk controller with the new
-  /// parameters. If required the pose controller is reinitialised with new 'auto posing' parameters.
+  /// Handles a gait change event. Whilst walking (and if gait transition cycles are requested) gait parameters are
+  /// updated based on the new gait selection and the walk controller transitions to the new gait without stopping.
+  /// Otherwise forces robot velocity input to zero until it is in a STOPPED walk state and then updates gait
+  /// parameters and reinitialises the walk controller with the new parameters. If required the pose controller is
+  /// reinitialised with new 'auto posing' parameters.
   void changeGait(void);
 
   /// Handles a leg toggle event. Forces robot velocity input to zero until it is in a STOPPED walk state and then
@@ -128,6 +130,9 @@ public:
   /// Publishes current pose (roll, pitch, yaw, x, y, z) for debugging.
   void publishPose(void);
 
+  /// Publishes odometry (with covariance) estimated from leg kinematics of legs in stance and imu orientation.
+  void publishOdometry(void);
+
   /// Publishes details about current workspace (average/min/max radius) for debugging.
   void publishWalkspace(void);
 
@@ -140,6 +145,9 @@ public:
   /// Generates transforms for external leg stepper targets based on frame id and time.
   void generateExternalTargetTransforms(void);
 
+  /// Generates the input to the compliance loop from the current state of each leg and admittance parameters.
+  void generateComplianceInput(void);
+
   /// Sets up velocities for and calls debug output object to publish various debugging visualations via rviz.
   void RVIZDebugging(void);
 
@@ -306,6 +314,7 @@ private:
   ros::Publisher velocity_publisher_;            ///< Publisher for topic /shc/velocity
   ros::Publisher pose_publisher_;                ///< Publisher for topic /shc/pose
   ros::Publisher walkspace_publisher_;           ///< Publisher for topic /shc/walkspace
+  ros::Publisher odometry_publisher_;            ///< Publisher for topic /shc/odometry
   ros::Publisher rotation_pose_error_publisher_; ///< Publisher for topic /shc/rotation_pose_error
   ros::Publisher plan_step_request_publisher_;   ///< Publisher for topic /shc/plan_step_request
 
@@ -320,6 +329,9 @@ private:
   std::shared_ptr<WalkController> walker_;           ///< Pointer to walk controller object
   std::shared_ptr<PoseController> poser_;            ///< Pointer to pose controller object
   std::shared_ptr<AdmittanceController> admittance_; ///< Pointer to admittance controller object
+  std::shared_ptr<ComplianceLoop> compliance_loop_; ///< Pointer to compliance loop object (NULL if not running)
+  ComplianceInput compliance_input_;                 ///< The input to the compliance loop from the control loop
+  ComplianceOutput compliance_output_;               ///< The latest output of the compliance loop
   DebugVisualiser debug_visualiser_;                 ///< Debug class object used for RVIZ visualization
   Parameters params_;                                ///< Parameter data structure for storing parameter variables
 
@@ -332,6 +344,7 @@ private:
   RobotState new_robot_state_ = UNKNOWN;     ///< Desired state of the robot
 
   GaitDesignation gait_selection_ = GAIT_UNDESIGNATED;            ///< Current gait selection for the walk cycle
+  GaitDesignation transition_gait_ = GAIT_UNDESIGNATED;           ///< Gait being transitioned to whilst walking
   PosingMode posing_mode_ = NO_POSING;                            ///< Current posing mode for manual posing
   CruiseControlMode cruise_control_mode_ = CRUISE_CONTROL_OFF;    ///< Current cruise control mode
   PlannerMode planner_mode_ = PLANNER_MODE_OFF;                   ///< Current planner mode
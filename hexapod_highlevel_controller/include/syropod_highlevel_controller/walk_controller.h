@@ -14,22 +14,150 @@
 #include "pose.h"
 #include "model.h"
 
+#define PHASE_TOLERANCE 1e-6 ///< Tolerance absorbing floating point error accumulated when advancing step cycle phase
+#define GAIT_TRANSITION_SHIFT_RATIO 0.25 ///< Max phase shift of a stance leg per iteration (ratio of phase delta)
+#define WALKSPACE_TIME_BUDGET 0.2        ///< Ratio of control period available to walkspace regeneration per iteration
+#define WALKSPACE_INPUT_TOLERANCE 1e-4   ///< Change in walkspace inputs (m) below which walkspace is not regenerated
+#define WALK_PLANE_MAX_POINTS 8          ///< Max number of tip positions used in walk plane estimation (max leg count)
+#define WALK_PLANE_ROBUST_ITERATIONS 3   ///< Number of re-weighting iterations of robust walk plane estimation
+#define WALK_PLANE_SINGULARITY_TOLERANCE 1e-12 ///< Min determinant of normal equations of a solvable walk plane
+#define ODOMETRY_MIN_VARIANCE 1e-10      ///< Min variance of each element of an estimated odometry pose delta
+#define ODOMETRY_FALLBACK_VARIANCE 1e-4  ///< Variance of each element of an odometry pose delta from commanded velocity
+#define ODOMETRY_SINGULARITY_TOLERANCE 1e-6 ///< Min singular value of footprint cross-covariance to estimate rotation
+#define TERRAIN_HISTORY_SIZE 32          ///< Number of past touchdown positions used in terrain height estimation
+#define TERRAIN_ESTIMATE_RADIUS 0.15     ///< Horizontal range of touchdown positions used in terrain estimation (m)
+#define FOOTHOLD_OFFSET_COST 0.5         ///< Margin cost per unit distance of a candidate foothold from nominal target
+#define SWING_SPEED_SAMPLES 12           ///< Samples per swing curve at which tip velocity is checked in speed limits
+
+typedef Eigen::Matrix<double, 6, 6> PoseCovariance; ///< Covariance of pose in form [x, y, z, roll, pitch, yaw]
+
 class DebugVisualiser;
-typedef std::map<int, double> LimitMap;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// Object containing parameters which define the timing of the step cycle.
+/// Designation for each walk limit held in a walk limit table.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+enum WalkLimit
+{
+  MAX_LINEAR_SPEED,         ///< The maximum linear speed of the robot body
+  MAX_ANGULAR_SPEED,        ///< The maximum angular speed of the robot body
+  MAX_LINEAR_ACCELERATION,  ///< The maximum linear acceleration of the robot body
+  MAX_ANGULAR_ACCELERATION, ///< The maximum angular acceleration of the robot body
+  WALK_LIMIT_COUNT,         ///< Misc enum defining number of Walk Limits
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Object containing one or more limit values for each of a set of bearing bins at a regular bearing step from 0 to 360
+/// degrees (inclusive). Values are stored contiguously by bearing bin, such that all limits at a bearing are adjacent
+/// in memory and may be interpolated in a single pass without lookup.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <int LimitCount>
+class BearingLimits
+{
+public:
+  typedef Eigen::Array<double, 1, LimitCount> Limits; ///< The limit values at a bearing
+  typedef Eigen::Array<double, Eigen::Dynamic, LimitCount, (LimitCount == 1 ? Eigen::ColMajor : Eigen::RowMajor)> Bins;
+
+  /// Constructor for bearing limits object.
+  /// @param[in] bearing_step The step between bearing bins (deg) - must be a divisor of 360
+  /// @param[in] value The initial value of all limits within each bearing bin
+  BearingLimits(const int& bearing_step = DEFAULT_BEARING_STEP, const double& value = 0.0)
+    : bearing_step_(bearing_step)
+    , bins_(Bins::Constant(360 / bearing_step + 1, LimitCount, value))
+  {
+    ROS_ASSERT(bearing_step > 0 && 360 % bearing_step == 0);
+  };
+
+  /// Accessor for the step between bearing bins.
+  /// @return The step between bearing bins (deg)
+  inline int getBearingStep(void) const { return bearing_step_; };
+
+  /// Accessor for the number of bearing bins (including both 0 and 360 degrees).
+  /// @return The number of bearing bins
+  inline int getBearingCount(void) const { return bins_.rows(); };
+
+  /// Accessor for the bearing associated with a bearing bin.
+  /// @param[in] bearing_index The index of the bearing bin
+  /// @return The bearing of the bin (deg)
+  inline int getBearing(const int& bearing_index) const { return bearing_index * bearing_step_; };
+
+  /// Accessor for a limit value of a bearing bin.
+  /// @param[in] bearing_index The index of the bearing bin
+  /// @param[in] limit_index The index of the limit within the bearing bin
+  /// @return A reference to the limit value
+  inline double& getValue(const int& bearing_index, const int& limit_index = 0)
+  {
+    return bins_(bearing_index, limit_index);
+  };
+
+  /// Accessor for a limit value of a bearing bin.
+  /// @param[in] bearing_index The index of the bearing bin
+  /// @param[in] limit_index The index of the limit within the bearing bin
+  /// @return The limit value
+  inline double getValue(const int& bearing_index, const int& limit_index = 0) const
+  {
+    return bins_(bearing_index, limit_index);
+  };
+
+  /// Accessor for the limit values of all bearing bins.
+  /// @return A pointer to the limit values of all bearing bins
+  inline Bins* getBins(void) { return &bins_; };
+
+  /// Returns all limit values at the input bearing, linearly interpolated between the bounding bearing bins. Limits
+  /// which are unassigned in one bounding bin take the value of the other bounding bin.
+  /// @param[in] bearing The bearing at which to interpolate limits (deg)
+  /// @return The interpolated limit values
+  inline Limits interpolate(const double& bearing) const
+  {
+    // Bins span 0 to 360 inclusive, hence the upper bounding bin never wraps
+    double bearing_position = std::fmod(bearing, 360.0);
+    bearing_position = (bearing_position < 0.0 ? bearing_position + 360.0 : bearing_position) / bearing_step_;
+    int bearing_index = std::min(int(bearing_position), int(bins_.rows()) - 2);
+    double control_input = clamped(bearing_position - bearing_index, 0.0, 1.0);
+    Limits lower_limits = bins_.row(bearing_index);
+    Limits upper_limits = bins_.row(bearing_index + 1);
+    Limits limits = (1.0 - control_input) * lower_limits + control_input * upper_limits;
+    limits = (upper_limits == UNASSIGNED_VALUE).select(lower_limits, limits);
+    return (lower_limits == UNASSIGNED_VALUE).select(upper_limits, limits);
+  };
+
+private:
+  int bearing_step_; ///< The step between bearing bins (deg)
+  Bins bins_;        ///< The limit values of each bearing bin (row)
+};
+
+typedef BearingLimits<1> LimitMap;                  ///< Single limit (e.g. walkspace radius) for each bearing bin
+typedef BearingLimits<WALK_LIMIT_COUNT> LimitTable; ///< All walk limits for each bearing bin
+typedef LimitTable::Limits WalkLimits;              ///< All walk limits at a bearing
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Object containing parameters which define the timing of the step cycle. The step cycle is a continuous phase
+/// oscillator: phase is measured in the base units of the gait parameters (i.e. stance phase + swing phase per cycle)
+/// and is advanced each iteration by a real valued phase delta proportional to the step frequency, so that the step
+/// frequency is independent of the control rate and is not quantised to whole iterations.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 struct StepCycle
 {
-  double frequency_;  ///< The frequency of the step cycle in Hz
-  int period_;        ///< The length of the entire step cycle in iterations
-  int swing_period_;  ///< The length of the swing period of the step cycle in iterations
-  int stance_period_; ///< The length of the stance period of the step cycle in iterations
-  int stance_end_;    ///< The iteration at which the stance period ends
-  int swing_start_;   ///< The iteration at which the swing period starts
-  int swing_end_;     ///< The iteration at which the swing period ends
-  int stance_start_;  ///< The iteration at which the stance period starts
+  double frequency_;     ///< The frequency of the step cycle in Hz
+  double period_;        ///< The length of the entire step cycle in phase units
+  double swing_period_;  ///< The length of the swing period of the step cycle in phase units
+  double stance_period_; ///< The length of the stance period of the step cycle in phase units
+  double stance_end_;    ///< The phase at which the stance period ends
+  double swing_start_;   ///< The phase at which the swing period starts
+  double swing_end_;     ///< The phase at which the swing period ends
+  double stance_start_;  ///< The phase at which the stance period starts
+  double phase_delta_;   ///< The phase advanced each iteration (period * frequency * time delta)
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Object containing the map from tip velocity to joint velocities of a leg at default stance, from which the body
+/// speeds achievable within joint velocity limits are found.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct JointSpeedMap
+{
+  Eigen::Matrix<double, Eigen::Dynamic, 3, 0, MAX_JOINT_COUNT, 3> tip_to_joint_velocity_; ///< Tip to joint velocity map
+  Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> max_joint_speed_;      ///< Max speed of each joint
+  Eigen::Vector3d default_tip_position_; ///< The default tip position of the leg
+  Eigen::Vector3d swing_width_axis_;     ///< The axis along which swing width shifts the swing trajectory of the leg
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -45,6 +173,82 @@ struct ExternalTarget
   bool defined_ = false;   ///< Flag denoting if external target object has been defined
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Object containing the contribution of a leg to the walkspace and the inputs from which it was generated. The
+/// contribution is only regenerated when these inputs change and radii are generated bearing by bearing, such that
+/// regeneration may be spread across multiple iterations.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct LegWalkspace
+{
+  Eigen::Vector3d default_tip_position_;    ///< The default tip position of the leg
+  Eigen::Vector3d adjacent_tip_position_1_; ///< The default tip position of the 1st adjacent leg
+  Eigen::Vector3d adjacent_tip_position_2_; ///< The default tip position of the 2nd adjacent leg
+  Eigen::Vector3d default_shift_;           ///< The shift from identity to default tip position in the body frame
+  bool overlapping_ = false;                ///< Flag denoting if walkspace is allowed to overlap adjacent walkspaces
+  Workplane workplane_;                     ///< The leg workplane at the height of the default tip position
+  LimitMap overlap_;                        ///< The distance to overlap with adjacent leg walkspaces at each bearing
+  LimitMap radius_;                         ///< Radius of leg workplane about default tip position per bearing
+  int bearing_index_ = 0;                   ///< The index of the next bearing at which to generate radius
+
+  /// Returns true if all inputs are equal (within tolerance) to those of another object.
+  /// @param[in] other The object to compare against
+  /// @return Flag denoting if all inputs are equal
+  inline bool hasEqualInputs(const LegWalkspace& other) const
+  {
+    return ((default_tip_position_ - other.default_tip_position_).norm() < WALKSPACE_INPUT_TOLERANCE &&
+            (adjacent_tip_position_1_ - other.adjacent_tip_position_1_).norm() < WALKSPACE_INPUT_TOLERANCE &&
+            (adjacent_tip_position_2_ - other.adjacent_tip_position_2_).norm() < WALKSPACE_INPUT_TOLERANCE &&
+            (default_shift_ - other.default_shift_).norm() < WALKSPACE_INPUT_TOLERANCE &&
+            overlapping_ == other.overlapping_);
+  };
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class estimates a walk plane which best fits a set of tip positions. The normal equations of the least squares
+/// fit are accumulated incrementally as fixed size matrices and solved in closed form, such that estimation requires
+/// no dynamic memory allocation. Tip positions may optionally be re-weighted (Huber) to reject outliers.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class WalkPlaneEstimator
+{
+public:
+  /// Accessor for the number of tip positions added to the estimator.
+  /// @return The number of tip positions added to the estimator
+  inline int getPointCount(void) const { return point_count_; };
+
+  /// Removes all tip positions from the estimator.
+  inline void reset(void)
+  {
+    point_count_ = 0;
+    normal_matrix_ = Eigen::Matrix3d::Zero();
+    normal_vector_ = Eigen::Vector3d::Zero();
+  };
+
+  /// Adds a tip position to the estimator, accumulating its contribution to the normal equations.
+  /// @param[in] point The tip position to add to the estimator
+  void addPoint(const Eigen::Vector3d &point);
+
+  /// Estimates the walk plane which best fits the added tip positions.
+  /// Walk plane vector in form: [a, b, c] where plane equation equals: ax + by + c = z.
+  /// @param[out] walk_plane The estimated walk plane vector
+  /// @param[in] outlier_threshold The residual (m) beyond which tip positions are down-weighted (zero disables)
+  /// @return Flag denoting if the walk plane was able to be estimated
+  bool estimate(Eigen::Vector3d *walk_plane, const double &outlier_threshold = 0.0) const;
+
+private:
+  /// Solves the given normal equations for the walk plane in closed form.
+  /// @param[in] normal_matrix The normal matrix (A^T * W * A) of the least squares fit
+  /// @param[in] normal_vector The normal vector (A^T * W * B) of the least squares fit
+  /// @param[out] walk_plane The solved walk plane vector
+  /// @return Flag denoting if the normal equations were solvable
+  bool solve(const Eigen::Matrix3d &normal_matrix, const Eigen::Vector3d &normal_vector,
+             Eigen::Vector3d *walk_plane) const;
+
+  int point_count_ = 0;                                     ///< The number of tip positions added to the estimator
+  Eigen::Matrix<double, 3, WALK_PLANE_MAX_POINTS> points_;  ///< The tip positions added to the estimator
+  Eigen::Matrix3d normal_matrix_ = Eigen::Matrix3d::Zero(); ///< The accumulated (unweighted) normal matrix
+  Eigen::Vector3d normal_vector_ = Eigen::Vector3d::Zero(); ///< The accumulated (unweighted) normal vector
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles top level management of the walk cycle state machine and calls each leg's LegStepper object to
 /// update tip trajectories. This class also handles generation of default walk stance tip positions, calculation of
@@ -97,7 +301,7 @@ public:
 
   /// Accessor for walkspace.
   /// @return Walkspace
-  inline LimitMap getWalkspace(void) { return walkspace_; };
+  inline LimitMap* getWalkspace(void) { return &walkspace_; };
 
   /// Accessor for walk plane estimate.
   /// @return Walk plane estimate
@@ -111,6 +315,22 @@ public:
   /// @return Ideal odometry pose
   inline Pose getOdometryIdeal(void) { return odometry_ideal_; };
 
+  /// Accessor for estimated odometry pose (of body in world frame) from leg kinematics.
+  /// @return Estimated odometry pose
+  inline Pose getOdometry(void) { return odometry_; };
+
+  /// Accessor for covariance of estimated odometry pose.
+  /// @return Covariance of estimated odometry pose
+  inline PoseCovariance getOdometryCovariance(void) { return odometry_covariance_; };
+
+  /// Accessor for estimated odometry pose delta (of body in previous body frame) over the last iteration.
+  /// @return Estimated odometry pose delta
+  inline Pose getOdometryDelta(void) { return odometry_delta_; };
+
+  /// Accessor for covariance of estimated odometry pose delta over the last iteration.
+  /// @return Covariance of estimated odometry pose delta
+  inline PoseCovariance getOdometryDeltaCovariance(void) { return odometry_delta_covariance_; };
+
   /// Accessor for model current pose.
   /// @return Model current pose
   inline Pose getModelCurrentPose(void) { return model_->getCurrentPose(); };
@@ -119,65 +339,51 @@ public:
   /// @param[in] state The new posing state
   inline void setPoseState(const PosingState &state) { pose_state_ = state; };
 
-  /// Modifier for linear velocity limit map.
-  /// @param[in] limit_map The new linear velocity limit map
-  inline void setLinearSpeedLimitMap(const LimitMap &limit_map) { max_linear_speed_ = limit_map; };
-
-  /// Modifier for angular velocity limit map.
-  /// @param[in] limit_map The new angular velocity limit map
-  inline void setAngularSpeedLimitMap(const LimitMap &limit_map) { max_angular_speed_ = limit_map; };
-
-  /// Modifier for linear acceleration limit map.
-  /// @param[in] limit_map The new linear aceleration limit map
-  inline void setLinearAccelerationLimitMap(const LimitMap &limit_map) { max_linear_acceleration_ = limit_map; };
-
-  /// Modifier for angular acceleration limit map.
-  /// @param[in] limit_map The new angular acceleration limit map
-  inline void setAngularAccelerationLimitMap(const LimitMap &limit_map) { max_angular_acceleration_ = limit_map; };
+  /// Modifier for speed limits. Acceleration limits are left unchanged.
+  /// @param[in] limit_table The limit table from which to set new linear and angular speed limits
+  void setSpeedLimits(const LimitTable &limit_table);
 
   /// Sets flag to regenerate walkspace.
   inline void setRegenerateWalkspace(void) { regenerate_walkspace_ = true; };
 
+  /// Returns true if the walk controller is transitioning between gaits whilst walking.
+  /// @return Flag denoting whether the walk controller is transitioning between gaits
+  inline bool isTransitioningGait(void) { return gait_transition_progress_ >= 0.0; };
+
   /// Initialises walk controller by setting desired default walking stance tip positions from parameters and creating
   /// LegStepper objects for each leg. Also populates workspace map with initial values by finding bisector line between
   /// adjacent leg tip positions.
   void init(void);
 
-  /// Generates a 2D polygon from leg workspace, representing the acceptable space to walk within.
+  /// Generates a 2D polygon from leg workspace, representing the acceptable space to walk within. The walkspace of
+  /// every leg is regenerated within this call (e.g. following generation of leg workspaces).
   /// @todo Remove debugging visualisations
   void generateWalkspace(void);
 
-  /// Generate maximum linear and angular speed/acceleration for each workspace radius in workspace map from a given
+  /// Incrementally regenerates the walkspace. Only the contributions of legs whose inputs (default tip positions and
+  /// body pose) have changed are regenerated, and regeneration is suspended once the time limit is exceeded, resuming
+  /// on the next call. The walkspace and walk limits are updated once all contributions are complete. A suspended
+  /// regeneration may be restarted (to include inputs changed since it began) by clearing the in progress flag, in
+  /// which case only contributions whose inputs have changed again are discarded.
+  /// @param[in] time_limit The (wall) time limit of this call
+  /// @return Flag denoting if regeneration is complete
+  bool updateWalkspace(const double &time_limit = UNASSIGNED_VALUE);
+
+  /// Generate maximum linear and angular speed/acceleration for each walkspace radius in walkspace map from a given
   /// step cycle. These calculated values will accomodate overshoot of tip outside defined workspace whilst body
-  /// accelerates, effectively scaling usable workspace. The calculated values are either set as walk controller limits
-  /// OR output to given pointer arguments.
+  /// accelerates, effectively scaling usable workspace. Speeds are further limited such that the resulting tip
+  /// velocities (in stance and swing) are achievable within joint velocity limits. The calculated values are either
+  /// set as walk controller limits OR output to given pointer argument.
   /// @param[in] step Step cycle timing object
-  /// @param[out] max_linear_speed_ptr Pointer to output object to store new maximum linear speed values
-  /// @param[out] max_angular_speed_ptr Pointer to output object to store new maximum angular speed values
-  /// @param[out] max_linear_acceleration_ptr Pointer to output object to store new maximum linear acceleration values
-  /// @param[out] max_angular_acceleration_ptr Pointer to output object to store new maximum angular acceleration values
-  void generateLimits(StepCycle step,
-                      LimitMap *max_linear_speed_ptr = NULL,
-                      LimitMap *max_angular_speed_ptr = NULL,
-                      LimitMap *max_linear_acceleration_ptr = NULL,
-                      LimitMap *max_angular_acceleration_ptr = NULL);
-
-  /// Generate maximum linear and angular speed/acceleration for each workspace radius in workspace map from pre-set
+  /// @param[out] limit_table_ptr Pointer to output object to store new maximum speed and acceleration values
+  void generateLimits(StepCycle step, LimitTable *limit_table_ptr = NULL);
+
+  /// Generate maximum linear and angular speed/acceleration for each walkspace radius in walkspace map from pre-set
   /// step cycle. These calculated values will accomodate overshoot of tip outside defined workspace whilst body
   /// accelerates, effectively scaling usable workspace. The calculated values are either set as walk controller limits
-  /// OR output to given pointer arguments.
-  /// @param[out] max_linear_speed_ptr Pointer to output object to store new maximum linear speed values
-  /// @param[out] max_angular_speed_ptr Pointer to output object to store new maximum angular speed values
-  /// @param[out] max_linear_acceleration_ptr Pointer to output object to store new maximum linear acceleration values
-  /// @param[out] max_angular_acceleration_ptr Pointer to output object to store new maximum angular acceleration values
-  void inline generateLimits(LimitMap *max_linear_speed_ptr = NULL,
-                             LimitMap *max_angular_speed_ptr = NULL,
-                             LimitMap *max_linear_acceleration_ptr = NULL,
-                             LimitMap *max_angular_acceleration_ptr = NULL)
-  {
-    generateLimits(step_, max_linear_speed_ptr, max_angular_speed_ptr,
-                   max_linear_acceleration_ptr, max_angular_acceleration_ptr);
-  };
+  /// OR output to given pointer argument.
+  /// @param[out] limit_table_ptr Pointer to output object to store new maximum speed and acceleration values
+  void inline generateLimits(LimitTable *limit_table_ptr = NULL) { generateLimits(step_, limit_table_ptr); };
 
   /// Generates step timing object from walk cycle parameters, normalising base parameters according to step frequency.
   /// Returns step timing object and optionally sets step timing in Walk Controller.
@@ -185,15 +391,61 @@ public:
   /// @return Generated step cycle object
   StepCycle generateStepCycle(const bool set_step_cycle = true);
 
-  /// Given an input linear velocity vector and angular velocity, this function calculates a stride bearing then
-  /// an interpolation of the two limits at the bearings (defined by the input limit map) bounding the stride bearing.
-  /// This is calculated for each leg and the minimum value returned.
+  /// Begins a transition whilst walking from the current step cycle to that defined by the current gait parameters.
+  /// Over the transition the swing ratio of the step cycle is blended from the original to the new gait and the phase
+  /// of each leg is shifted towards the new phase offsets. Phase shifts are only applied to legs in stance and legs
+  /// are held in stance whilst starting a swing would violate support constraints. Speed limits are reduced to those
+  /// allowable by both gaits until the transition is complete.
+  /// @return Flag denoting if the transition was started (only possible whilst walk state is MOVING)
+  bool startGaitTransition(void);
+
+  /// Ends any gait transition in progress, setting the step cycle and limits of the gait defined by the current gait
+  /// parameters.
+  void endGaitTransition(void);
+
+  /// Returns true if legs decide independently when to lift off (free gait), i.e. free gait is enabled and the walker
+  /// is moving and not transitioning between gaits.
+  /// @return Flag denoting if legs decide independently when to lift off
+  inline bool isFreeGait(void)
+  {
+    return params_.free_gait.data && walk_state_ == MOVING && !isTransitioningGait();
+  };
+
+  /// Returns true if the input leg may start a swing period without violating support constraints, i.e. no adjacent
+  /// leg is in swing and fewer than half of all legs are in swing. In free gait the support polygon of the remaining
+  /// legs in stance must also retain the free gait stability margin, or if the walkspace of the leg is exhausted, at
+  /// least contain the body origin. Always true unless transitioning between gaits or in free gait.
+  /// @param[in] leg A pointer to the leg object about to start a swing period
+  /// @return Flag denoting if the leg may start a swing period
+  bool isSwingPermitted(std::shared_ptr<Leg> leg);
+
+  /// Calculates the stability margin of the support polygon formed by the tips of legs in stance, excluding the input
+  /// leg, as the min distance of the body origin inside any edge of the polygon (negative if outside). Vertices are
+  /// ordered by leg id number, i.e. clockwise about the body.
+  /// @param[in] swing_leg A pointer to the leg object excluded from the support polygon
+  /// @return The stability margin of the support polygon (negative if unstable)
+  double calculateStabilityMargin(std::shared_ptr<Leg> swing_leg);
+
+  /// Given an input linear velocity vector and angular velocity, this function calculates a stride bearing for each leg
+  /// then an interpolation of all limits at the bearing bins (defined by the input limit table) bounding the stride
+  /// bearing, such that unassigned limits (e.g. accelerations at bearings of zero walkspace) are not interpolated
+  /// toward. The minimum of each limit across all legs is returned, such that every limit is found in a single pass.
+  /// @param[in] linear_velocity_input The velocity input given to the Syropod defining desired linear body motion
+  /// @param[in] angular_velocity_input The velocity input given to the Syropod defining desired angular body motion
+  /// @param[in] limit_table The LimitTable object which contains limit data for a range of bearings from 0-360 degrees
+  /// @return The smallest interpolated value of each limit for the stride bearings of each of the Syropod legs
+  WalkLimits getLimits(const Eigen::Vector2d &linear_velocity_input, const double &angular_velocity_input,
+                       const LimitTable &limit_table);
+
+  /// Given an input linear velocity vector and angular velocity, this function calculates all walk limits from the
+  /// current limit table of the walk controller.
   /// @param[in] linear_velocity_input The velocity input given to the Syropod defining desired linear body motion
   /// @param[in] angular_velocity_input The velocity input given to the Syropod defining desired angular body motion
-  /// @param[in] limit The LimitMap object which contains limit data for a range of bearings from 0-360 degrees
-  /// @return The smallest interpolated limit for a given bearing from each of the Syropod legs
-  double getLimit(const Eigen::Vector2d &linear_velocity_input, const double &angular_velocity_input,
-                  const LimitMap &limit);
+  /// @return The smallest interpolated value of each limit for the stride bearings of each of the Syropod legs
+  inline WalkLimits getLimits(const Eigen::Vector2d &linear_velocity_input, const double &angular_velocity_input)
+  {
+    return getLimits(linear_velocity_input, angular_velocity_input, limit_table_);
+  };
 
   /// Updates all legs in the walk cycle. Calculates stride vectors for all legs from robot body velocity inputs and
   /// calls trajectory update functions for each leg to update individual tip positions. Also manages the overall walk
@@ -223,11 +475,28 @@ public:
   void updateManual(const int &primary_leg_selection_ID, const Pose &primary_tip_pose_input,
                     const int &secondary_leg_selection_ID, const Pose &secondary_tip_pose_input);
 
-  /// Calculates a estimated walk plane which best fits the default tip positions of legs in model.
+  /// Calculates a estimated walk plane which best fits the default tip positions of legs in stance. If the walk plane
+  /// is unable to be estimated (e.g. less than 3 legs in stance) the previous estimate is retained.
   /// Walk plane vector in form: [a, b, c] where plane equation equals: ax + by + c = z.
   /// Ref: https://math.stackexchange.com/questions/99299/best-fitting-plane-given-a-set-of-points
   void updateWalkPlane(void);
 
+  /// Estimates odometry from the actual tip positions of legs in stance. The footprint of legs in stance during both
+  /// this and the previous iteration is aligned (Procrustes/Kabsch) to find the body pose delta which best keeps
+  /// stance tips stationary. If IMU data is available, the rotation delta is taken from the change in IMU orientation
+  /// and only translation is estimated from the footprint. If less than 3 (non-collinear) legs remain in stance, the
+  /// pose delta is taken from commanded body velocity with inflated covariance.
+  /// Ref: https://en.wikipedia.org/wiki/Kabsch_algorithm
+  /// @param[in] actual_tip_poses Tip poses of all legs (by id number) generated from actual joint positions
+  void updateOdometry(const PoseArray &actual_tip_poses);
+
+  /// Discards the previous stance footprint such that odometry estimation restarts from the next iteration.
+  inline void resetOdometryFootprint(void)
+  {
+    std::fill(stance_footprint_valid_, stance_footprint_valid_ + MAX_LEG_COUNT, false);
+    previous_imu_orientation_ = UNDEFINED_ROTATION;
+  };
+
   /// Estimates the acceleration vector due to gravity.
   /// @return The estimated acceleration vector due to gravity
   inline Eigen::Vector3d estimateGravity(void) { return model_->estimateGravity(); };
@@ -237,7 +506,52 @@ public:
   /// @return The estimated odometry pose change over the desired time period
   Pose calculateOdometry(const double &time_period);
 
+  /// Records the tip position of a leg at touchdown, transformed into the world frame via estimated odometry (such that
+  /// positions remain consistent despite slip), in a fixed size history of touchdown positions from which local
+  /// terrain height is estimated. The oldest position is overwritten.
+  /// @param[in] tip_position The tip position at touchdown
+  void addTouchdownPosition(const Eigen::Vector3d &tip_position);
+
+  /// Estimates the terrain height at the input tip position as the average height of past touchdown positions within
+  /// horizontal range, weighted by decreasing linearly with horizontal distance.
+  /// @param[in] tip_position The tip position at which to estimate terrain height
+  /// @param[out] height The estimated terrain height
+  /// @return Flag denoting if any past touchdown positions were within range to estimate terrain height
+  bool estimateTerrainHeight(const Eigen::Vector3d &tip_position, double *height);
+
 private:
+  /// Iterates the gait transition, blending the swing ratio of the step cycle and shifting the phase of each leg in
+  /// stance towards the blended phase offset. The transition ends once complete and all legs are at the new offsets.
+  void updateGaitTransition(void);
+
+  /// Generates the map from tip velocity to joint velocities of every walking leg in its current configuration,
+  /// through the position DLS pseudo-inverse of each leg jacobian. Legs without a valid kinematic state are omitted.
+  void generateJointSpeedMaps(void);
+
+  /// Generates the max body speed along each walkspace bearing, and max body angular speed, for which tip velocities of
+  /// every leg throughout the nominal stance and swing trajectories of a step cycle are achievable within joint
+  /// velocity limits. Swing trajectories are sampled from control nodes generated as per the leg stepper whilst walking
+  /// at constant speed, such that the peak (including vertical and lateral) swing velocities are accounted for.
+  /// @param[in] step Step cycle timing object
+  void generateJointSpeedLimits(const StepCycle &step);
+
+  /// Generates the inputs from which the contribution of a leg to the walkspace is generated.
+  /// @param[in] leg A pointer to the leg object
+  /// @return The leg walkspace object containing generated inputs
+  LegWalkspace generateLegWalkspaceInputs(std::shared_ptr<Leg> leg);
+
+  /// Generates the distance to overlap with adjacent leg walkspaces at each bearing of a leg walkspace.
+  /// @param[in,out] leg_walkspace A pointer to the leg walkspace object
+  void generateWalkspaceOverlap(LegWalkspace *leg_walkspace);
+
+  /// Generates the radius of a leg walkspace at a bearing from the leg workplane, shifted to the default tip position.
+  /// @param[in] leg A pointer to the leg object
+  /// @param[in] leg_walkspace The leg walkspace object
+  /// @param[in] bearing_index The index of the bearing at which to generate radius
+  /// @return The radius of the leg walkspace at the bearing
+  double generateWalkspaceRadius(std::shared_ptr<Leg> leg, const LegWalkspace &leg_walkspace,
+                                 const int &bearing_index);
+
   std::shared_ptr<Model> model_; ///< Pointer to robot model object
   const Parameters &params_;     ///< Pointer to parameter data structure for storing parameter variables
   double time_delta_;            ///< The time period of the ros cycle
@@ -247,20 +561,44 @@ private:
 
   StepCycle step_; ///< Step cycle timing object
 
+  // Gait transition variables
+  double gait_transition_progress_ = -1.0;      ///< The progress of the gait transition (0.0->1.0 || -1.0)
+  double origin_swing_ratio_ = 0.0;             ///< The swing ratio of the step cycle prior to gait transition
+  double master_phase_ = 0.0;                   ///< The phase of a zero offset leg (ratio of step cycle)
+  std::map<int, double> origin_phase_offsets_;  ///< Phase offset (ratio of step cycle) of each leg prior to transition
+  std::map<int, double> phase_offset_changes_;  ///< Change in phase offset (ratio of step cycle) of each leg
+
   // Workspace generation variables
-  LimitMap walkspace_;                ///< A map of interpolated radii for given bearings in degrees at default stance
-  Eigen::Vector3d walk_plane_;        ///< The co-efficients of an estimated planar walk surface
-  Eigen::Vector3d walk_plane_normal_; ///< The normal of the estimated planar walk surface
-  bool regenerate_walkspace_ = false; ///< Flag denoting whether walkspace needs to be regenerated
+  LimitMap walkspace_;                         ///< A map of interpolated radii for given bearings at default stance
+  Eigen::Vector3d walk_plane_;                 ///< The co-efficients of an estimated planar walk surface
+  Eigen::Vector3d walk_plane_normal_;          ///< The normal of the estimated planar walk surface
+  WalkPlaneEstimator walk_plane_estimator_;    ///< The estimator of the planar walk surface
+  bool regenerate_walkspace_ = false;          ///< Flag denoting if regeneration was requested since it last began
+  bool walkspace_update_in_progress_ = false;  ///< Flag denoting if incremental walkspace regeneration is in progress
+  std::map<int, LegWalkspace> leg_walkspaces_; ///< The contribution of each leg (by id number) to the walkspace
 
   // Velocity/acceleration variables
   Eigen::Vector2d desired_linear_velocity_; ///< The desired linear velocity of the robot body
   double desired_angular_velocity_;         ///< The desired angular velocity of the robot body
   Pose odometry_ideal_;                     ///< The ideal odometry from the world frame
-  LimitMap max_linear_speed_;               ///< A map of max allowable linear body speeds for potential bearings
-  LimitMap max_angular_speed_;              ///< A map of max allowable angular speeds for potential bearings
-  LimitMap max_linear_acceleration_;        ///< A map of max allowable linear accelerations for potential bearings
-  LimitMap max_angular_acceleration_;       ///< A map of max allowable angular accelerations for potential bearings
+
+  // Odometry estimation variables
+  Pose odometry_;                                            ///< The estimated odometry from the world frame
+  Pose odometry_delta_;                                      ///< The estimated odometry pose delta over last iteration
+  PoseCovariance odometry_covariance_;                       ///< The covariance of the estimated odometry
+  PoseCovariance odometry_delta_covariance_;                 ///< The covariance of the estimated odometry pose delta
+  Eigen::Matrix<double, 3, MAX_LEG_COUNT> stance_footprint_; ///< Tip position of each leg (by id) at last iteration
+  bool stance_footprint_valid_[MAX_LEG_COUNT];               ///< If each leg (by id) was in stance at last iteration
+  Eigen::Quaterniond previous_imu_orientation_;              ///< The IMU orientation at last iteration
+  LimitTable limit_table_;                  ///< A table of max allowable speeds/accelerations for potential bearings
+  LimitMap joint_linear_speed_limits_;      ///< Max body speed along each bearing within joint velocity limits
+  double joint_angular_speed_limit_;        ///< Max body angular speed within joint velocity limits
+  std::map<int, JointSpeedMap> joint_speed_maps_; ///< Tip to joint velocity map of each walking leg (by id number)
+
+  // Terrain estimation variables
+  Eigen::Matrix<double, 3, TERRAIN_HISTORY_SIZE> touchdown_history_; ///< Past touchdown positions in world frame
+  int touchdown_history_count_ = 0; ///< The number of valid touchdown positions held in the touchdown history
+  int touchdown_history_index_ = 0; ///< The index in the touchdown history at which to record the next position
 
   // Leg coordination variables
   int legs_at_correct_phase_ = 0;            ///< A count of legs currently at the correct phase per walk cycle state
@@ -276,6 +614,82 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class contains a table of the weight of each control node in the derivative of a quartic bezier curve for each
+/// iteration of a trajectory along the curve with a fixed time input delta. Since the time input delta is fixed for a
+/// given step cycle, the table is generated once per step cycle and evaluating the derivative at each iteration
+/// reduces to a weighted sum of control nodes. Time inputs which do not fall on an iteration of the table (e.g. when
+/// the time input delta does not evenly divide the curve) are evaluated directly.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class BezierWeightTable
+{
+public:
+  /// Accessor for the number of iterations of the trajectory.
+  /// @return The number of iterations of the trajectory
+  inline int getIterations(void) const { return iterations_; };
+
+  /// Accessor for the time input delta between iterations of the trajectory.
+  /// @return The time input delta between iterations
+  inline double getDeltaT(void) const { return delta_t_; };
+
+  /// Generates the weight table for a trajectory with the given time input delta, where the time input at each
+  /// iteration is iteration * delta_t. The table is only regenerated if the time input delta has changed.
+  /// @param[in] delta_t The time input delta between iterations of the trajectory
+  void generate(const double& delta_t);
+
+  /// Evaluates the derivative of the quartic bezier curve defined by the input control nodes at a time input, using
+  /// the tabulated weights if the time input falls on an iteration of the table.
+  /// @param[in] nodes An array of 5 control node vectors
+  /// @param[in] time_input The time input of the bezier curve (0.0 -> 1.0)
+  /// @return The derivative of the bezier curve at the time input
+  inline Eigen::Vector3d evaluate(const Eigen::Vector3d* nodes, const double& time_input) const
+  {
+    Eigen::Matrix<double, 5, 1> w;
+    double index = (delta_t_ > 0.0 ? time_input / delta_t_ : 0.0);
+    int iteration = roundToInt(index);
+    if (iteration >= 1 && iteration <= iterations_ && std::abs(index - iteration) < PHASE_TOLERANCE)
+    {
+      w = weights_.col(iteration - 1);
+    }
+    else
+    {
+      w = quarticBezierDotWeights(time_input);
+    }
+    return w[0] * nodes[0] + w[1] * nodes[1] + w[2] * nodes[2] + w[3] * nodes[3] + w[4] * nodes[4];
+  };
+
+private:
+  int iterations_ = 0;                               ///< The number of iterations of the trajectory
+  double delta_t_ = 0.0;                             ///< The time input delta between iterations of the trajectory
+  Eigen::Matrix<double, 5, Eigen::Dynamic> weights_; ///< The weight of each control node (row) for each iteration
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Object containing the inputs from which the swing control nodes are generated, used to regenerate control nodes
+/// only when these inputs change.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct SwingNodeInputs
+{
+  Eigen::Vector3d target_tip_position_; ///< The target tip position at the end of the swing period
+  Eigen::Vector3d stride_vector_;       ///< The stride vector defining tip velocity at the end of the swing period
+  Eigen::Vector3d swing_clearance_;     ///< The clearance of the swing trajectory
+  double swing_width_ = 0.0;            ///< The lateral shift of the swing trajectory
+  double swing_delta_t_ = 0.0;          ///< The time input delta of each swing bezier curve
+  double stance_delta_t_ = 0.0;         ///< The time input delta of the stance bezier curve
+  bool ground_contact_ = false;         ///< Flag denoting if the leg has made ground contact during swing
+
+  /// Returns true if all inputs are equal to those of another object.
+  /// @param[in] other The object to compare against
+  /// @return Flag denoting if all inputs are equal
+  inline bool operator==(const SwingNodeInputs& other) const
+  {
+    return (target_tip_position_ == other.target_tip_position_ && stride_vector_ == other.stride_vector_ &&
+            swing_clearance_ == other.swing_clearance_ && swing_width_ == other.swing_width_ &&
+            swing_delta_t_ == other.swing_delta_t_ && stance_delta_t_ == other.stance_delta_t_ &&
+            ground_contact_ == other.ground_contact_);
+  };
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class handles the generation of leg tip trajectory generation and updating the desired tip position along this
 /// trajectory during iteration of the step cycle. Trajectories are generated using 3 bezier curves: a primary and
@@ -334,11 +748,21 @@ public:
 
   /// Accessor for the current phase of the step cycle.
   /// @return Current phase of the step cycle
-  inline int getPhase(void) { return phase_; };
+  inline double getPhase(void) { return phase_; };
 
   /// Accessor for the current phase offset of the step cycle.
   /// @return Current phase offset of the step cycle
-  inline int getPhaseOffset(void) { return phase_offset_; };
+  inline double getPhaseOffset(void) { return phase_offset_; };
+
+  /// Accessor for the phase advanced by the step cycle each iteration.
+  /// @return The phase advanced by the step cycle each iteration
+  inline double getPhaseDelta(void) { return walker_->getStepCycle().phase_delta_; };
+
+  /// Accessor for the step cycle timing object used by this leg stepper. This is the step cycle of the walk controller
+  /// except during swing, when the bounds of the swing period are held fixed from the start of the swing period such
+  /// that changes to the step cycle (e.g. during gait transitions) do not alter a swing trajectory in progress.
+  /// @return Step cycle timing object used by this leg stepper
+  StepCycle getStepCycle(void);
 
   /// Accessor for the current stride vector used in the step cycle.
   /// @return Current stride vector used in the step cycle
@@ -365,6 +789,12 @@ public:
   /// @return Flag denoting whether the leg is in the correct step cycle phase per the walk controller state
   inline bool isAtCorrectPhase(void) { return at_correct_phase_; };
 
+  /// Returns true if the step cycle phase reached the input phase on the latest iteration of the phase, i.e. if the
+  /// input phase lies after the phase prior to the iteration and at or before the current phase.
+  /// @param[in] phase The phase to check
+  /// @return Flag denoting whether the step cycle phase reached the input phase on the latest iteration
+  bool hasReachedPhase(const double &phase);
+
   /// Accessor for control nodes in the primary swing bezier curve.
   /// @param[in] i Index of the control node
   /// @return Control node in the primary swing bezier curve of the given index
@@ -406,7 +836,18 @@ public:
 
   /// Modifier for the phase of the step cycle.
   /// @param[in] phase The new phase
-  inline void setPhase(const int &phase) { phase_ = phase; };
+  inline void setPhase(const double &phase) { phase_ = previous_phase_ = phase; };
+
+  /// Shifts the phase of the step cycle without iteration, such that phases passed by the shift are not reached.
+  /// @param[in] phase_shift The phase by which to shift the step cycle
+  inline void shiftPhase(const double &phase_shift)
+  {
+    phase_ = mod(phase_ + phase_shift, walker_->getStepCycle().period_);
+  };
+
+  /// Scales all phase variables of the leg stepper, used to convert phase between units of different step cycles.
+  /// @param[in] scaler The ratio between new and original phase units
+  void scalePhase(const double &scaler);
 
   /// Modifier for the progress of the swing period.
   /// @param[in] progress The new swing progress
@@ -418,7 +859,7 @@ public:
 
   /// Modifier for the phase offset of the step cycle.
   /// @param[in] phase_offset The new phase offset
-  inline void setPhaseOffset(const int &phase_offset) { phase_offset_ = phase_offset; };
+  inline void setPhaseOffset(const double &phase_offset) { phase_offset_ = phase_offset; };
 
   /// Modifier for the flag denoting if the leg has completed its first step.
   /// @param[in] completed_first_step The new value for the flag
@@ -440,12 +881,28 @@ public:
   /// @param[in] external_default The new externally set default tip pose object
   inline void setExternalDefault(const ExternalTarget &external_default) { external_default_ = external_default; };
 
-  /// Updates phase for new step cycle parameters.
-  void updatePhase(void);
-
-  /// Iterates the step phase and updates the progress variables.
+  /// Iterates the step phase by the phase delta of the step cycle and updates the progress variables. In free gait, a
+  /// leg in stance lifts off early (skipping to the start of the swing period) if its tip would otherwise leave its
+  /// walkspace on the next iteration.
   void iteratePhase(void);
 
+  /// Calculates the remaining distance the tip may travel in stance (opposite to stride vector) before leaving the
+  /// walkspace about the default tip position.
+  /// @return The remaining distance within the walkspace along the stride
+  double calculateWalkspaceMargin(void);
+
+  /// Returns true if the tip would leave the walkspace (along the stride) on the next iteration of stance.
+  /// @return Flag denoting if the walkspace margin of the leg is exhausted
+  bool isWalkspaceExhausted(void);
+
+  /// Plans the swing target before lift off by evaluating, in a single batch, a set of candidate footholds about the
+  /// nominal swing target. Each candidate is projected onto the local terrain height estimate and scored by its min
+  /// margin from the leg workspace limit (at touchdown) and walkspace limit (at the end of the following stance), less
+  /// a cost on distance from the nominal target. The candidate with the greatest score is returned.
+  /// @param[in] nominal_tip_position The nominal swing target tip position
+  /// @return The planned swing target tip position
+  Eigen::Vector3d planFoothold(const Eigen::Vector3d &nominal_tip_position);
+
   /// Updates the Step state of this LegStepper according to the phase.
   void updateStepState(void);
 
@@ -493,15 +950,19 @@ private:
   bool at_correct_phase_ = false;     ///< Flag denoting if the leg is at the correct phase per the walk state
   bool completed_first_step_ = false; ///< Flag denoting if the leg has completed its first step
   bool touchdown_detection_ = false;  ///< Flag denoting whether touchdown detection is enabled
+  bool swing_first_half_ = false;     ///< Flag denoting if the last swing iteration was in the first half of swing
 
-  int phase_ = 0;    ///< Step cycle phase
-  int phase_offset_; ///< Step cycle phase offset
+  double phase_ = 0.0;          ///< Step cycle phase
+  double previous_phase_ = 0.0; ///< Step cycle phase prior to the latest iteration
+  double phase_offset_ = 0.0;   ///< Step cycle phase offset
 
   double step_progress_ = 0.0;    ///< The progress of the entire step cycle (0.0->1.0 || -1.0)
   double swing_progress_ = -1.0;  ///< The progress of the swing period in the step cycle. (0.0->1.0 || -1.0)
   double stance_progress_ = -1.0; ///< The progress of the stance period in the step cycle. (0.0->1.0 || -1.0)
 
-  StepState step_state_ = STANCE; ///< The state of the step cycle
+  StepState step_state_ = STANCE;               ///< The state of the step cycle
+  StepState trajectory_step_state_ = FORCE_STOP; ///< The state of the step cycle at the last tip position update
+  StepCycle swing_step_;                         ///< The step cycle at the start of the current swing period
 
   Eigen::Vector3d swing_1_nodes_[5]; ///< An array of 3d control nodes defining the primary swing bezier curve
   Eigen::Vector3d swing_2_nodes_[5]; ///< An array of 3d control nodes defining the secondary swing bezier curve
@@ -512,8 +973,13 @@ private:
   Eigen::Vector3d stride_vector_;     ///< The desired stride vector
   Eigen::Vector3d swing_clearance_;   ///< Position relative to the default tip position to achieve during swing period
 
-  double swing_delta_t_ = 0.0;
-  double stance_delta_t_ = 0.0;
+  double swing_delta_t_ = 0.0;  ///< The time input delta of each swing bezier curve
+  double stance_delta_t_ = 0.0; ///< The time input delta of the stance bezier curve
+
+  BezierWeightTable swing_weights_;  ///< Control node weights of each swing bezier curve for the current step cycle
+  BezierWeightTable stance_weights_; ///< Control node weights of the stance bezier curve for the current step cycle
+  SwingNodeInputs swing_node_inputs_;          ///< Inputs from which current swing control nodes were generated
+  Eigen::Vector3d stance_node_stride_vector_;  ///< Scaled stride vector from which stance control nodes were generated
 
   Pose identity_tip_pose_; ///< The user defined tip pose assuming a identity walk plane
   Pose default_tip_pose_;  ///< The default tip pose per the walk controller, updated with walk plane
@@ -529,6 +995,7 @@ private:
   Eigen::Vector3d swing_origin_tip_position_;  ///< Tip position used as the origin for the bezier curve during swing
   Eigen::Vector3d swing_origin_tip_velocity_;  ///< Tip velocity used in the generation of bezier curve during swing
   Eigen::Vector3d stance_origin_tip_position_; ///< Tip position used as the origin for the bezier curve during stance
+  Eigen::Vector3d foothold_offset_;            ///< Offset of planned foothold from nominal swing target
 
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
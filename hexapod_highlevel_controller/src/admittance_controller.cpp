@@ -11,6 +11,66 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void AdmittanceLaneArrays::generate(const double& mass, const AdmittanceLanes& stiffness,
+                                    const double& damping_ratio, const double& step_time)
+{
+  // Continuous system: x = [position, velocity], dx/dt = A * x + B * force, A = [0, 1; -w^2, -2 * z * w], B = [0; -1/m]
+  // exp(A * T) = e^(-z * w * T) * (C * I + S * (A + z * w * I)) where C and S depend on the damping regime
+  AdmittanceLanes natural_frequency = (stiffness / mass).sqrt();
+  AdmittanceLanes decay_rate = damping_ratio * natural_frequency;
+  AdmittanceLanes cosine_term;
+  AdmittanceLanes sine_term;
+  if (damping_ratio < 1.0)
+  {
+    AdmittanceLanes damped_frequency = natural_frequency * sqrt(1.0 - damping_ratio * damping_ratio);
+    cosine_term = (damped_frequency * step_time).cos();
+    sine_term = (damped_frequency * step_time).sin() / damped_frequency;
+  }
+  else if (damping_ratio > 1.0)
+  {
+    AdmittanceLanes damped_frequency = natural_frequency * sqrt(damping_ratio * damping_ratio - 1.0);
+    cosine_term = (damped_frequency * step_time).cosh();
+    sine_term = (damped_frequency * step_time).sinh() / damped_frequency;
+  }
+  else
+  {
+    cosine_term.setOnes();
+    sine_term.setConstant(step_time);
+  }
+
+  AdmittanceLanes decay = (-decay_rate * step_time).exp();
+  state_matrix_00_ = decay * (cosine_term + decay_rate * sine_term);
+  state_matrix_01_ = decay * sine_term;
+  state_matrix_10_ = -natural_frequency.square() * state_matrix_01_;
+  state_matrix_11_ = decay * (cosine_term - decay_rate * sine_term);
+
+  // Bd = A^-1 * (Ad - I) * B
+  input_matrix_0_ = (state_matrix_00_ - 1.0) / stiffness;
+  input_matrix_1_ = -state_matrix_01_ / mass;
+  mass_ = mass;
+  stiffness_ = stiffness;
+  damping_ratio_ = damping_ratio;
+  step_time_ = step_time;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+AdmittanceLanes AdmittanceLaneArrays::advance(const AdmittanceLanes& force_input)
+{
+  // x[k+1] = Ad * x[k] + Bd * u[k] for all lanes (force input limited to positive values as per ODE solver)
+  AdmittanceLanes positive_force_input = force_input.max(0.0);
+  AdmittanceLanes position = state_matrix_00_ * position_ + state_matrix_01_ * velocity_ +
+                             input_matrix_0_ * positive_force_input;
+  velocity_ = state_matrix_10_ * position_ + state_matrix_11_ * velocity_ + input_matrix_1_ * positive_force_input;
+  position_ = position;
+
+  // Clamping and deadbanding of all lanes
+  AdmittanceLanes delta = (-position_).min(MAX_ADMITTANCE_DELTA).max(-MAX_ADMITTANCE_DELTA);
+  return delta.sign() * (delta.abs() - ADMITTANCE_DEADBAND).max(0.0) / (1 - ADMITTANCE_DEADBAND);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 AdmittanceController::AdmittanceController(std::shared_ptr<Model> model, const Parameters& params)
   : model_(model)
   , params_(params)
@@ -21,6 +81,12 @@ AdmittanceController::AdmittanceController(std::shared_ptr<Model> model, const P
 
 void AdmittanceController::updateAdmittance(void)
 {
+  if (params_.exact_admittance_integrator.data)
+  {
+    updateDiscreteAdmittance();
+    return;
+  }
+
   // Get current force value on leg and run admittance calculations to get a vertical tip offset (deltaZ)
   LegContainer::iterator leg_it;
   for (leg_it = model_->getLegContainer()->begin(); leg_it != model_->getLegContainer()->end(); ++leg_it)
@@ -52,12 +118,8 @@ void AdmittanceController::updateAdmittance(void)
                       step_time / 30);
       
       // Deadbanding
-      double delta = clamped(-(*admittance_state)[0], -0.2, 0.2);
-      double delta_direction = delta / abs(delta);
-      if (abs(delta) > ADMITTANCE_DEADBAND)
-      {
-        admittance_delta[i] = delta_direction * (abs(delta) - ADMITTANCE_DEADBAND) / (1 - ADMITTANCE_DEADBAND);
-      }
+      double delta = clamped(-(*admittance_state)[0], -MAX_ADMITTANCE_DELTA, MAX_ADMITTANCE_DELTA);
+      admittance_delta[i] = applyDeadband(delta);
     }
     leg->setAdmittanceDelta(admittance_delta);
   }
@@ -65,6 +127,59 @@ void AdmittanceController::updateAdmittance(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void AdmittanceController::updateDiscreteAdmittance(void)
+{
+  double mass = params_.virtual_mass.current_value;
+  double damping_ratio = params_.virtual_damping_ratio.current_value;
+  double step_time = params_.integrator_step_time.data;
+  bool dynamic_stiffness = params_.dynamic_stiffness.data;
+  bool use_calculated_tip_force = params_.use_joint_effort.data;
+
+  // Gather force input and stiffness of each lane
+  AdmittanceLanes stiffness = lanes_.stiffness_;
+  LegContainer::iterator leg_it;
+  for (leg_it = model_->getLegContainer()->begin(); leg_it != model_->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    int id_number = leg->getIDNumber();
+    Eigen::Vector3d tip_force = use_calculated_tip_force ? leg->getTipForceCalculated() : leg->getTipForceMeasured();
+    lanes_.force_.segment<3>(id_number * 3) = tip_force;
+
+    // Stiffness of each leg is only scaled from the parameterised value by dynamic stiffness (i.e. updateStiffness)
+    double leg_stiffness = dynamic_stiffness ? leg->getVirtualStiffness() : params_.virtual_stiffness.current_value;
+    stiffness.segment<3>(id_number * 3).setConstant(leg_stiffness);
+  }
+
+  // Regenerate discrete system coefficients of all lanes if the model of any leg has changed
+  if (!lanes_.isValid(mass, stiffness, damping_ratio, step_time))
+  {
+    lanes_.generate(mass, stiffness, damping_ratio, step_time);
+  }
+
+  // Advance all lanes together
+  AdmittanceLanes delta = lanes_.advance(lanes_.force_ * params_.force_gain.current_value);
+
+  for (leg_it = model_->getLegContainer()->begin(); leg_it != model_->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    leg->setAdmittanceDelta(delta.segment<3>(leg->getIDNumber() * 3).matrix());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+double AdmittanceController::applyDeadband(const double& delta)
+{
+  if (abs(delta) > ADMITTANCE_DEADBAND)
+  {
+    double delta_direction = delta / abs(delta);
+    return delta_direction * (abs(delta) - ADMITTANCE_DEADBAND) / (1 - ADMITTANCE_DEADBAND);
+  }
+  return 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void AdmittanceController::updateStiffness(std::shared_ptr<Leg> leg, const double& scale_reference)
 {
   int leg_id = leg->getIDNumber();
@@ -134,3 +249,197 @@ void AdmittanceController::updateStiffness(std::shared_ptr<WalkController> walke
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ComplianceLoop::ComplianceLoop(std::shared_ptr<Model> model, const Parameters& params,
+                               const ros::Publisher& desired_joint_state_publisher)
+  : params_(params)
+  , rate_(params.compliance_loop_rate.data)
+  , desired_joint_state_publisher_(desired_joint_state_publisher)
+  , joint_efforts_(Eigen::Array<double, MAX_LEG_COUNT, MAX_JOINT_COUNT>::Zero())
+  , running_(true)
+{
+  // Generate joint lookup data and copy publishers (publishing is thread safe) whilst model is not yet being updated
+  LegContainer::iterator leg_it;
+  for (leg_it = model->getLegContainer()->begin(); leg_it != model->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    int id_number = leg->getIDNumber();
+    int i = 0;
+    JointContainer::iterator joint_it;
+    for (joint_it = leg->getJointContainer()->begin(); joint_it != leg->getJointContainer()->end(); ++joint_it, ++i)
+    {
+      std::shared_ptr<Joint> joint = joint_it->second;
+      joint_indices_[joint->id_name_] = std::make_pair(id_number, i);
+      joint_names_[id_number][i] = joint->id_name_;
+      joint_offsets_[id_number][i] = joint->offset_;
+      joint_publishers_[id_number][i] = joint->desired_position_publisher_;
+    }
+    output_.admittance_delta_[id_number] = Eigen::Vector3d::Zero();
+    tip_forces_[id_number] = Eigen::Vector3d::Zero();
+  }
+
+  // Joint states are received on compliance loop callback queue, independent of main control loop spinning
+  ros::NodeHandle n;
+  n.setCallbackQueue(&callback_queue_);
+  joint_state_subscriber_ = n.subscribe("joint_states", 100, &ComplianceLoop::jointStatesCallback, this);
+
+  thread_ = std::thread(&ComplianceLoop::run, this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ComplianceLoop::~ComplianceLoop(void)
+{
+  running_ = false;
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ComplianceLoop::run(void)
+{
+  ros::Rate r(rate_);
+  while (running_ && ros::ok())
+  {
+    iterate(1.0 / rate_);
+    r.sleep();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ComplianceLoop::iterate(const double& time_delta)
+{
+  // Receive latest joint efforts and main control loop state
+  callback_queue_.callAvailable();
+  input_buffer_.read(&input_);
+  if (!input_.active_)
+  {
+    return;
+  }
+
+  // Tip force filter and integrator step time scaled to give equivalent response to that at main loop rate
+  double period_ratio = time_delta / input_.time_delta_;
+  double smoothing = 1.0 - pow(1.0 - TIP_FORCE_SMOOTHING, period_ratio);
+  double step_time = input_.integrator_step_time_ * period_ratio;
+
+  // Gather force input and stiffness of each lane
+  AdmittanceLanes stiffness = lanes_.stiffness_;
+  for (int id_number = 0; id_number < MAX_LEG_COUNT; ++id_number)
+  {
+    const ComplianceLegInput &leg = input_.legs_[id_number];
+    if (leg.joint_count_ == 0)
+    {
+      continue;
+    }
+
+    Eigen::Vector3d &tip_force = tip_forces_[id_number];
+    if (input_.use_joint_effort_)
+    {
+      JointVector joint_efforts = joint_efforts_.row(id_number).head(leg.joint_count_).matrix().transpose();
+      Eigen::Vector3d raw_tip_force = leg.force_map_ * joint_efforts;
+      tip_force = smoothing * raw_tip_force * input_.force_gain_ + (1 - smoothing) * tip_force;
+    }
+    else
+    {
+      tip_force = leg.tip_force_measured_;
+    }
+    lanes_.force_.segment<3>(id_number * 3) = tip_force;
+    stiffness.segment<3>(id_number * 3).setConstant(leg.stiffness_);
+  }
+
+  // Regenerate discrete system coefficients of all lanes if the model of any leg has changed
+  if (!lanes_.isValid(input_.mass_, stiffness, input_.damping_ratio_, step_time))
+  {
+    lanes_.generate(input_.mass_, stiffness, input_.damping_ratio_, step_time);
+  }
+
+  // Advance all lanes together
+  AdmittanceLanes delta = lanes_.advance(lanes_.force_ * input_.force_gain_);
+
+  // Correct desired joint positions from main loop for change in admittance tip position offset (first order IK). The
+  // offset is projected onto the tip axis as the main loop does when setting it on the leg (Leg::setAdmittanceDelta),
+  // such that the correction is relative to the offset actually applied in the main loop desired tip pose.
+  for (int id_number = 0; id_number < MAX_LEG_COUNT; ++id_number)
+  {
+    const ComplianceLegInput &leg = input_.legs_[id_number];
+    if (leg.joint_count_ == 0)
+    {
+      continue;
+    }
+
+    Eigen::Vector3d admittance_delta = getProjection(delta.segment<3>(id_number * 3).matrix(), leg.delta_axis_);
+    output_.admittance_delta_[id_number] = admittance_delta;
+    JointVector &desired_position = desired_positions_[id_number];
+    desired_position = leg.desired_position_;
+    if (leg.apply_delta_)
+    {
+      desired_position += leg.delta_map_ * (admittance_delta - leg.admittance_delta_);
+    }
+    if (input_.clamp_joint_positions_)
+    {
+      desired_position = desired_position.cwiseMax(leg.min_position_).cwiseMin(leg.max_position_);
+    }
+  }
+
+  output_buffer_.write(output_);
+  publishDesiredJointState();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ComplianceLoop::jointStatesCallback(const sensor_msgs::JointState& joint_states)
+{
+  if (joint_states.effort.size() == 0)
+  {
+    return;
+  }
+
+  for (uint i = 0; i < joint_states.name.size(); ++i)
+  {
+    std::map<std::string, std::pair<int, int>>::iterator index_it = joint_indices_.find(joint_states.name[i]);
+    if (index_it != joint_indices_.end())
+    {
+      joint_efforts_(index_it->second.first, index_it->second.second) = joint_states.effort[i];
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ComplianceLoop::publishDesiredJointState(void)
+{
+  sensor_msgs::JointState joint_state_msg;
+  joint_state_msg.header.stamp = ros::Time::now();
+  for (int id_number = 0; id_number < MAX_LEG_COUNT; ++id_number)
+  {
+    const ComplianceLegInput &leg = input_.legs_[id_number];
+    for (int i = 0; i < leg.joint_count_; ++i)
+    {
+      if (params_.combined_control_interface.data)
+      {
+        joint_state_msg.name.push_back(joint_names_[id_number][i]);
+        joint_state_msg.position.push_back(desired_positions_[id_number][i]);
+        joint_state_msg.velocity.push_back(leg.desired_velocity_[i]);
+        joint_state_msg.effort.push_back(leg.desired_effort_[i]);
+      }
+
+      if (params_.individual_control_interface.data)
+      {
+        std_msgs::Float64 position_command_msg;
+        position_command_msg.data = desired_positions_[id_number][i] + joint_offsets_[id_number][i];
+        joint_publishers_[id_number][i].publish(position_command_msg);
+      }
+    }
+  }
+
+  if (params_.combined_control_interface.data)
+  {
+    desired_joint_state_publisher_.publish(joint_state_msg);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
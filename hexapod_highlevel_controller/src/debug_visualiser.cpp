@@ -390,16 +390,17 @@ void DebugVisualiser::generateWalkspace(std::shared_ptr<Leg> leg, const LimitMap
   origin_point.z = walkspace_origin[2];
   
   geometry_msgs::Point first_point;
-  LimitMap::const_iterator it;
-  for (it = walkspace.begin(); it != walkspace.end(); ++it)
+  for (int i = 0; i < walkspace.getBearingCount(); ++i)
   {
-    if (it->second != UNASSIGNED_VALUE)
+    int bearing = walkspace.getBearing(i);
+    double radius = walkspace.getValue(i);
+    if (radius != UNASSIGNED_VALUE)
     {
       geometry_msgs::Point point;
-      point.x = origin_point.x + it->second * cos(degreesToRadians(it->first));
-      point.y = origin_point.y + it->second * sin(degreesToRadians(it->first));
+      point.x = origin_point.x + radius * cos(degreesToRadians(bearing));
+      point.y = origin_point.y + radius * sin(degreesToRadians(bearing));
       point.z = origin_point.z;
-      if (it->first == 0)
+      if (bearing == 0)
       {
         first_point = point;
       }
@@ -413,7 +414,7 @@ void DebugVisualiser::generateWalkspace(std::shared_ptr<Leg> leg, const LimitMap
 
 void DebugVisualiser::generateWorkspace(std::shared_ptr<Leg> leg, const double& body_clearance)
 {
-  Workspace workspace = leg->getWorkspace();
+  Workspace* workspace = leg->getWorkspace();
   std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
   
   visualization_msgs::MarkerArray workspace_cage_marker_array;
@@ -431,13 +432,10 @@ void DebugVisualiser::generateWorkspace(std::shared_ptr<Leg> leg, const double&
   workspace_marker.color.a = 1;
   workspace_marker.pose = Pose::Identity().toPoseMessage();
 
-  Workspace::const_iterator workspace_it;
-  int workspace_id = 1;
-  for (workspace_it = workspace.begin(); workspace_it != workspace.end(); ++workspace_it, ++workspace_id)
+  for (int i = 0; i < workspace->getWorkplaneCount(); ++i)
   {
-    double plane_height = workspace_it->first;
-    Workplane workplane = workspace_it->second;
-    workspace_marker.id = workspace_id;
+    double plane_height = workspace->getHeight(i);
+    workspace_marker.id = i + 1;
     geometry_msgs::Point origin_point;
     Eigen::Vector3d identity_tip_position = leg_stepper->getIdentityTipPose().position_ - 
     Eigen::Vector3d::UnitZ() * body_clearance;
@@ -447,11 +445,10 @@ void DebugVisualiser::generateWorkspace(std::shared_ptr<Leg> leg, const double&
     origin_point.z = workplane_origin[2];
     
     geometry_msgs::Point first_point;
-    Workplane::const_iterator workplane_it;
-    for (workplane_it = workplane.begin(); workplane_it != workplane.end(); ++workplane_it)
+    for (int j = 0; j < workspace->getBearingCount(); ++j)
     {
-      int bearing = workplane_it->first;
-      double radius = workplane_it->second;
+      int bearing = workspace->getBearing(j);
+      double radius = workspace->getRadius(i, j);
       if (radius != UNASSIGNED_VALUE)
       {
         geometry_msgs::Point point;
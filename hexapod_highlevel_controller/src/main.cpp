@@ -111,6 +111,7 @@ int main(int argc, char* argv[])
       state.publishLegState();
       state.publishVelocity();
       state.publishPose();
+      state.publishOdometry();
       state.publishWalkspace();
       state.publishRotationPoseError();
       state.publishFrameTransforms();
@@ -11,6 +11,135 @@
 #include "syropod_highlevel_controller/pose_controller.h"
 #include "syropod_highlevel_controller/debug_visualiser.h"
 
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ModelStorage::ModelStorage(const int &leg_count)
+    : leg_count_(leg_count)
+    , dh_parameter_r_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , dh_parameter_theta_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , dh_parameter_d_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , dh_parameter_alpha_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , min_position_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , max_position_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , max_angular_speed_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , desired_position_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , desired_velocity_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , desired_effort_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , prev_desired_position_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , prev_desired_velocity_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , prev_desired_effort_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , current_position_(Eigen::ArrayXXd::Constant(leg_count, MAX_JOINT_COUNT + 1, UNASSIGNED_VALUE))
+    , current_velocity_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , current_effort_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , default_position_(Eigen::ArrayXXd::Constant(leg_count, MAX_JOINT_COUNT + 1, UNASSIGNED_VALUE))
+    , default_velocity_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , default_effort_(Eigen::ArrayXXd::Zero(leg_count, MAX_JOINT_COUNT + 1))
+    , current_transforms_(leg_count * (MAX_JOINT_COUNT + 2), Eigen::Matrix4d::Identity())
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Workspace::Workspace(const int &bearing_step)
+    : bearing_step_(bearing_step)
+{
+  if (bearing_step_ <= 0 || 360 % bearing_step_ != 0)
+  {
+    ROS_WARN_ONCE("\n[SHC] Workspace bearing step (%d) is not a divisor of 360 - using default step (%d).\n",
+                  bearing_step_, DEFAULT_BEARING_STEP);
+    bearing_step_ = DEFAULT_BEARING_STEP;
+  }
+  bearing_count_ = 360 / bearing_step_ + 1;
+  radii_.resize(0, bearing_count_);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int Workspace::addWorkplane(const double &height, const double &radius)
+{
+  std::vector<double>::iterator height_it = std::lower_bound(heights_.begin(), heights_.end(), height);
+  int workplane_index = height_it - heights_.begin();
+  if (height_it != heights_.end() && *height_it == height)
+  {
+    return workplane_index;
+  }
+
+  // Insert new row of radii, shifting rows of workplanes above new workplane
+  int workplane_count = heights_.size() + 1;
+  int upper_count = workplane_count - workplane_index - 1;
+  WorkspaceRadii radii(workplane_count, bearing_count_);
+  radii.topRows(workplane_index) = radii_.topRows(workplane_index);
+  radii.row(workplane_index).setConstant(radius);
+  radii.bottomRows(upper_count) = radii_.bottomRows(upper_count);
+  radii_.swap(radii);
+  heights_.insert(height_it, height);
+  return workplane_index;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Workspace::getBoundingWorkplanes(const double &height,
+                                      int *lower_index, int *upper_index, double *control_input) const
+{
+  ROS_ASSERT(!heights_.empty());
+  int workplane_count = heights_.size();
+  if (workplane_count == 1 || height <= heights_.front())
+  {
+    *lower_index = 0;
+    *upper_index = 0;
+    *control_input = 0.0;
+  }
+  else if (height >= heights_.back())
+  {
+    *lower_index = workplane_count - 1;
+    *upper_index = workplane_count - 1;
+    *control_input = 0.0;
+  }
+  else
+  {
+    *upper_index = std::upper_bound(heights_.begin(), heights_.end(), height) - heights_.begin();
+    *lower_index = *upper_index - 1;
+    double lower_height = heights_[*lower_index];
+    double upper_height = heights_[*upper_index];
+    *control_input = (height - lower_height) / (upper_height - lower_height);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+double Workspace::interpolateRadius(const double &height, const double &bearing) const
+{
+  // Bearings span 0 to 360 inclusive, hence the upper bounding bearing never wraps
+  double bearing_position = std::fmod(bearing, 360.0);
+  bearing_position = (bearing_position < 0.0 ? bearing_position + 360.0 : bearing_position) / bearing_step_;
+  int bearing_index = std::min(int(bearing_position), bearing_count_ - 2);
+  double bearing_control_input = clamped(bearing_position - bearing_index, 0.0, 1.0);
+
+  int lower_index, upper_index;
+  double height_control_input;
+  getBoundingWorkplanes(height, &lower_index, &upper_index, &height_control_input);
+  double lower_radius = interpolate(radii_(lower_index, bearing_index),
+                                    radii_(lower_index, bearing_index + 1), bearing_control_input);
+  double upper_radius = interpolate(radii_(upper_index, bearing_index),
+                                    radii_(upper_index, bearing_index + 1), bearing_control_input);
+  return interpolate(lower_radius, upper_radius, height_control_input);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Workplane Workspace::getWorkplane(const double &height) const
+{
+  int lower_index, upper_index;
+  double control_input;
+  getBoundingWorkplanes(height, &lower_index, &upper_index, &control_input);
+  return ((1.0 - control_input) * radii_.row(lower_index) + control_input * radii_.row(upper_index)).transpose();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 Model::Model(const Parameters &params, std::shared_ptr<DebugVisualiser> debug_visualiser)
@@ -20,6 +149,9 @@ Model::Model(const Parameters &params, std::shared_ptr<DebugVisualiser> debug_vi
     , time_delta_(params_.time_delta.data)
     , current_pose_(Pose::Identity())
     , default_pose_(Pose::Identity())
+    , storage_(leg_count_)
+    , actual_transforms_(storage_.current_transforms_)
+    , actual_tip_poses_(leg_count_, Pose::Undefined())
 {
   imu_data_.orientation = UNDEFINED_ROTATION;
   imu_data_.linear_acceleration = Eigen::Vector3d::Zero();
@@ -36,6 +168,9 @@ Model::Model(std::shared_ptr<Model> model)
     , current_pose_(model->current_pose_)
     , default_pose_(model->default_pose_)
     , imu_data_(model->imu_data_)
+    , storage_(model->leg_count_)
+    , actual_transforms_(storage_.current_transforms_)
+    , actual_tip_poses_(leg_count_, Pose::Undefined())
 {
 }
 
@@ -43,6 +178,26 @@ Model::Model(std::shared_ptr<Model> model)
 
 void Model::generate(std::shared_ptr<Model> model)
 {
+  // Reject models exceeding the bounds of fixed size storage before any leg is generated
+  std::string error;
+  if (leg_count_ > MAX_LEG_COUNT)
+  {
+    error = stringFormat("models with more than %d legs are not supported", MAX_LEG_COUNT);
+  }
+  for (int i = 0; error.empty() && i < leg_count_; ++i)
+  {
+    std::string leg_id_name = params_.leg_id.data[i];
+    if (params_.leg_DOF.data.at(leg_id_name) > MAX_JOINT_COUNT)
+    {
+      error = stringFormat("leg %s has more than %d joints", leg_id_name.c_str(), MAX_JOINT_COUNT);
+    }
+  }
+  if (!error.empty())
+  {
+    ROS_FATAL("\nModel initialisation error: %s.\n", error.c_str());
+    throw std::runtime_error("Model initialisation error: " + error);
+  }
+
   for (int i = 0; i < leg_count_; ++i)
   {
     std::shared_ptr<Leg> leg;
@@ -119,22 +274,277 @@ void Model::updateDefaultConfiguration(void)
 
 void Model::generateWorkspaces(void)
 {
-  // Create copy of model for searching for kinematic limitations
-  std::shared_ptr<Model> search_model = std::allocate_shared<Model>(Eigen::aligned_allocator<Model>(),
-                                                                    shared_from_this());
-  search_model->generate(shared_from_this());
-  search_model->initLegs(true);
+  // Load workspaces from cache if previously generated with identical parameters (bypassed whilst debugging search)
+  bool use_cache = !params_.debug_workspace_calc.data;
+  uint64_t hash = generateWorkspaceHash();
+  std::string cache_directory = getCacheDirectory(WORKSPACE_CACHE_DIRECTORY);
+  std::string cache_file_name;
+  if (use_cache && !cache_directory.empty())
+  {
+    std::stringstream ss;
+    ss << cache_directory << "/workspace_" << std::hex << hash << ".bin";
+    cache_file_name = ss.str();
+    if (loadWorkspaces(cache_file_name, hash))
+    {
+      ROS_INFO("\n[SHC] Workspace loaded from cache (%s).\n", cache_file_name.c_str());
+      return;
+    }
+  }
+
+  // Legs are independent during workspace search - search concurrently with each thread using its own model copy
+  // (Debug visualisation draws the whole search model so searching is kept sequential)
+  bool display_debug_visualisation = params_.debug_workspace_calc.data && params_.debug_rviz.data;
+  int thread_count = std::min(leg_count_, std::max(1, int(std::thread::hardware_concurrency())));
+  thread_count = display_debug_visualisation ? 1 : thread_count;
+
+  // Create copies of model for searching for kinematic limitations
+  std::vector<std::shared_ptr<Model>> search_models;
+  for (int i = 0; i < thread_count; ++i)
+  {
+    std::shared_ptr<Model> search_model = std::allocate_shared<Model>(Eigen::aligned_allocator<Model>(),
+                                                                      shared_from_this());
+    search_model->generate(shared_from_this());
+    search_model->initLegs(true);
+    search_models.push_back(search_model);
+  }
 
-  // Run workspace generation for each leg in model
+  // Run workspace generation for each leg in model, distributing legs between threads
+  std::atomic<int> next_leg_id(0);
+  std::atomic<int> completed_leg_count(0);
+  ROS_INFO("\n[SHC] Generating workspace (0%%) . . .\n");
+  auto search_legs = [&](std::shared_ptr<Model> search_model)
+  {
+    int leg_id;
+    while ((leg_id = next_leg_id++) < leg_count_)
+    {
+      std::shared_ptr<Leg> search_leg = search_model->leg_container_.at(leg_id);
+      std::shared_ptr<Leg> leg = leg_container_.at(leg_id);
+      leg->setWorkspace(search_leg->generateWorkspace());
+      int progress = roundToInt(100.0 * ++completed_leg_count / leg_count_);
+      ROS_INFO("\n[SHC] Generating workspace (%d%%) . . .\n", progress);
+    }
+  };
+
+  std::vector<std::thread> search_threads;
+  for (int i = 1; i < thread_count; ++i)
+  {
+    search_threads.push_back(std::thread(search_legs, search_models[i]));
+  }
+  search_legs(search_models[0]);
+  for (std::thread &search_thread : search_threads)
+  {
+    search_thread.join();
+  }
+
+  // Only cache workspaces if every leg has a non-degenerate workspace (i.e. search was not failed or cut short)
+  bool degenerate_workspace = false;
   LegContainer::iterator leg_it;
-  for (leg_it = search_model->getLegContainer()->begin(); leg_it != search_model->getLegContainer()->end(); ++leg_it)
+  for (leg_it = leg_container_.begin(); leg_it != leg_container_.end(); ++leg_it)
+  {
+    Workspace* workspace = leg_it->second->getWorkspace();
+    double max_radius = 0.0;
+    for (int i = 0; i < workspace->getWorkplaneCount(); ++i)
+    {
+      for (int j = 0; j < workspace->getBearingCount(); ++j)
+      {
+        max_radius = std::max(max_radius, workspace->getRadius(i, j));
+      }
+    }
+    degenerate_workspace = degenerate_workspace || max_radius <= 0.0;
+  }
+
+  if (!cache_file_name.empty() && !degenerate_workspace)
   {
-    std::shared_ptr<Leg> search_leg = leg_it->second;
-    ROS_INFO("\n[SHC] Generating workspace (%d%%) . . .\n", roundToInt(100.0 * search_leg->getIDNumber() / leg_count_));
-    std::shared_ptr<Leg> leg = leg_container_.at(search_leg->getIDNumber());
-    leg->setWorkspace(search_leg->generateWorkspace());
+    saveWorkspaces(cache_file_name, hash);
+  }
+  else if (!cache_file_name.empty())
+  {
+    ROS_WARN("\n[SHC] Generated workspace is degenerate for at least one leg and will not be cached.\n");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t Model::generateWorkspaceHash(void)
+{
+  uint64_t hash = hashValue(WORKSPACE_CACHE_VERSION);
+  hash = hashValue(params_.workspace_bearing_step.data, hash);
+  hash = hashValue(params_.workspace_layers.data, hash);
+  hash = hashValue(MAX_POSITION_DELTA, hash);
+  hash = hashValue(MAX_WORKSPACE_RADIUS, hash);
+  hash = hashValue(params_.rough_terrain_mode.data, hash);
+  hash = hashValue(params_.body_clearance.data, hash);
+  hash = hashValue(params_.bisect_workspace_search.data, hash);
+  hash = hashValue(WORKSPACE_BISECTION_TOLERANCE, hash);
+  hash = hashValue(WORKSPACE_MAX_SEARCH_STEP, hash);
+  hash = hashValue(WORKSPACE_SEARCH_MARGIN_RATIO, hash);
+  hash = hashValue(WORKSPACE_SEARCH_IK_ITERATIONS, hash);
+  hash = hashValue(WORKSPACE_SEARCH_IK_TOLERANCE, hash);
+  hash = hashValue(WORKSPACE_SEARCH_IK_STALL_RATIO, hash);
+  LegContainer::iterator leg_it;
+  for (leg_it = leg_container_.begin(); leg_it != leg_container_.end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    int leg_id = leg->getIDNumber();
+    hash = hashValue(leg->getIDName(), hash);
+    hash = hashValue(leg->getJointCount(), hash);
+    hash = hashValue(params_.leg_stance_positions[leg_id].data, hash);
+    hash = hashValue(params_.link_parameters[leg_id][0].data, hash);
+    for (int i = 1; i < leg->getJointCount() + 1; ++i)
+    {
+      hash = hashValue(params_.link_parameters[leg_id][i].data, hash);
+      hash = hashValue(params_.joint_parameters[leg_id][i - 1].data, hash);
+    }
+
+    // Workspace is searched from the default configuration of each leg
+    JointContainer::iterator joint_it;
+    for (joint_it = leg->getJointContainer()->begin(); joint_it != leg->getJointContainer()->end(); ++joint_it)
+    {
+      hash = hashValue(setPrecision(joint_it->second->default_position_, WORKSPACE_CACHE_PRECISION), hash);
+    }
+  }
+
+  // Workspace is searched relative to the current body pose
+  Eigen::Vector3d pose_position = setPrecision(current_pose_.position_, WORKSPACE_CACHE_PRECISION);
+  Eigen::Vector4d pose_rotation = current_pose_.rotation_.coeffs();
+  for (int i = 0; i < 4; ++i)
+  {
+    pose_rotation[i] = setPrecision(pose_rotation[i], WORKSPACE_CACHE_PRECISION);
+  }
+  hash = hashBytes(pose_position.data(), 3 * sizeof(double), hash);
+  hash = hashBytes(pose_rotation.data(), 4 * sizeof(double), hash);
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool Model::loadWorkspaces(const std::string &file_name, const uint64_t &hash)
+{
+  int file_descriptor = open(file_name.c_str(), O_RDONLY);
+  if (file_descriptor < 0)
+  {
+    return false;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size == 0)
+  {
+    close(file_descriptor);
+    return false;
+  }
+  size_t file_size = file_status.st_size;
+  void *file_data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (file_data == MAP_FAILED)
+  {
+    return false;
+  }
+
+  // Read sequentially from mapped file, failing if attempting to read beyond end of file
+  const char *data = static_cast<const char *>(file_data);
+  size_t offset = 0;
+  auto read = [&](void *value, const size_t &size)
+  {
+    if (offset + size > file_size)
+    {
+      return false;
+    }
+    memcpy(value, data + offset, size);
+    offset += size;
+    return true;
+  };
+
+  // Validate header
+  uint32_t version;
+  uint64_t file_hash;
+  int32_t leg_count;
+  bool valid = (read(&version, sizeof(version)) && version == WORKSPACE_CACHE_VERSION &&
+                read(&file_hash, sizeof(file_hash)) && file_hash == hash &&
+                read(&leg_count, sizeof(leg_count)) && leg_count == leg_count_);
+
+  // Read workspace of each leg
+  std::map<int, Workspace> workspaces;
+  for (int i = 0; valid && i < leg_count; ++i)
+  {
+    int32_t leg_id;
+    uint32_t workplane_count;
+    uint32_t bearing_count;
+    Workspace workspace(params_.workspace_bearing_step.data);
+    valid = (read(&leg_id, sizeof(leg_id)) && leg_container_.find(leg_id) != leg_container_.end() &&
+             read(&workplane_count, sizeof(workplane_count)) && workplane_count > 0 &&
+             read(&bearing_count, sizeof(bearing_count)) && int(bearing_count) == workspace.getBearingCount());
+
+    // Workplanes are stored in ascending height order, each followed by its contiguous row of radii
+    for (uint32_t j = 0; valid && j < workplane_count; ++j)
+    {
+      double height;
+      valid = read(&height, sizeof(height)) && (j == 0 || height > workspace.getMaxHeight());
+      int workplane_index = valid ? workspace.addWorkplane(height, 0.0) : 0;
+      valid = valid && read(&workspace.getRadius(workplane_index, 0), bearing_count * sizeof(double));
+    }
+    workspaces[leg_id] = workspace;
+  }
+  valid = valid && offset == file_size && int(workspaces.size()) == leg_count_;
+  munmap(file_data, file_size);
+
+  if (!valid)
+  {
+    ROS_WARN("\n[SHC] Workspace cache file (%s) is invalid and will be regenerated.\n", file_name.c_str());
+    return false;
+  }
+
+  std::map<int, Workspace>::iterator workspace_it;
+  for (workspace_it = workspaces.begin(); workspace_it != workspaces.end(); ++workspace_it)
+  {
+    leg_container_.at(workspace_it->first)->setWorkspace(workspace_it->second);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Model::saveWorkspaces(const std::string &file_name, const uint64_t &hash)
+{
+  std::string temporary_file_name = file_name + ".tmp";
+  std::ofstream file(temporary_file_name.c_str(), std::ios::binary | std::ios::trunc);
+  auto write = [&](const void *value, const size_t &size)
+  {
+    file.write(static_cast<const char *>(value), size);
+  };
+
+  // Write header
+  uint32_t version = WORKSPACE_CACHE_VERSION;
+  int32_t leg_count = leg_count_;
+  write(&version, sizeof(version));
+  write(&hash, sizeof(hash));
+  write(&leg_count, sizeof(leg_count));
+
+  // Write workspace of each leg
+  LegContainer::iterator leg_it;
+  for (leg_it = leg_container_.begin(); leg_it != leg_container_.end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    Workspace* workspace = leg->getWorkspace();
+    int32_t leg_id = leg->getIDNumber();
+    uint32_t workplane_count = workspace->getWorkplaneCount();
+    uint32_t bearing_count = workspace->getBearingCount();
+    write(&leg_id, sizeof(leg_id));
+    write(&workplane_count, sizeof(workplane_count));
+    write(&bearing_count, sizeof(bearing_count));
+    for (uint32_t j = 0; j < workplane_count; ++j)
+    {
+      double height = workspace->getHeight(j);
+      write(&height, sizeof(height));
+      write(&workspace->getRadius(j, 0), bearing_count * sizeof(double));
+    }
+  }
+  file.close();
+
+  // Replace existing cache file only once new file is completely written
+  if (!file || std::rename(temporary_file_name.c_str(), file_name.c_str()) != 0)
+  {
+    ROS_WARN("\n[SHC] Unable to write workspace cache file (%s).\n", file_name.c_str());
+    std::remove(temporary_file_name.c_str());
   }
-  ROS_INFO("\n[SHC] Generating workspace (100%%) . . .\n");
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -153,6 +563,65 @@ void Model::updateModel(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void Model::generateTransforms(const Eigen::ArrayXXd &joint_positions, TransformCache *transforms)
+{
+  typedef Eigen::Array<double, Eigen::Dynamic, 1, 0, MAX_LEG_COUNT, 1> LegArray;
+
+  int max_joint_count = 0;
+  LegContainer::iterator leg_it;
+  for (leg_it = leg_container_.begin(); leg_it != leg_container_.end(); ++leg_it)
+  {
+    max_joint_count = std::max(max_joint_count, leg_it->second->getJointCount());
+  }
+
+  // Element i of kinematic chain (joints 1-N, tip N+1) is transformed via link i-1, actuated by joint i-1
+  for (int i = 1; i <= max_joint_count + 1; ++i)
+  {
+    int link = i - 1;
+    LegArray joint_position = (link == 0 ? LegArray(LegArray::Zero(leg_count_)) : LegArray(joint_positions.col(link)));
+    LegArray theta = storage_.dh_parameter_theta_.col(link) + joint_position;
+    LegArray alpha = storage_.dh_parameter_alpha_.col(link);
+    LegArray sin_theta = theta.sin();
+    LegArray cos_theta = theta.cos();
+    LegArray sin_alpha = alpha.sin();
+    LegArray cos_alpha = alpha.cos();
+    for (int l = 0; l < leg_count_; ++l)
+    {
+      double r = storage_.dh_parameter_r_(l, link);
+      double d = storage_.dh_parameter_d_(l, link);
+      (*transforms)[storage_.getTransformIndex(l, i)] <<
+        cos_theta[l], -sin_theta[l] * cos_alpha[l],  sin_theta[l] * sin_alpha[l], r * cos_theta[l],
+        sin_theta[l],  cos_theta[l] * cos_alpha[l], -cos_theta[l] * sin_alpha[l], r * sin_theta[l],
+        0,             sin_alpha[l],                 cos_alpha[l],                d,
+        0,             0,                            0,                           1;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PoseArray* Model::applyActualFK(void)
+{
+  generateTransforms(storage_.current_position_, &actual_transforms_);
+
+  // Accumulate transforms along kinematic chain of each leg to get tip pose
+  LegContainer::iterator leg_it;
+  for (leg_it = leg_container_.begin(); leg_it != leg_container_.end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    int leg_id = leg->getIDNumber();
+    Eigen::Matrix4d transform = Eigen::Matrix4d::Identity();
+    for (int i = 1; i <= leg->getJointCount() + 1; ++i)
+    {
+      transform = transform * actual_transforms_[storage_.getTransformIndex(leg_id, i)];
+    }
+    actual_tip_poses_[leg_id] = Pose::Identity().transform(transform);
+  }
+  return &actual_tip_poses_;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 Eigen::Vector3d Model::estimateGravity(void)
 {
   Eigen::Vector3d euler = quaternionToEulerAngles(imu_data_.orientation);
@@ -171,8 +640,10 @@ Leg::Leg(std::shared_ptr<Model> model, const int &id_number, const Parameters &p
     , id_number_(id_number)
     , id_name_(params_.leg_id.data.at(id_number))
     , joint_count_(params_.leg_DOF.data.at(id_name_))
+    , ik_kernel_(NULL)
     , leg_state_(WALKING)
     , admittance_delta_(Eigen::Vector3d::Zero())
+    , admittance_delta_applied_(false)
     , admittance_state_(std::vector<double>(2))
 {
   desired_tip_pose_ = Pose::Undefined();
@@ -184,6 +655,7 @@ Leg::Leg(std::shared_ptr<Model> model, const int &id_number, const Parameters &p
   tip_torque_calculated_ = Eigen::Vector3d::Zero();
   tip_torque_measured_ = Eigen::Vector3d::Zero();
   step_plane_pose_ = Pose::Undefined();
+  virtual_stiffness_ = params_.virtual_stiffness.current_value;
   group_ = (id_number % 2); // Even/odd groups
 }
 
@@ -194,6 +666,7 @@ Leg::Leg(std::shared_ptr<Leg> leg, std::shared_ptr<Model> model)
     , id_number_(leg->id_number_)
     , id_name_(leg->id_name_)
     , joint_count_(leg->joint_count_)
+    , ik_kernel_(leg->ik_kernel_)
     , leg_state_(leg->leg_state_)
     , admittance_state_(leg->admittance_state_)
 {
@@ -201,6 +674,7 @@ Leg::Leg(std::shared_ptr<Leg> leg, std::shared_ptr<Model> model)
   leg_state_publisher_ = leg->leg_state_publisher_;
   asc_leg_state_publisher_ = leg->asc_leg_state_publisher_;
   admittance_delta_ = leg->admittance_delta_;
+  admittance_delta_applied_ = leg->admittance_delta_applied_;
   virtual_mass_ = leg->virtual_mass_;
   virtual_stiffness_ = leg->virtual_stiffness_;
   virtual_damping_ratio_ = leg->virtual_damping_ratio_;
@@ -221,7 +695,8 @@ Leg::Leg(std::shared_ptr<Leg> leg, std::shared_ptr<Model> model)
 void Leg::generate(std::shared_ptr<Leg> leg)
 {
   // Null joint acts as origin
-  std::shared_ptr<Joint> null_joint = std::allocate_shared<Joint>(Eigen::aligned_allocator<Joint>());
+  std::shared_ptr<Joint> null_joint =
+      std::allocate_shared<Joint>(Eigen::aligned_allocator<Joint>(), getModelStorage(), id_number_);
   std::shared_ptr<Link> base_link =
       std::allocate_shared<Link>(Eigen::aligned_allocator<Link>(), shared_from_this(), null_joint, 0, params_);
   link_container_.insert(LinkContainer::value_type(0, base_link));
@@ -237,6 +712,43 @@ void Leg::generate(std::shared_ptr<Leg> leg)
     prev_link = new_link;
   }
   tip_ = std::allocate_shared<Tip>(Eigen::aligned_allocator<Tip>(), shared_from_this(), prev_link);
+  // Analytic IK requires a coxa/femur/tibia structure - i.e. coxa axis perpendicular to planar femur/tibia chain
+  if (joint_count_ == 3 && params_.use_analytic_IK.data)
+  {
+    std::shared_ptr<Link> coxa_link = link_container_.at(1);
+    std::shared_ptr<Link> femur_link = link_container_.at(2);
+    std::shared_ptr<Link> tibia_link = link_container_.at(3);
+    analytic_ik_compatible_ = (abs(cos(coxa_link->dh_parameter_alpha_)) < ANALYTIC_IK_TOLERANCE &&
+                               abs(femur_link->dh_parameter_alpha_) < ANALYTIC_IK_TOLERANCE &&
+                               femur_link->dh_parameter_r_ > 0.0 && tibia_link->dh_parameter_r_ > 0.0);
+    ROS_WARN_COND(!analytic_ik_compatible_,
+                  "\nLeg %s geometry is incompatible with analytic inverse kinematics. Using DLS solution.\n",
+                  id_name_.c_str());
+  }
+
+  base_transforms_.resize(joint_count_ + 2, Eigen::Matrix4d::Identity());
+  inverse_base_transforms_.resize(joint_count_ + 2, Eigen::Matrix4d::Identity());
+  invalidateTransformCache();
+
+  // Select fixed size inverse kinematics kernel for leg DOF (dynamically sized for uncommon DOF)
+  switch (joint_count_)
+  {
+    case (3):
+      ik_kernel_ = &Leg::applyIKKernel<3>;
+      break;
+    case (4):
+      ik_kernel_ = &Leg::applyIKKernel<4>;
+      break;
+    case (5):
+      ik_kernel_ = &Leg::applyIKKernel<5>;
+      break;
+    case (6):
+      ik_kernel_ = &Leg::applyIKKernel<6>;
+      break;
+    default:
+      ik_kernel_ = &Leg::applyIKKernel<Eigen::Dynamic>;
+      break;
+  }
 
   // If given reference leg, copy member element variables to this leg object
   if (leg != NULL)
@@ -270,6 +782,7 @@ void Leg::generate(std::shared_ptr<Leg> leg)
     // Copy tip variables
     tip_->identity_transform_ = leg->tip_->identity_transform_;
     tip_->current_transform_ = leg->tip_->current_transform_;
+    invalidateTransformCache();
 
     // Copy LegStepper
     leg_stepper_ = std::allocate_shared<LegStepper>(Eigen::aligned_allocator<LegStepper>(), leg->getLegStepper());
@@ -312,6 +825,7 @@ Workspace Leg::generateWorkspace(void)
   bool display_debug_visualisation = debug && params_.debug_rviz.data;
   bool workspace_generation_complete = false;
   bool simple_workspace = !params_.rough_terrain_mode.data;
+  bool bisect_search = params_.bisect_workspace_search.data;
 
   // Publish static transforms for visualisation purposes
   if (display_debug_visualisation)
@@ -330,15 +844,10 @@ Workspace Leg::generateWorkspace(void)
     static_broadcaster.sendTransform(static_base_link_to_walk_plane);
   }
 
-  // Init maximal/minimal workplanes
-  Workplane max_workplane;
-  Workplane min_workplane;
-  for (int bearing = 0; bearing <= 360; bearing += BEARING_STEP)
-  {
-    max_workplane.insert(Workplane::value_type(bearing, MAX_WORKSPACE_RADIUS));
-    min_workplane.insert(Workplane::value_type(bearing, 0.0));
-  }
-  workspace_.clear();
+  // Init empty workspace at configured resolution
+  workspace_ = Workspace(params_.workspace_bearing_step.data);
+  int bearing_step = workspace_.getBearingStep();
+  int workspace_layers = std::max(1, params_.workspace_layers.data);
 
   // Calculate Identity tip pose
   Pose current_pose = model_->getCurrentPose();
@@ -348,20 +857,21 @@ Workspace Leg::generateWorkspace(void)
   // Set zero workspace if unable to reach idenity_tip_pose
   if ((identity_tip_position - current_tip_pose_.position_).norm() > IK_TOLERANCE)
   {
-    workspace_.insert(Workspace::value_type(0.0, min_workplane));
+    workspace_.addWorkplane(0.0, 0.0);
     return workspace_;
   }
 
+  int search_workplane = 0;
   if (simple_workspace)
   {
-    workspace_.insert(Workspace::value_type(0.0, max_workplane));
+    search_workplane = workspace_.addWorkplane(0.0, MAX_WORKSPACE_RADIUS);
   }
 
   bool found_lower_limit = simple_workspace ? true : false;
   bool found_upper_limit = simple_workspace ? true : false;
   double max_plane_height = simple_workspace ? 0.0 : MAX_WORKSPACE_RADIUS;
   double min_plane_height = simple_workspace ? 0.0 : -MAX_WORKSPACE_RADIUS;
-  double search_height_delta = MAX_WORKSPACE_RADIUS / WORKSPACE_LAYERS;
+  double search_height_delta = MAX_WORKSPACE_RADIUS / workspace_layers;
 
   double search_height = 0.0;
   int search_bearing = 0;
@@ -413,22 +923,37 @@ Workspace Leg::generateWorkspace(void)
       }
     }
 
+    // Search for kinematic workspace limit along search line via bisection (tracking to workplane origin is linear)
+    bool tracking_to_workplane_origin = found_lower_limit && found_upper_limit && search_bearing == 0;
+    if (bisect_search && !tracking_to_workplane_origin)
+    {
+      bisectWorkspaceLimit(origin_tip_position, target_tip_position);
+      distance_from_origin = Eigen::Vector3d(current_tip_pose_.position_ - identity_tip_position).norm();
+      iteration = number_iterations;
+
+      // Display debugging messages
+      ROS_DEBUG_COND(debug && search_bearing != 0, "LEG: %s\tSEARCH: %f:%d\tDISTANCE: %f",
+                     id_name_.c_str(), search_height, search_bearing, distance_from_origin);
+    }
     // Move tip position linearly along search bearing in search of kinematic workspace limit
-    double i = double(iteration) / number_iterations;                                                 // Interpolation control variable
-    Eigen::Vector3d desired_tip_position = origin_tip_position * (1.0 - i) + target_tip_position * i; // Interpolate
-    // Quaterniond desired_tip_rotation = leg_stepper->getIdentityTipPose().rotation_;
-    setDesiredTipPose(Pose(desired_tip_position, UNDEFINED_ROTATION));
-    double ik_result = applyIK(true);
-    distance_from_origin = Eigen::Vector3d(current_tip_pose_.position_ - identity_tip_position).norm();
-
-    // Check if leg is still within limits
-    within_limits = within_limits && ik_result != 0.0;
-
-    // Display debugging messages
-    ROS_DEBUG_COND(debug && search_bearing != 0,
-                   "LEG: %s\tSEARCH: %f:%d:%d\tDISTANCE: %f\tIK_RESULT: %f\tWITHIN LIMITS: %s",
-                   id_name_.c_str(), search_height, search_bearing,
-                   iteration, distance_from_origin, ik_result, within_limits ? "TRUE" : "FALSE");
+    else
+    {
+      double i = double(iteration) / number_iterations;                                                 // Interpolation control variable
+      Eigen::Vector3d desired_tip_position = origin_tip_position * (1.0 - i) + target_tip_position * i; // Interpolate
+      // Quaterniond desired_tip_rotation = leg_stepper->getIdentityTipPose().rotation_;
+      setDesiredTipPose(Pose(desired_tip_position, UNDEFINED_ROTATION));
+      double ik_result = applyIK(true);
+      distance_from_origin = Eigen::Vector3d(current_tip_pose_.position_ - identity_tip_position).norm();
+
+      // Check if leg is still within limits
+      within_limits = within_limits && ik_result != 0.0;
+
+      // Display debugging messages
+      ROS_DEBUG_COND(debug && search_bearing != 0,
+                     "LEG: %s\tSEARCH: %f:%d:%d\tDISTANCE: %f\tIK_RESULT: %f\tWITHIN LIMITS: %s",
+                     id_name_.c_str(), search_height, search_bearing,
+                     iteration, distance_from_origin, ik_result, within_limits ? "TRUE" : "FALSE");
+    }
 
     // Search not complete -> iterate along current search bearing
     if (within_limits && iteration < number_iterations)
@@ -444,7 +969,7 @@ Workspace Leg::generateWorkspace(void)
       {
         found_lower_limit = true;
         min_plane_height = -distance_from_origin;
-        workspace_.insert(Workspace::value_type(min_plane_height, min_workplane));
+        workspace_.addWorkplane(min_plane_height, 0.0);
         continue;
       }
       // Upper vertical limit found - reset to start searching for limits within intermediate workplanes
@@ -452,11 +977,11 @@ Workspace Leg::generateWorkspace(void)
       {
         found_upper_limit = true;
         max_plane_height = distance_from_origin;
-        search_height_delta = (max_plane_height - min_plane_height) / WORKSPACE_LAYERS;
+        search_height_delta = (max_plane_height - min_plane_height) / workspace_layers;
         int upper_levels = int(abs(max_plane_height) / search_height_delta);
         search_height = upper_levels * search_height_delta;
-        workspace_.insert(Workspace::value_type(max_plane_height, min_workplane));
-        workspace_.insert(Workspace::value_type(search_height, max_workplane));
+        workspace_.addWorkplane(max_plane_height, 0.0);
+        search_workplane = workspace_.addWorkplane(search_height, MAX_WORKSPACE_RADIUS);
         continue;
       }
       // Tracked to origin of new workplane, update default configuration to easily reset betweeen search bearings
@@ -467,23 +992,24 @@ Workspace Leg::generateWorkspace(void)
       // Search along bearing complete - save in workspace
       else
       {
-        workspace_.at(search_height)[search_bearing] = distance_from_origin;
+        workspace_.getRadius(search_workplane, search_bearing / bearing_step) = distance_from_origin;
       }
 
       // Iterate search bearing (0 -> 360 anti-clockwise)
-      if (search_bearing + BEARING_STEP <= 360)
+      if (search_bearing + bearing_step <= 360)
       {
-        search_bearing += BEARING_STEP;
+        search_bearing += bearing_step;
       }
       // Iterate search height (top to bottom)
       else
       {
         search_bearing = 0;
-        workspace_.at(search_height)[0] = workspace_.at(search_height).at(360);
+        int last_bearing_index = workspace_.getBearingCount() - 1;
+        workspace_.getRadius(search_workplane, 0) = workspace_.getRadius(search_workplane, last_bearing_index);
         search_height -= search_height_delta;
         if (search_height >= min_plane_height)
         {
-          workspace_.insert(Workspace::value_type(search_height, max_workplane));
+          search_workplane = workspace_.addWorkplane(search_height, MAX_WORKSPACE_RADIUS);
         }
         // All searches complete - set workspace generation complete and reset
         else
@@ -511,67 +1037,182 @@ Workspace Leg::generateWorkspace(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Workplane Leg::getWorkplane(const double &height)
+void Leg::bisectWorkspaceLimit(const Eigen::Vector3d &origin_tip_position,
+                               const Eigen::Vector3d &target_tip_position)
 {
-  bool within_workspace = (height >= workspace_.begin()->first && height <= workspace_.rbegin()->first);
-  if (!within_workspace)
+  // Store/restore desired joint positions of a feasible configuration
+  Eigen::VectorXd feasible_joint_positions(joint_count_);
+  auto store_configuration = [&](void)
   {
-    ROS_WARN("\n[SHC] Requested workplane does not exist within workspace.\n");
-    Workplane undefined;
-    return undefined;
-  }
-  else if (workspace_.size() == 1)
+    int i = 0;
+    JointContainer::iterator joint_it;
+    for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
+    {
+      feasible_joint_positions[i] = joint_it->second->desired_position_;
+    }
+  };
+  auto restore_configuration = [&](void)
   {
-    return workspace_.at(0.0);
+    int i = 0;
+    JointContainer::iterator joint_it;
+    for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
+    {
+      std::shared_ptr<Joint> joint = joint_it->second;
+      joint->desired_position_ = feasible_joint_positions[i];
+      joint->prev_desired_position_ = feasible_joint_positions[i];
+      joint->desired_velocity_ = 0.0;
+    }
+    applyFK();
+  };
+
+  // Checks feasibility of tip position by iterating IK from the current configuration until converged to the tip
+  // position (feasible unless a joint is at its limit) or a joint reaches its limit (infeasible). IK is converged once
+  // the tip is within tolerance of the tip position, or has stalled within IK tolerance with no joint still closing
+  // on its limit (as damped IK of legs with redundant joints may not converge further).
+  auto check_feasibility = [&](const Eigen::Vector3d &tip_position)
+  {
+    setDesiredTipPose(Pose(tip_position, UNDEFINED_ROTATION));
+    double previous_error = UNASSIGNED_VALUE;
+    double previous_ik_result = UNASSIGNED_VALUE;
+    for (int i = 0; i < WORKSPACE_SEARCH_IK_ITERATIONS; ++i)
+    {
+      double ik_result = applyIK(true);
+      double error = (current_tip_pose_.position_ - tip_position).norm();
+      bool stalled = (error <= IK_TOLERANCE &&
+                      error > WORKSPACE_SEARCH_IK_STALL_RATIO * previous_error &&
+                      ik_result > WORKSPACE_SEARCH_IK_STALL_RATIO * previous_ik_result);
+      if (error <= WORKSPACE_SEARCH_IK_TOLERANCE || stalled)
+      {
+        return ik_result != 0.0;
+      }
+      previous_error = error;
+      previous_ik_result = ik_result;
+
+      JointContainer::iterator joint_it;
+      for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it)
+      {
+        std::shared_ptr<Joint> joint = joint_it->second;
+        if (joint->desired_position_ <= joint->min_position_ || joint->desired_position_ >= joint->max_position_)
+        {
+          return false;
+        }
+      }
+    }
+    return false;
+  };
+
+  double search_distance = (target_tip_position - origin_tip_position).norm();
+  Eigen::Vector3d search_direction = (target_tip_position - origin_tip_position).normalized();
+  store_configuration();
+
+  // Rate of change of each joint position per distance along search line (first order IK) at feasible configuration
+  Eigen::VectorXd joint_rates = getTipDeltaMap() * search_direction;
+  Eigen::VectorXd previous_joint_rates = joint_rates;
+  double previous_step = 0.0;
+
+  // Generates the largest step along the search line over which no joint is predicted to consume more than a ratio of
+  // its margin from its limits, from the rate and change in rate (over the previous step) of each joint. Feasibility
+  // is not monotonic along the search line (a joint may reach its limit and then move away from it again) so the
+  // prediction includes change in rate, such that steps shrink whilst any joint approaches a limit, even slowly.
+  auto generate_step = [&](void)
+  {
+    if (previous_step == 0.0)
+    {
+      return MAX_POSITION_DELTA;
+    }
+    int i = 0;
+    double step = WORKSPACE_MAX_SEARCH_STEP;
+    JointContainer::iterator joint_it;
+    for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
+    {
+      std::shared_ptr<Joint> joint = joint_it->second;
+      double limit_margin = std::min(joint->desired_position_ - joint->min_position_,
+                                     joint->max_position_ - joint->desired_position_);
+      double margin = WORKSPACE_SEARCH_MARGIN_RATIO * std::max(limit_margin, 0.0);
+      double rate = abs(joint_rates[i]);
+      double rate_change = abs(joint_rates[i] - previous_joint_rates[i]) / previous_step;
+
+      // Solves rate * step + rate_change * step^2 / 2 = margin for step
+      double joint_step = 2.0 * margin / (rate + sqrt(sqr(rate) + 2.0 * rate_change * margin));
+      step = std::min(step, joint_step);
+    }
+    return std::max(step, MAX_POSITION_DELTA);
+  };
+
+  // Bracket limit by stepping from origin towards target. An infeasible step is retried with halved steps until it is
+  // no longer than those of the linear search, such that the bracket is never wider than a linear search step.
+  double lower_distance = 0.0;
+  double upper_distance = search_distance;
+  double max_step = WORKSPACE_MAX_SEARCH_STEP;
+  while (lower_distance < search_distance)
+  {
+    double step = std::min(std::min(generate_step(), max_step), search_distance - lower_distance);
+    if (check_feasibility(origin_tip_position + (lower_distance + step) * search_direction))
+    {
+      lower_distance += step;
+      store_configuration();
+      previous_joint_rates = joint_rates;
+      joint_rates = getTipDeltaMap() * search_direction;
+      previous_step = step;
+    }
+    else if (step > MAX_POSITION_DELTA)
+    {
+      restore_configuration();
+      max_step = std::max(step / 2.0, MAX_POSITION_DELTA);
+    }
+    else
+    {
+      upper_distance = lower_distance + step;
+      break;
+    }
   }
 
-  // Get bounding existing workplanes within workspace
-  ROS_ASSERT(workspace_.size() > 1);
-  Workspace::iterator upper_bound_it = workspace_.upper_bound(height);
-  Workspace::iterator lower_bound_it = prev(upper_bound_it);
-  double upper_workplane_height = setPrecision(upper_bound_it->first, 3);
-  double lower_workplane_height = setPrecision(lower_bound_it->first, 3);
-  Workplane upper_workplane = upper_bound_it->second;
-  Workplane lower_workplane = lower_bound_it->second;
+  // Bisect bracket, resuming each check from the last feasible configuration
+  while (upper_distance - lower_distance > WORKSPACE_BISECTION_TOLERANCE)
+  {
+    double middle_distance = (lower_distance + upper_distance) / 2.0;
+    restore_configuration();
+    if (check_feasibility(origin_tip_position + middle_distance * search_direction))
+    {
+      lower_distance = middle_distance;
+      store_configuration();
+    }
+    else
+    {
+      upper_distance = middle_distance;
+    }
+  }
+  restore_configuration();
+}
 
-  // Calculate interpolation value of target workplane height between existing workspace planes
-  double i = (height - lower_workplane_height) / (upper_workplane_height - lower_workplane_height);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  // Generate workplane radii
-  Workplane workplane = upper_workplane;
-  Workplane::iterator workplane_it;
-  for (workplane_it = workplane.begin(); workplane_it != workplane.end(); ++workplane_it)
+Workplane Leg::getWorkplane(const double &height)
+{
+  bool within_workspace = (height >= workspace_.getMinHeight() && height <= workspace_.getMaxHeight());
+  if (!within_workspace)
   {
-    int bearing = workplane_it->first;
-    double radius = lower_workplane.at(bearing) * (1.0 - i) + upper_workplane.at(bearing) * i;
-    workplane[bearing] = within_workspace ? radius : 0.0;
+    ROS_WARN("\n[SHC] Requested workplane does not exist within workspace.\n");
+    Workplane undefined;
+    return undefined;
   }
-  return workplane;
+  return workspace_.getWorkplane(height);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 Eigen::Vector3d Leg::makeReachable(const Eigen::Vector3d &reference_tip_position)
 {
-  // Get workplane containing test tip position
+  // Get test tip position relative to workspace
   Pose pose = model_->getCurrentPose();
   Eigen::Vector3d test_tip_position = pose.inverseTransformVector(reference_tip_position);
   Eigen::Vector3d identity_tip_position = leg_stepper_->getIdentityTipPose().position_;
   Eigen::Vector3d identity_to_test = test_tip_position - identity_tip_position;
   double distance_to_test = Eigen::Vector2d(identity_to_test[0], identity_to_test[1]).norm();
-  LimitMap workplane = getWorkplane(test_tip_position[2]);
 
   // Find distance to workplane limit along bearing to test tip position
   double raw_bearing = atan2(test_tip_position[1], test_tip_position[0]);
-  int bearing = mod(roundToInt(radiansToDegrees(raw_bearing)), 360);
-  int upper_bound = workplane.lower_bound(bearing)->first;
-  int lower_bound = mod(upper_bound - BEARING_STEP, 360);
-  bearing += (bearing < lower_bound) ? 360 : 0;
-  upper_bound += (upper_bound < lower_bound) ? 360 : 0;
-  double interpolation_progress = (bearing - lower_bound) / (upper_bound - lower_bound);
-  double distance_to_limit = interpolate(workplane.at(lower_bound),
-                                         workplane.at(mod(upper_bound, 360)),
-                                         interpolation_progress);
+  double distance_to_limit = workspace_.interpolateRadius(test_tip_position[2], radiansToDegrees(raw_bearing));
 
   // If test tip position is beyond limit, calculate new position along same workplane bearing within limits
   if (distance_to_test > distance_to_limit)
@@ -590,6 +1231,27 @@ Eigen::Vector3d Leg::makeReachable(const Eigen::Vector3d &reference_tip_position
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void Leg::calculateReachabilityMargins(const TipPositionBatch &tip_positions, TipMarginBatch *margins)
+{
+  // Get test tip positions relative to workspace
+  Pose pose = model_->getCurrentPose();
+  Eigen::Matrix3d inverse_rotation = pose.rotation_.toRotationMatrix().transpose();
+  TipPositionBatch test_tip_positions = inverse_rotation * (tip_positions.colwise() - pose.position_);
+  TipPositionBatch identity_to_test = test_tip_positions.colwise() - leg_stepper_->getIdentityTipPose().position_;
+
+  // Compare distance to each test tip position with distance to workplane limit along bearing to test tip position
+  margins->resize(tip_positions.cols());
+  for (int i = 0; i < tip_positions.cols(); ++i)
+  {
+    double distance_to_test = identity_to_test.col(i).head<2>().norm();
+    double raw_bearing = atan2(test_tip_positions(1, i), test_tip_positions(0, i));
+    double distance_to_limit = workspace_.interpolateRadius(test_tip_positions(2, i), radiansToDegrees(raw_bearing));
+    (*margins)[i] = distance_to_limit - distance_to_test;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void Leg::updateDefaultConfiguration(void)
 {
   JointContainer::iterator joint_it;
@@ -659,26 +1321,26 @@ void Leg::setDesiredTipPose(const Pose &tip_pose, bool apply_delta)
 
   desired_tip_pose_ = use_poser_tip_pose ? leg_poser_->getCurrentTipPose() : tip_pose;
   desired_tip_pose_.position_ += (apply_delta ? admittance_delta_ : Eigen::Vector3d::Zero());
+  admittance_delta_applied_ = apply_delta;
   ROS_ASSERT(desired_tip_pose_.isValid());
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Leg::calculateTipForce(void)
+void Leg::updateKinematicState(void)
 {
+  // Calculate Jacobian from DH matrices along kinematic chain. Ref:
+  // robotics.stackexchange.com/questions/2760/computing-inverse-kinematic-with-jacobian-matrices-for-6-dof-manipulator
   std::shared_ptr<Joint> first_joint = joint_container_.begin()->second;
-
   Eigen::Vector3d pe = tip_->getTransformFromJoint(first_joint->id_number_).block<3, 1>(0, 3);
   Eigen::Vector3d z0(0, 0, 1);
   Eigen::Vector3d p0(0, 0, 0);
 
-  Eigen::MatrixXd jacobian(6, joint_count_);
+  Jacobian &jacobian = kinematic_state_.jacobian;
+  jacobian.resize(6, joint_count_);
   jacobian.block<3, 1>(0, 0) = z0.cross(pe - p0); // Linear velocity
   jacobian.block<3, 1>(3, 0) = z0;                // Angular velocity
 
-  Eigen::VectorXd joint_torques(joint_count_);
-  joint_torques[0] = first_joint->current_effort_;
-
   // Skip first joint dh parameters since it is a fixed transformation
   int i = 1;
   JointContainer::iterator joint_it;
@@ -688,20 +1350,35 @@ void Leg::calculateTipForce(void)
     Eigen::Matrix4d t = joint->getTransformFromJoint(first_joint->id_number_);
     jacobian.block<3, 1>(0, i) = t.block<3, 1>(0, 2).cross(pe - t.block<3, 1>(0, 3)); // Linear velocity
     jacobian.block<3, 1>(3, i) = t.block<3, 1>(0, 2);                                 // Angular velocity
-    joint_torques[i] = joint->current_effort_;
   }
 
-  // Transpose and invert jacobian
-  Eigen::MatrixXd identity = Eigen::MatrixXd::Identity(joint_count_, joint_count_);
-  Eigen::MatrixXd transformation =
-      jacobian * ((jacobian.transpose() * jacobian + sqr(DLS_COEFFICIENT) * identity).inverse());
+  // Calculate jacobian inverses using damped least squares method
+  // REF: Chapter 5 of Introduction to Inverse Kinematics... , Samuel R. Buss 2009
+  Eigen::Matrix<double, 3, Eigen::Dynamic, 0, 3, MAX_JOINT_COUNT> linear_jacobian = jacobian.topRows(3);
+  Eigen::Matrix<double, 6, 6> jacobian_square = jacobian * jacobian.transpose();
+  Eigen::Matrix3d linear_jacobian_square = linear_jacobian * linear_jacobian.transpose();
+  kinematic_state_.dls_inverse = jacobian.transpose() *
+    (jacobian_square + sqr(DLS_COEFFICIENT) * Eigen::Matrix<double, 6, 6>::Identity()).inverse();
+  kinematic_state_.position_dls_inverse = linear_jacobian.transpose() *
+    (linear_jacobian_square + sqr(DLS_COEFFICIENT) * Eigen::Matrix3d::Identity()).inverse();
+  kinematic_state_.valid = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  Eigen::VectorXd raw_tip_force_leg_frame = transformation * joint_torques;
-  Eigen::Quaterniond rotation = (first_joint->getPoseJointFrame()).rotation_;
-  Eigen::VectorXd raw_tip_force = rotation._transformVector(raw_tip_force_leg_frame.block<3, 1>(0, 0));
+void Leg::calculateTipForce(void)
+{
+  int i = 0;
+  JointContainer::iterator joint_it;
+  Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> joint_torques(joint_count_);
+  for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
+  {
+    joint_torques[i] = joint_it->second->current_effort_;
+  }
+  Eigen::Vector3d raw_tip_force = getTipForceMap() * joint_torques;
 
   // Low pass filter and force gain applied to calculated raw tip force
-  double s = 0.15; // Smoothing Factor
+  double s = TIP_FORCE_SMOOTHING;
   tip_force_calculated_[0] = s*raw_tip_force[0]*params_.force_gain.current_value + (1 - s)*tip_force_calculated_[0];
   tip_force_calculated_[1] = s*raw_tip_force[1]*params_.force_gain.current_value + (1 - s)*tip_force_calculated_[1];
   tip_force_calculated_[2] = s*raw_tip_force[2]*params_.force_gain.current_value + (1 - s)*tip_force_calculated_[2];
@@ -709,6 +1386,29 @@ void Leg::calculateTipForce(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+TipForceMap Leg::getTipForceMap(void)
+{
+  // Map joint torques to tip force via the transposed DLS pseudo-inverse shared with inverse kinematics, since
+  // J * (J^T * J + k^2 * I)^-1 == (J^T * (J * J^T + k^2 * I)^-1)^T
+  std::shared_ptr<Joint> first_joint = joint_container_.begin()->second;
+  const KinematicState &kinematic_state = getKinematicState();
+  Eigen::Matrix3d rotation = first_joint->getPoseJointFrame().rotation_.toRotationMatrix();
+  return rotation * kinematic_state.dls_inverse.transpose().topRows<3>();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+LinearJacobianInverse Leg::getTipDeltaMap(void)
+{
+  // Tip position delta is transformed into the first joint frame in which the jacobian is defined (as per IK)
+  std::shared_ptr<Joint> first_joint = joint_container_.begin()->second;
+  const KinematicState &kinematic_state = getKinematicState();
+  Eigen::Matrix3d rotation = first_joint->getPoseJointFrame().rotation_.toRotationMatrix();
+  return kinematic_state.position_dls_inverse * rotation;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void Leg::touchdownDetection(void)
 {
   if (tip_force_measured_.norm() > params_.touchdown_threshold.data && step_plane_pose_ == Pose::Undefined())
@@ -723,45 +1423,35 @@ void Leg::touchdownDetection(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Eigen::VectorXd Leg::solveIK(const Eigen::MatrixXd &delta, const bool &solve_rotation)
+template <int DOF>
+Eigen::Matrix<double, DOF, 1> Leg::solveIK(const Eigen::Matrix<double, 6, 1> &delta, const bool &solve_rotation)
 {
-  // Calculate Jacobian from DH matrices along kinematic chain. Ref:
-  // robotics.stackexchange.com/questions/2760/computing-inverse-kinematic-with-jacobian-matrices-for-6-dof-manipulator
-  std::shared_ptr<Joint> first_joint = joint_container_.begin()->second;
-  Eigen::Vector3d pe = tip_->getTransformFromJoint(first_joint->id_number_).block<3, 1>(0, 3);
-  Eigen::Vector3d z0(0, 0, 1);
-  Eigen::Vector3d p0(0, 0, 0);
-
-  Eigen::MatrixXd jacobian(6, joint_count_);
-  jacobian.block<3, 1>(0, 0) = z0.cross(pe - p0);                             // Linear velocity
-  jacobian.block<3, 1>(3, 0) = solve_rotation ? z0 : Eigen::Vector3d::Zero(); // Angular velocity
-
-  JointContainer::iterator joint_it;
-  int i = 1; // Skip first joint dh parameters since it is a fixed transformation
-  for (joint_it = ++joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
+  // Jacobian and DLS pseudo-inverse are shared with tip force estimation via the leg kinematic state. Ignoring
+  // rotation is equivalent to zeroing the angular rows of the jacobian, for which the DLS pseudo-inverse reduces to
+  // that of the linear rows alone with zero columns for the angular components of the delta.
+  const KinematicState &kinematic_state = getKinematicState();
+  Eigen::Matrix<double, 6, DOF> j = kinematic_state.jacobian;
+  Eigen::Matrix<double, DOF, 6> jacobian_inverse(joint_count_, 6);
+  if (solve_rotation)
   {
-    std::shared_ptr<Joint> joint = joint_it->second;
-    Eigen::Matrix4d t = joint->getTransformFromJoint(first_joint->id_number_);
-    jacobian.block<3, 1>(0, i) = t.block<3, 1>(0, 2).cross(pe - t.block<3, 1>(0, 3));             // Linear velocity
-    jacobian.block<3, 1>(3, i) = solve_rotation ? t.block<3, 1>(0, 2) : Eigen::Vector3d(0, 0, 0); // Angular velocity
+    jacobian_inverse = kinematic_state.dls_inverse;
+  }
+  else
+  {
+    j.bottomRows(3).setZero();
+    jacobian_inverse.leftCols(3) = kinematic_state.position_dls_inverse;
+    jacobian_inverse.rightCols(3).setZero();
   }
-
-  Eigen::MatrixXd identity = Eigen::MatrixXd::Identity(6, 6);
-  Eigen::MatrixXd jacobian_inverse(joint_count_, 6);
-  Eigen::MatrixXd j = jacobian;
-
-  // Calculate jacobian inverse using damped least squares method
-  // REF: Chapter 5 of Introduction to Inverse Kinematics... , Samuel R. Buss 2009
-  jacobian_inverse = j.transpose() * ((j * j.transpose() + sqr(DLS_COEFFICIENT) * identity).inverse()); //DLS Method
 
   // Generate joint limit cost function and gradient
   // REF: Chapter 2.4 of Autonomous Robots - Kinematics, Path Planning and Control, Farbod. Fahimi 2008
-  i = 0;
+  int i = 0;
+  JointContainer::iterator joint_it;
   double position_limit_cost = 0.0;
   double velocity_limit_cost = 0.0;
-  Eigen::VectorXd position_cost_gradient = Eigen::VectorXd::Zero(joint_count_);
-  Eigen::VectorXd velocity_cost_gradient = Eigen::VectorXd::Zero(joint_count_);
-  Eigen::VectorXd combined_cost_gradient = Eigen::VectorXd::Zero(joint_count_);
+  Eigen::Matrix<double, DOF, 1> position_cost_gradient = Eigen::Matrix<double, DOF, 1>::Zero(joint_count_);
+  Eigen::Matrix<double, DOF, 1> velocity_cost_gradient = Eigen::Matrix<double, DOF, 1>::Zero(joint_count_);
+  Eigen::Matrix<double, DOF, 1> combined_cost_gradient = Eigen::Matrix<double, DOF, 1>::Zero(joint_count_);
   for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++i)
   {
     std::shared_ptr<Joint> joint = joint_it->second;
@@ -790,13 +1480,76 @@ Eigen::VectorXd Leg::solveIK(const Eigen::MatrixXd &delta, const bool &solve_rot
   combined_cost_gradient = interpolate(position_cost_gradient, velocity_cost_gradient, 0.75);
 
   // Calculate joint position change
-  identity = Eigen::MatrixXd::Identity(joint_count_, joint_count_);
-  return jacobian_inverse * delta + (identity - jacobian_inverse * j) * combined_cost_gradient;
+  Eigen::Matrix<double, DOF, DOF> joint_identity =
+      Eigen::Matrix<double, DOF, DOF>::Identity(joint_count_, joint_count_);
+  return jacobian_inverse * delta + (joint_identity - jacobian_inverse * j) * combined_cost_gradient;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool Leg::solveAnalyticIK(const Eigen::Vector3d &target_tip_position, Eigen::Vector3d *joint_position_delta)
+{
+  std::shared_ptr<Link> coxa_link = link_container_.at(1);
+  std::shared_ptr<Link> femur_link = link_container_.at(2);
+  std::shared_ptr<Link> tibia_link = link_container_.at(3);
+  std::shared_ptr<Joint> coxa_joint = joint_container_.at(1);
+  std::shared_ptr<Joint> femur_joint = joint_container_.at(2);
+  std::shared_ptr<Joint> tibia_joint = joint_container_.at(3);
+
+  // Femur/tibia chain lies in a plane offset from the coxa axis by the sum of femur and tibia 'd' DH parameters
+  double coxa_alpha_sign = sign(sin(coxa_link->dh_parameter_alpha_));
+  double lateral_offset = coxa_alpha_sign * (femur_link->dh_parameter_d_ + tibia_link->dh_parameter_d_);
+  double radial_distance_sqr = sqr(target_tip_position[0]) + sqr(target_tip_position[1]) - sqr(lateral_offset);
+  if (radial_distance_sqr < sqr(IK_TOLERANCE))
+  {
+    return false; // Tip on coxa axis - coxa position undefined (singularity)
+  }
+  double radial_distance = sqrt(radial_distance_sqr);
+
+  // Coxa joint rotates femur/tibia plane to contain tip position
+  double coxa_angle = atan2(target_tip_position[1], target_tip_position[0]) - atan2(-lateral_offset, radial_distance);
+
+  // Femur and tibia joints solve planar two link problem within femur/tibia plane
+  double femur_length = femur_link->dh_parameter_r_;
+  double tibia_length = tibia_link->dh_parameter_r_;
+  double planar_x = radial_distance - coxa_link->dh_parameter_r_;
+  double planar_y = coxa_alpha_sign * (target_tip_position[2] - coxa_link->dh_parameter_d_);
+  double cos_tibia_angle =
+      (sqr(planar_x) + sqr(planar_y) - sqr(femur_length) - sqr(tibia_length)) / (2.0 * femur_length * tibia_length);
+  if (abs(cos_tibia_angle) > 1.0)
+  {
+    return false; // Tip position unreachable
+  }
+
+  // Select knee configuration closest to current tibia joint position
+  double tibia_angle = acos(cos_tibia_angle);
+  double current_tibia_angle = tibia_link->dh_parameter_theta_ + tibia_joint->desired_position_;
+  if (abs(atan2(sin(-tibia_angle - current_tibia_angle), cos(-tibia_angle - current_tibia_angle))) <
+      abs(atan2(sin(tibia_angle - current_tibia_angle), cos(tibia_angle - current_tibia_angle))))
+  {
+    tibia_angle = -tibia_angle;
+  }
+  double femur_angle = atan2(planar_y, planar_x) - atan2(tibia_length * sin(tibia_angle),
+                                                         femur_length + tibia_length * cos(tibia_angle));
+
+  // Convert DH angles to joint positions and generate shortest angular change from current joint positions
+  Eigen::Vector3d joint_angles(coxa_angle - coxa_link->dh_parameter_theta_,
+                               femur_angle - femur_link->dh_parameter_theta_,
+                               tibia_angle - tibia_link->dh_parameter_theta_);
+  Eigen::Vector3d current_joint_angles(coxa_joint->desired_position_,
+                                       femur_joint->desired_position_,
+                                       tibia_joint->desired_position_);
+  for (int i = 0; i < 3; ++i)
+  {
+    double difference = joint_angles[i] - current_joint_angles[i];
+    (*joint_position_delta)[i] = atan2(sin(difference), cos(difference));
+  }
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-double Leg::updateJointPositions(const Eigen::VectorXd &delta, const bool &simulation)
+double Leg::updateJointPositions(const Eigen::Ref<const Eigen::VectorXd> &delta, const bool &simulation)
 {
   int index = 0;
   std::string clamping_events;
@@ -858,7 +1611,8 @@ double Leg::updateJointPositions(const Eigen::VectorXd &delta, const bool &simul
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-double Leg::applyIK(const bool &simulation)
+template <int DOF>
+double Leg::applyIKKernel(const bool &simulation)
 {
   // Generate position delta vector in reference to the base of the leg
   std::shared_ptr<Joint> base_joint = joint_container_.begin()->second;
@@ -867,17 +1621,26 @@ double Leg::applyIK(const bool &simulation)
   Eigen::Vector3d position_delta = leg_frame_desired_tip_pose.position_ - leg_frame_current_tip_pose.position_;
   ROS_ASSERT(position_delta.norm() < UNASSIGNED_VALUE);
 
-  Eigen::MatrixXd delta = Eigen::Matrix<double, 6, 1>::Zero();
+  Eigen::Matrix<double, 6, 1> delta = Eigen::Matrix<double, 6, 1>::Zero();
   delta(0) = position_delta[0];
   delta(1) = position_delta[1];
   delta(2) = position_delta[2];
 
-  // Calculate change in joint positions for change in tip position
-  Eigen::VectorXd joint_position_delta(joint_count_);
-  joint_position_delta = solveIK(delta, false);
+  // Calculate change in joint positions for change in tip position (directly via analytic solution if possible)
+  bool rotation_constrained = !desired_tip_pose_.rotation_.isApprox(UNDEFINED_ROTATION);
+  bool analytic_solution = false;
+  Eigen::Matrix<double, DOF, 1> joint_position_delta;
+  if constexpr (DOF == 3)
+  {
+    analytic_solution = analytic_ik_compatible_ && !rotation_constrained &&
+                        solveAnalyticIK(leg_frame_desired_tip_pose.position_, &joint_position_delta);
+  }
+  if (!analytic_solution)
+  {
+    joint_position_delta = solveIK<DOF>(delta, false);
+  }
 
   // Update change in joint positions for change in tip rotation to desired tip rotation if defined
-  bool rotation_constrained = !desired_tip_pose_.rotation_.isApprox(UNDEFINED_ROTATION);
   if (rotation_constrained)
   {
     // Update model
@@ -896,7 +1659,7 @@ double Leg::applyIK(const bool &simulation)
     delta(3) = rotation_delta[0];
     delta(4) = rotation_delta[1];
     delta(5) = rotation_delta[2];
-    joint_position_delta = solveIK(delta, true);
+    joint_position_delta = solveIK<DOF>(delta, true);
   }
 
   // Update Model
@@ -942,6 +1705,25 @@ double Leg::applyIK(const bool &simulation)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void Leg::updateTransformCache(void)
+{
+  // Accumulate transforms along kinematic chain from origin (index 0) through each joint to the tip (index N+1)
+  int index = 1;
+  JointContainer::iterator joint_it;
+  for (joint_it = joint_container_.begin(); joint_it != joint_container_.end(); ++joint_it, ++index)
+  {
+    std::shared_ptr<Joint> joint = joint_it->second;
+    base_transforms_[index] = base_transforms_[index - 1] * joint->current_transform_;
+    inverse_base_transforms_[index] = invertRigidTransform(base_transforms_[index]);
+  }
+  base_transforms_[index] = base_transforms_[index - 1] * tip_->current_transform_;
+  inverse_base_transforms_[index] = invertRigidTransform(base_transforms_[index]);
+  transform_cache_valid_ = true;
+  kinematic_state_.valid = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 Pose Leg::applyFK(const bool &set_current, const bool &use_actual)
 {
   // Update joint transforms - skip first joint since it's transform is constant
@@ -971,6 +1753,8 @@ Pose Leg::applyFK(const bool &set_current, const bool &use_actual)
                                             reference_link->dh_parameter_r_,
                                             reference_link->dh_parameter_alpha_);
 
+  updateTransformCache();
+
   // Get world frame position of tip
   Pose tip_pose = tip_->getPoseRobotFrame();
   if (set_current && !use_actual)
@@ -995,11 +1779,18 @@ Link::Link(std::shared_ptr<Leg> leg, std::shared_ptr<Joint> actuating_joint,
     , actuating_joint_(actuating_joint)
     , id_number_(id_number)
     , id_name_(leg->getIDName() + "_" + params.link_id.data[id_number_] + "_link")
-    , dh_parameter_r_(params.link_parameters[leg->getIDNumber()][id_number_].data.at("r"))
-    , dh_parameter_theta_(params.link_parameters[leg->getIDNumber()][id_number_].data.at("theta"))
-    , dh_parameter_d_(params.link_parameters[leg->getIDNumber()][id_number_].data.at("d"))
-    , dh_parameter_alpha_(params.link_parameters[leg->getIDNumber()][id_number_].data.at("alpha"))
+    , dh_parameter_r_(leg->getModelStorage()->dh_parameter_r_(leg->getIDNumber(), id_number_))
+    , dh_parameter_theta_(leg->getModelStorage()->dh_parameter_theta_(leg->getIDNumber(), id_number_))
+    , dh_parameter_d_(leg->getModelStorage()->dh_parameter_d_(leg->getIDNumber(), id_number_))
+    , dh_parameter_alpha_(leg->getModelStorage()->dh_parameter_alpha_(leg->getIDNumber(), id_number_))
 {
+  ModelStorage* storage = leg->getModelStorage();
+  std::map<std::string, double> link_parameters = params.link_parameters[leg->getIDNumber()][id_number_].data;
+  storage->dh_parameter_r_(leg->getIDNumber(), id_number_) = link_parameters.at("r");
+  storage->dh_parameter_theta_(leg->getIDNumber(), id_number_) = link_parameters.at("theta");
+  storage->dh_parameter_d_(leg->getIDNumber(), id_number_) = link_parameters.at("d");
+  storage->dh_parameter_alpha_(leg->getIDNumber(), id_number_) = link_parameters.at("alpha");
+
   if (!params.link_parameters[leg->getIDNumber()][id_number_].initialised)
   {
     ROS_FATAL("\nModel initialisation error for %s\n", id_name_.c_str());
@@ -1029,16 +1820,36 @@ Joint::Joint(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link,
     , reference_link_(reference_link)
     , id_number_(id_number)
     , id_name_(leg->getIDName() + "_" + params.joint_id.data[id_number_ - 1] + "_joint")
-    , min_position_(params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data.at("min"))
-    , max_position_(params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data.at("max"))
+    , current_transform_(leg->getModelStorage()->current_transforms_[
+        leg->getModelStorage()->getTransformIndex(leg->getIDNumber(), id_number_)])
+    , min_position_(leg->getModelStorage()->min_position_(leg->getIDNumber(), id_number_))
+    , max_position_(leg->getModelStorage()->max_position_(leg->getIDNumber(), id_number_))
     , offset_(params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data.at("offset"))
     , unpacked_position_(params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data.at("unpacked"))
-    , max_angular_speed_(params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data.at("max_vel"))
+    , max_angular_speed_(leg->getModelStorage()->max_angular_speed_(leg->getIDNumber(), id_number_))
+    , desired_position_(leg->getModelStorage()->desired_position_(leg->getIDNumber(), id_number_))
+    , desired_velocity_(leg->getModelStorage()->desired_velocity_(leg->getIDNumber(), id_number_))
+    , desired_effort_(leg->getModelStorage()->desired_effort_(leg->getIDNumber(), id_number_))
+    , prev_desired_position_(leg->getModelStorage()->prev_desired_position_(leg->getIDNumber(), id_number_))
+    , prev_desired_velocity_(leg->getModelStorage()->prev_desired_velocity_(leg->getIDNumber(), id_number_))
+    , prev_desired_effort_(leg->getModelStorage()->prev_desired_effort_(leg->getIDNumber(), id_number_))
+    , current_position_(leg->getModelStorage()->current_position_(leg->getIDNumber(), id_number_))
+    , current_velocity_(leg->getModelStorage()->current_velocity_(leg->getIDNumber(), id_number_))
+    , current_effort_(leg->getModelStorage()->current_effort_(leg->getIDNumber(), id_number_))
+    , default_position_(leg->getModelStorage()->default_position_(leg->getIDNumber(), id_number_))
+    , default_velocity_(leg->getModelStorage()->default_velocity_(leg->getIDNumber(), id_number_))
+    , default_effort_(leg->getModelStorage()->default_effort_(leg->getIDNumber(), id_number_))
 {
+  // Populate joint limits in model storage
+  ModelStorage* storage = leg->getModelStorage();
+  std::map<std::string, double> joint_parameters = params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data;
+  storage->min_position_(leg->getIDNumber(), id_number_) = joint_parameters.at("min");
+  storage->max_position_(leg->getIDNumber(), id_number_) = joint_parameters.at("max");
+  storage->max_angular_speed_(leg->getIDNumber(), id_number_) = joint_parameters.at("max_vel");
+
   default_position_ = clamped(0.0, min_position_, max_position_);
 
   // Populate packed configuration/s joint position/s
-  std::map<std::string, double> joint_parameters = params.joint_parameters[leg->getIDNumber()][id_number_ - 1].data;
   bool get_next_packed_position = true;
   std::string packed_position_key = "packed";
   int i = 0;
@@ -1074,50 +1885,38 @@ Joint::Joint(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link,
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Joint::Joint(std::shared_ptr<Joint> joint)
-    : parent_leg_(joint->parent_leg_)
-    , reference_link_(joint->reference_link_)
-    , id_number_(joint->id_number_)
-    , id_name_(joint->id_name_)
-    , min_position_(joint->min_position_)
-    , max_position_(joint->max_position_)
-    , offset_(joint->offset_)
-    , packed_positions_(joint->packed_positions_)
-    , unpacked_position_(joint->unpacked_position_)
-    , max_angular_speed_(joint->max_angular_speed_)
-{
-  current_transform_ = joint->current_transform_;
-  identity_transform_ = joint->identity_transform_;
-
-  desired_position_publisher_ = joint->desired_position_publisher_;
-
-  desired_position_ = joint->desired_position_;
-  desired_velocity_ = joint->desired_velocity_;
-  desired_effort_ = joint->desired_effort_;
-  prev_desired_position_ = joint->prev_desired_position_;
-  prev_desired_velocity_ = joint->prev_desired_velocity_;
-  prev_desired_effort_ = joint->prev_desired_effort_;
-
-  current_position_ = joint->current_position_;
-  current_velocity_ = joint->current_velocity_;
-  current_effort_ = joint->current_effort_;
-
-  default_position_ = joint->default_position_;
-  default_velocity_ = joint->default_velocity_;
-  default_effort_ = joint->default_effort_;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-Joint::Joint(void)
-    : parent_leg_(NULL), reference_link_(NULL), id_number_(0), id_name_("origin")
+Joint::Joint(ModelStorage* storage, const int &leg_id_number)
+    : parent_leg_(NULL)
+    , reference_link_(NULL)
+    , id_number_(0)
+    , id_name_("origin")
+    , current_transform_(storage->current_transforms_[storage->getTransformIndex(leg_id_number, 0)])
+    , min_position_(storage->min_position_(leg_id_number, 0))
+    , max_position_(storage->max_position_(leg_id_number, 0))
+    , max_angular_speed_(storage->max_angular_speed_(leg_id_number, 0))
+    , desired_position_(storage->desired_position_(leg_id_number, 0))
+    , desired_velocity_(storage->desired_velocity_(leg_id_number, 0))
+    , desired_effort_(storage->desired_effort_(leg_id_number, 0))
+    , prev_desired_position_(storage->prev_desired_position_(leg_id_number, 0))
+    , prev_desired_velocity_(storage->prev_desired_velocity_(leg_id_number, 0))
+    , prev_desired_effort_(storage->prev_desired_effort_(leg_id_number, 0))
+    , current_position_(storage->current_position_(leg_id_number, 0))
+    , current_velocity_(storage->current_velocity_(leg_id_number, 0))
+    , current_effort_(storage->current_effort_(leg_id_number, 0))
+    , default_position_(storage->default_position_(leg_id_number, 0))
+    , default_velocity_(storage->default_velocity_(leg_id_number, 0))
+    , default_effort_(storage->default_effort_(leg_id_number, 0))
 {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 Tip::Tip(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link)
-    : parent_leg_(leg), reference_link_(reference_link), id_name_(leg->getIDName() + "_tip")
+    : parent_leg_(leg)
+    , reference_link_(reference_link)
+    , id_name_(leg->getIDName() + "_tip")
+    , current_transform_(leg->getModelStorage()->current_transforms_[
+        leg->getModelStorage()->getTransformIndex(leg->getIDNumber(), leg->getJointCount() + 1)])
 {
   identity_transform_ = createDHMatrix(reference_link_->dh_parameter_d_,
                                        reference_link_->dh_parameter_theta_,
@@ -1127,12 +1926,3 @@ Tip::Tip(std::shared_ptr<Leg> leg, std::shared_ptr<Link> reference_link)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-Tip::Tip(std::shared_ptr<Tip> tip)
-    : parent_leg_(tip->parent_leg_), reference_link_(tip->reference_link_), id_name_(tip->id_name_)
-{
-  identity_transform_ = tip->identity_transform_;
-  current_transform_ = tip->current_transform_;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,8 @@
 #include "syropod_highlevel_controller/pose_controller.h"
 #include "syropod_highlevel_controller/walk_controller.h"
 
+#include <fstream>
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 PoseController::PoseController(std::shared_ptr<Model> model, const Parameters& params)
@@ -43,24 +45,19 @@ void PoseController::init(void)
 
 void PoseController::setAutoPoseParams(void)
 {
-  double raw_phase_length;
-  int base_phase_length;
   pose_frequency_ = params_.pose_frequency.data;
 
-  // Calculate posing phase length and normalisation values based off gait/posing cycle parameters
+  // Calculate posing phase length and delta based off gait/posing cycle parameters
+  // (If synced with step cycle, phase delta is taken from the step cycle each iteration)
   if (pose_frequency_ == -1.0) // Use step cycle parameters
   {
-    base_phase_length = params_.stance_phase.data + params_.swing_phase.data;
-    double swing_ratio = double(params_.swing_phase.data) / base_phase_length;
-    raw_phase_length = ((1.0 / params_.step_frequency.current_value) / params_.time_delta.data) / swing_ratio;
+    pose_phase_length_ = params_.stance_phase.data + params_.swing_phase.data;
   }
   else
   {
-    base_phase_length = params_.pose_phase_length.data;
-    raw_phase_length = ((1.0 / pose_frequency_) / params_.time_delta.data);
+    pose_phase_length_ = params_.pose_phase_length.data;
+    pose_phase_delta_ = pose_phase_length_ * pose_frequency_ * params_.time_delta.data;
   }
-  pose_phase_length_ = roundToEvenInt(raw_phase_length / base_phase_length) * base_phase_length;
-  normaliser_ = pose_phase_length_ / base_phase_length;
 
   // Set posing negation phase variables according to auto posing parameters
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
@@ -159,6 +156,23 @@ int PoseController::executeSequence(const SequenceSelection& sequence)
       leg_poser->resetTransitionSequence();
       leg_poser->addTransitionPose(leg->getCurrentTipPose()); // Initial transition position
     }
+
+    // Replay transition sequence from cache if previously discovered with identical parameters (bypassed in debug)
+    sequence_cache_file_name_.clear();
+    std::string cache_directory = getCacheDirectory(SEQUENCE_CACHE_DIRECTORY);
+    if (!debug && !cache_directory.empty())
+    {
+      sequence_hash_ = generateSequenceHash();
+      std::stringstream ss;
+      ss << cache_directory << "/sequence_" << std::hex << sequence_hash_ << ".bin";
+      sequence_cache_file_name_ = ss.str();
+      if (loadTransitionSequence(sequence_cache_file_name_, sequence_hash_))
+      {
+        ROS_INFO("\n[SHC] Transition sequence loaded from cache (%s).\n", sequence_cache_file_name_.c_str());
+        first_sequence_execution_ = false;
+        sequence_cache_file_name_.clear();
+      }
+    }
   }
 
   int progress = 0; // Percentage progress (0%->100%)
@@ -444,6 +458,11 @@ int PoseController::executeSequence(const SequenceSelection& sequence)
   // Check if sequence has completed
   if (sequence_complete)
   {
+    if (first_sequence_execution_ && sequence == START_UP && !sequence_cache_file_name_.empty())
+    {
+      saveTransitionSequence(sequence_cache_file_name_, sequence_hash_);
+      sequence_cache_file_name_.clear();
+    }
     set_target_ = true;
     vertical_transition_complete_ = false;
     horizontal_transition_complete_ = false;
@@ -460,56 +479,202 @@ int PoseController::executeSequence(const SequenceSelection& sequence)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int PoseController::directStartup(void) // Simultaneous leg coordination
+uint64_t PoseController::generateSequenceHash(void)
 {
-  int progress = 0; // Percentage progress (0%->100%)
-  double time_to_start = params_.time_to_start.data;
+  uint64_t hash = hashValue(SEQUENCE_CACHE_VERSION);
+  hash = hashValue(SAFETY_FACTOR, hash);
+  hash = hashValue(HORIZONTAL_TRANSITION_TIME, hash);
+  hash = hashValue(VERTICAL_TRANSITION_TIME, hash);
+  hash = hashValue(params_.time_delta.data, hash);
+  hash = hashValue(params_.swing_height.current_value, hash);
+  hash = hashValue(params_.step_frequency.current_value, hash);
+  hash = hashValue(params_.clamp_joint_positions.data, hash);
+  hash = hashValue(params_.use_analytic_IK.data, hash);
+  hash = hashValue(model_->getLegCount(), hash);
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    int leg_id = leg->getIDNumber();
+    hash = hashValue(leg->getIDName(), hash);
+    hash = hashValue(leg->getGroup(), hash);
+    hash = hashValue(leg->getJointCount(), hash);
+    hash = hashValue(params_.link_parameters[leg_id][0].data, hash);
+    for (int i = 1; i < leg->getJointCount() + 1; ++i)
+    {
+      hash = hashValue(params_.link_parameters[leg_id][i].data, hash);
+      hash = hashValue(params_.joint_parameters[leg_id][i - 1].data, hash);
+    }
+
+    // Sequence targets default tip positions (as generated by walk controller from stance parameters)
+    Eigen::Vector3d default_tip_position = leg->getLegStepper()->getDefaultTipPose().position_;
+    default_tip_position = model_->getCurrentPose().inverseTransformVector(default_tip_position);
+    default_tip_position = setPrecision(default_tip_position, SEQUENCE_CACHE_PRECISION);
+    hash = hashBytes(default_tip_position.data(), 3 * sizeof(double), hash);
+  }
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PoseController::loadTransitionSequence(const std::string &file_name, const uint64_t &hash)
+{
+  std::ifstream file(file_name.c_str(), std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  auto read = [&](void *value, const size_t &size)
+  {
+    return bool(file.read(static_cast<char *>(value), size));
+  };
+
+  // Validate header
+  uint32_t version;
+  uint64_t file_hash;
+  int32_t leg_count;
+  int32_t transition_step_count;
+  bool valid = (read(&version, sizeof(version)) && version == SEQUENCE_CACHE_VERSION &&
+                read(&file_hash, sizeof(file_hash)) && file_hash == hash &&
+                read(&leg_count, sizeof(leg_count)) && leg_count == model_->getLegCount() &&
+                read(&transition_step_count, sizeof(transition_step_count)) &&
+                transition_step_count > 0 && transition_step_count <= TRANSITION_STEP_THRESHOLD);
+
+  // Read transition poses of each leg, the first of which is the initial tip pose the sequence was discovered from
+  std::map<int, std::vector<Pose, Eigen::aligned_allocator<Pose>>> transition_poses;
+  for (int i = 0; valid && i < leg_count; ++i)
+  {
+    int32_t leg_id;
+    valid = (read(&leg_id, sizeof(leg_id)) &&
+             model_->getLegContainer()->find(leg_id) != model_->getLegContainer()->end());
+    for (int j = 0; valid && j < transition_step_count + 1; ++j)
+    {
+      Pose transition_pose;
+      valid = (read(transition_pose.position_.data(), 3 * sizeof(double)) &&
+               read(transition_pose.rotation_.coeffs().data(), 4 * sizeof(double)));
+      transition_poses[leg_id].push_back(transition_pose);
+    }
+
+    // Cached sequence is only valid if discovered from the current initial tip pose
+    if (valid)
+    {
+      Pose current_tip_pose = model_->getLegByIDNumber(leg_id)->getCurrentTipPose();
+      Eigen::Vector3d initial_position_delta = current_tip_pose.position_ - transition_poses[leg_id][0].position_;
+      valid = initial_position_delta.norm() < TIP_TOLERANCE;
+    }
+  }
+  valid = valid && file.peek() == EOF && int(transition_poses.size()) == model_->getLegCount();
+
+  if (!valid)
+  {
+    ROS_WARN("\n[SHC] Transition sequence cache file (%s) is invalid and will be regenerated.\n", file_name.c_str());
+    return false;
+  }
 
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
     std::shared_ptr<Leg> leg = leg_it_->second;
     std::shared_ptr<LegPoser> leg_poser = leg->getLegPoser();
-    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    std::vector<Pose, Eigen::aligned_allocator<Pose>> &leg_transition_poses = transition_poses[leg->getIDNumber()];
+    for (int j = 1; j < transition_step_count + 1; ++j)
+    {
+      leg_poser->addTransitionPose(leg_transition_poses[j]);
+    }
+  }
+  transition_step_count_ = transition_step_count;
+  return true;
+}
 
-    // Run model in simulation to find joint positions for default stance
-    if (!executing_transition_)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PoseController::saveTransitionSequence(const std::string &file_name, const uint64_t &hash)
+{
+  // Only save complete sequences (i.e. each leg has a transition pose for every transition step)
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    if (leg->getLegPoser()->getTransitionPoseCount() != transition_step_count_ + 1)
     {
-      // Create copy of leg at initial state
-      std::shared_ptr<Leg> test_leg = std::allocate_shared<Leg>(Eigen::aligned_allocator<Leg>(), leg);
-      test_leg->generate(leg);
-      test_leg->init(true);
-
-      // Move tip linearly to default stance position
-      Pose default_tip_pose = leg_stepper->getDefaultTipPose();
-      while (progress != PROGRESS_COMPLETE)
-      {
-        std::shared_ptr<LegPoser> test_leg_poser = test_leg->getLegPoser();
-        progress = test_leg_poser->stepToPosition(default_tip_pose, model_->getCurrentPose(), 0.0, time_to_start);
-        test_leg->setDesiredTipPose(test_leg_poser->getCurrentTipPose(), true);
-        test_leg->applyIK(true);
-      }
+      return;
+    }
+  }
 
-      // Create empty configuration
-      sensor_msgs::JointState default_configuration;
-      default_configuration.name.assign(test_leg->getJointCount(), "");
-      default_configuration.position.assign(test_leg->getJointCount(), UNASSIGNED_VALUE);
+  std::string temporary_file_name = file_name + ".tmp";
+  std::ofstream file(temporary_file_name.c_str(), std::ios::binary | std::ios::trunc);
+  auto write = [&](const void *value, const size_t &size)
+  {
+    file.write(static_cast<const char *>(value), size);
+  };
 
-      // Populate configuration with default values
-      JointContainer::iterator joint_it;
-      for (joint_it = test_leg->getJointContainer()->begin();
-           joint_it != test_leg->getJointContainer()->end();
-           ++joint_it)
-      {
-        std::shared_ptr<Joint> joint = joint_it->second;
-        int joint_index = joint->id_number_ - 1;
-        default_configuration.name[joint_index] = joint->id_name_;
-        default_configuration.position[joint_index] = joint->desired_position_;
-      }
-      leg_poser->setDesiredConfiguration(default_configuration);
+  // Write header
+  uint32_t version = SEQUENCE_CACHE_VERSION;
+  int32_t leg_count = model_->getLegCount();
+  int32_t transition_step_count = transition_step_count_;
+  write(&version, sizeof(version));
+  write(&hash, sizeof(hash));
+  write(&leg_count, sizeof(leg_count));
+  write(&transition_step_count, sizeof(transition_step_count));
+
+  // Write transition poses of each leg
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    std::shared_ptr<LegPoser> leg_poser = leg->getLegPoser();
+    int32_t leg_id = leg->getIDNumber();
+    write(&leg_id, sizeof(leg_id));
+    for (int j = 0; j < transition_step_count + 1; ++j)
+    {
+      Pose transition_pose = leg_poser->getTransitionPose(j);
+      write(transition_pose.position_.data(), 3 * sizeof(double));
+      write(transition_pose.rotation_.coeffs().data(), 4 * sizeof(double));
     }
+  }
+  file.close();
 
-    // Transition to Default configuration
-    progress = leg_poser->transitionConfiguration(time_to_start);
+  // Replace existing cache file only once new file is completely written
+  if (!file || std::rename(temporary_file_name.c_str(), file_name.c_str()) != 0)
+  {
+    ROS_WARN("\n[SHC] Unable to write transition sequence cache file (%s).\n", file_name.c_str());
+    std::remove(temporary_file_name.c_str());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int PoseController::directStartup(void) // Simultaneous leg coordination
+{
+  int progress = 0; // Percentage progress (0%->100%)
+  double time_to_start = params_.time_to_start.data;
+
+  // Find joint positions for default stance by running model in simulation on a background thread
+  if (!executing_transition_)
+  {
+    // Create copy of model at initial state and hand it to planner (holding current pose until planning completes)
+    if (!default_configuration_plan_.valid())
+    {
+      std::shared_ptr<Model> plan_model = std::allocate_shared<Model>(Eigen::aligned_allocator<Model>(), model_);
+      plan_model->generate(model_);
+      plan_model->initLegs(true);
+      default_configuration_plan_ = std::async(std::launch::async, &PoseController::planDefaultConfigurations,
+                                               plan_model, model_->getCurrentPose(), time_to_start);
+    }
+    if (default_configuration_plan_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      return progress;
+    }
+
+    ConfigurationMap default_configurations = default_configuration_plan_.get();
+    for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+    {
+      std::shared_ptr<Leg> leg = leg_it_->second;
+      leg->getLegPoser()->setDesiredConfiguration(default_configurations.at(leg->getIDNumber()));
+    }
+  }
+
+  // Transition to Default configuration
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    progress = leg->getLegPoser()->transitionConfiguration(time_to_start);
   }
   
   executing_transition_ = (progress != 0 && progress != PROGRESS_COMPLETE);
@@ -518,6 +683,49 @@ int PoseController::directStartup(void) // Simultaneous leg coordination
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+ConfigurationMap PoseController::planDefaultConfigurations(std::shared_ptr<Model> plan_model, const Pose target_pose,
+                                                           const double time_to_start)
+{
+  ConfigurationMap default_configurations;
+  LegContainer::iterator leg_it;
+  for (leg_it = plan_model->getLegContainer()->begin(); leg_it != plan_model->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> test_leg = leg_it->second;
+    std::shared_ptr<LegPoser> test_leg_poser = test_leg->getLegPoser();
+
+    // Move tip linearly to default stance position
+    int progress = 0;
+    Pose default_tip_pose = test_leg->getLegStepper()->getDefaultTipPose();
+    while (progress != PROGRESS_COMPLETE)
+    {
+      progress = test_leg_poser->stepToPosition(default_tip_pose, target_pose, 0.0, time_to_start);
+      test_leg->setDesiredTipPose(test_leg_poser->getCurrentTipPose(), true);
+      test_leg->applyIK(true);
+    }
+
+    // Create empty configuration
+    sensor_msgs::JointState default_configuration;
+    default_configuration.name.assign(test_leg->getJointCount(), "");
+    default_configuration.position.assign(test_leg->getJointCount(), UNASSIGNED_VALUE);
+
+    // Populate configuration with default values
+    JointContainer::iterator joint_it;
+    for (joint_it = test_leg->getJointContainer()->begin();
+         joint_it != test_leg->getJointContainer()->end();
+         ++joint_it)
+    {
+      std::shared_ptr<Joint> joint = joint_it->second;
+      int joint_index = joint->id_number_ - 1;
+      default_configuration.name[joint_index] = joint->id_name_;
+      default_configuration.position[joint_index] = joint->desired_position_;
+    }
+    default_configurations[test_leg->getIDNumber()] = default_configuration;
+  }
+  return default_configurations;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 int PoseController::stepToNewStance(void) // Tripod leg coordination
 {
   int progress = 0; // Percentage progress (0%->100%)
@@ -1148,16 +1356,17 @@ void PoseController::updateAutoPose(void)
   }
 
   // Update master phase
-  int master_phase;
+  double master_phase;
   bool sync_with_step_cycle = (pose_frequency_ == -1.0);
   if (sync_with_step_cycle)
   {
     master_phase = leg_stepper->getPhase(); // Correction for calculating auto pose before iterating walk phase
+    pose_phase_delta_ = leg_stepper->getPhaseDelta();
   }
   else
   {
     master_phase = pose_phase_;
-    pose_phase_ = (pose_phase_ + 1) % pose_phase_length_; // Iterate pose phase
+    pose_phase_ = mod(pose_phase_ + pose_phase_delta_, double(pose_phase_length_)); // Iterate pose phase
   }
 
   // Update auto pose from auto posers
@@ -1335,11 +1544,12 @@ AutoPoser::AutoPoser(std::shared_ptr<PoseController> poser, const int& id)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Pose AutoPoser::updatePose(int phase)
+Pose AutoPoser::updatePose(double phase)
 {
   Pose return_pose = Pose::Identity();
-  int start_phase = start_phase_ * poser_->getNormaliser();
-  int end_phase = end_phase_ * poser_->getNormaliser();
+  double start_phase = start_phase_;
+  double end_phase = end_phase_;
+  double phase_delta = poser_->getPhaseDelta();
 
   // Handles phase overlapping master phase start/end
   if (start_phase > end_phase)
@@ -1356,9 +1566,12 @@ Pose AutoPoser::updatePose(int phase)
 
   // Coordinates starting/stopping of posing period
   // (posing only ends once a FULL posing cycle completes whilst in STOP_POSING state)
-  start_check_ = !sync_with_step_cycle || (!start_check_ && state == POSING && phase == start_phase);
-  end_check_.first = (end_check_.first || (state == STOP_POSING && phase == start_phase));
-  end_check_.second = (end_check_.second || (state == STOP_POSING && phase == end_phase && end_check_.first));
+  // Start/end phases are reached on the iteration in which the phase lies within one phase delta of them
+  bool at_start_phase = (phase >= start_phase && phase < start_phase + phase_delta);
+  bool at_end_phase = (phase >= end_phase && phase < end_phase + phase_delta);
+  start_check_ = !sync_with_step_cycle || (!start_check_ && state == POSING && at_start_phase);
+  end_check_.first = (end_check_.first || (state == STOP_POSING && at_start_phase));
+  end_check_.second = (end_check_.second || (state == STOP_POSING && at_end_phase && end_check_.first));
   if (!allow_posing_ && start_check_) // Start posing
   {
     allow_posing_ = true;
@@ -1373,14 +1586,14 @@ Pose AutoPoser::updatePose(int phase)
   // Pose if in correct phase
   if (phase >= start_phase && phase < end_phase && allow_posing_)
   {
-    int iteration = phase - start_phase + 1;
-    int num_iterations = end_phase - start_phase;
+    // Progress along posing cycle at end of this iteration
+    double progress = std::min(1.0, (phase - start_phase + phase_delta) / (end_phase - start_phase));
 
     Eigen::Vector3d zero(0.0, 0.0, 0.0);
     Eigen::Vector3d position_control_nodes[5] = {zero, zero, zero, zero, zero};
     Eigen::Vector3d rotation_control_nodes[5] = {zero, zero, zero, zero, zero};
 
-    bool first_half = iteration <= num_iterations / 2; // Flag for 1st vs 2nd half of posing cycle
+    bool first_half = progress <= 0.5; // Flag for 1st vs 2nd half of posing cycle
     Eigen::Vector3d gravity_direction = poser_->estimateGravity().normalized();
 
     if (first_half)
@@ -1414,9 +1627,7 @@ Pose AutoPoser::updatePose(int phase)
       }
     }
 
-    double delta_t = 1.0 / (num_iterations / 2.0);
-    int offset = static_cast<int>((first_half ? 0 : num_iterations / 2.0)); // Offsets iterations for 2nd half of cycle
-    double time_input = (iteration - offset) * delta_t;
+    double time_input = (first_half ? progress : progress - 0.5) * 2.0; // Offsets progress for 2nd half of cycle
 
     Eigen::Vector3d position = quarticBezier(position_control_nodes, time_input);
     Eigen::Vector3d rotation = quarticBezier(rotation_control_nodes, time_input);
@@ -1424,12 +1635,12 @@ Pose AutoPoser::updatePose(int phase)
     return_pose = Pose(position, eulerAnglesToQuaternion(rotation));
 
     ROS_DEBUG_COND(false,
-                   "AUTOPOSE_DEBUG %d - ITERATION: %d\t\t"
+                   "AUTOPOSE_DEBUG %d - PHASE: %f\t\t"
                    "TIME: %f\t\t"
                    "ORIGIN: %f:%f:%f\t\t"
                    "POS: %f:%f:%f\t\t"
                    "TARGET: %f:%f:%f\n",
-                   id_number_, iteration, setPrecision(time_input, 3),
+                   id_number_, setPrecision(phase, 3), setPrecision(time_input, 3),
                    position_control_nodes[0][0], position_control_nodes[0][1], position_control_nodes[0][2],
                    position[0], position[1], position[2],
                    position_control_nodes[4][0], position_control_nodes[4][1], position_control_nodes[4][2]);
@@ -1713,11 +1924,12 @@ int LegPoser::stepToPosition(const Pose& target_tip_pose, const Pose& target_pos
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void LegPoser::updateAutoPose(const int& phase)
+void LegPoser::updateAutoPose(const double& phase)
 {
-  int start_phase = pose_negation_phase_start_ * poser_->getNormaliser();
-  int end_phase = pose_negation_phase_end_ * poser_->getNormaliser();
-  int negation_phase = phase;
+  double start_phase = pose_negation_phase_start_;
+  double end_phase = pose_negation_phase_end_;
+  double negation_phase = phase;
+  double phase_delta = poser_->getPhaseDelta();
 
   // Changes start/end phases from zero to phase length value (which is equivalent)
   if (start_phase == 0)
@@ -1741,7 +1953,8 @@ void LegPoser::updateAutoPose(const int& phase)
   
   // Switch on/off auto pose negation
   StepState step_state = leg_->getLegStepper()->getStepState();
-  if (step_state != FORCE_STANCE && step_state != FORCE_STOP && negation_phase == start_phase)
+  bool at_start_phase = (negation_phase >= start_phase && negation_phase < start_phase + phase_delta);
+  if (step_state != FORCE_STANCE && step_state != FORCE_STOP && at_start_phase)
   {
     negate_auto_pose_ = true;
   }
@@ -1756,19 +1969,18 @@ void LegPoser::updateAutoPose(const int& phase)
   // Negate auto pose for this leg during negation peroid as defined by parameters
   if (negate_auto_pose_)
   {
-    int iteration = negation_phase - start_phase + 1;
-    int num_iterations = end_phase - start_phase;
-    bool first_half = iteration <= num_iterations / 2;
+    double progress = std::min(1.0, (negation_phase - start_phase + phase_delta) / (end_phase - start_phase));
+    bool first_half = progress <= 0.5;
     double control_input = 1.0;
     if (negation_transition_ratio_ > 0.0)
     {
       if (first_half)
       {
-        control_input = std::min(1.0, iteration / (num_iterations * negation_transition_ratio_));
+        control_input = std::min(1.0, progress / negation_transition_ratio_);
       }
       else
       {
-        control_input = std::min(1.0, (num_iterations - iteration) / (num_iterations * negation_transition_ratio_));
+        control_input = std::min(1.0, (1.0 - progress) / negation_transition_ratio_);
       }
     }
     control_input = smoothStep(control_input);
@@ -88,6 +88,7 @@ StateController::StateController(void)
   velocity_publisher_ = n.advertise<geometry_msgs::Twist>("shc/velocity", 1000);
   pose_publisher_ = n.advertise<geometry_msgs::Twist>("shc/pose", 1000);
   walkspace_publisher_ = n.advertise<std_msgs::Float32MultiArray>("shc/walkspace", 1000);
+  odometry_publisher_ = n.advertise<nav_msgs::Odometry>("shc/odometry", 1000);
   rotation_pose_error_publisher_ = n.advertise<std_msgs::Float32MultiArray>("shc/rotation_pose_error", 1000);
 
   // Set up combined desired joint state publisher
@@ -151,6 +152,11 @@ void StateController::init(void)
   poser_->init();
   admittance_ =
     std::allocate_shared<AdmittanceController>(Eigen::aligned_allocator<AdmittanceController>(), model_, params_);
+  if (params_.compliance_loop_rate.data > 0.0)
+  {
+    compliance_loop_ = std::allocate_shared<ComplianceLoop>(Eigen::aligned_allocator<ComplianceLoop>(),
+                                                           model_, params_, desired_joint_state_publisher_);
+  }
 
   robot_state_ = UNKNOWN;
 
@@ -176,7 +182,19 @@ void StateController::loop(void)
       {
         admittance_->updateStiffness(walker_);
       }
-      admittance_->updateAdmittance();
+      if (compliance_loop_ == NULL)
+      {
+        admittance_->updateAdmittance();
+      }
+      // Apply latest admittance tip position offsets from compliance loop (updated at higher rate)
+      else if (compliance_loop_->getOutput(&compliance_output_))
+      {
+        for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+        {
+          std::shared_ptr<Leg> leg = leg_it_->second;
+          leg->setAdmittanceDelta(compliance_output_.admittance_delta_[leg->getIDNumber()]);
+        }
+      }
     }
   }
 
@@ -190,6 +208,17 @@ void StateController::loop(void)
   {
     runningState();
   }
+
+  // Odometry estimation - actual tip poses are generated once per iteration and reused when publishing leg state
+  PoseArray* actual_tip_poses = model_->applyActualFK();
+  if (robot_state_ == RUNNING)
+  {
+    walker_->updateOdometry(*actual_tip_poses);
+  }
+  else
+  {
+    walker_->resetOdometryFootprint();
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -457,15 +486,12 @@ void StateController::adjustParameter(void)
   {
     // Calculate new speed/acceleration limits due to changing parameter
     StepCycle new_step_cycle = walker_->generateStepCycle(false);
-    LimitMap max_linear_speed_map;
-    LimitMap max_angular_speed_map;
-    walker_->generateLimits(new_step_cycle, &max_linear_speed_map, &max_angular_speed_map);
-    walker_->setLinearSpeedLimitMap(max_linear_speed_map);
-    walker_->setAngularSpeedLimitMap(max_angular_speed_map);
-    double max_linear_speed =
-      walker_->getLimit(linear_velocity_input_, angular_velocity_input_, max_linear_speed_map);
-    double max_angular_speed =
-      walker_->getLimit(linear_velocity_input_, angular_velocity_input_, max_angular_speed_map);
+    LimitTable limit_table;
+    walker_->generateLimits(new_step_cycle, &limit_table);
+    walker_->setSpeedLimits(limit_table);
+    WalkLimits limits = walker_->getLimits(linear_velocity_input_, angular_velocity_input_, limit_table);
+    double max_linear_speed = limits[MAX_LINEAR_SPEED];
+    double max_angular_speed = limits[MAX_ANGULAR_SPEED];
 
     // Generate target velocities to achieve before changing step frequency
     Eigen::Vector2d target_linear_velocity;
@@ -515,8 +541,7 @@ void StateController::changeGait(void)
   if (walker_->getWalkState() == STOPPED)
   {
     initGaitParameters(gait_selection_);
-    walker_->generateStepCycle();
-    walker_->generateLimits();
+    walker_->endGaitTransition();
 
     // For auto compensation find associated auto posing parameters for new gait
     if (params_.auto_posing.data && params_.auto_pose_type.data == "auto")
@@ -525,9 +550,38 @@ void StateController::changeGait(void)
       poser_->setAutoPoseParams();
     }
 
+    transition_gait_ = GAIT_UNDESIGNATED;
     gait_change_flag_ = false;
     ROS_INFO("\nNow using %s mode.\n", params_.gait_type.data.c_str());
   }
+  // Wait for gait transition in progress to complete
+  else if (walker_->isTransitioningGait())
+  {
+    return;
+  }
+  // Gait transition complete (begin another transition if gait selection has changed during transition)
+  else if (transition_gait_ != GAIT_UNDESIGNATED)
+  {
+    gait_change_flag_ = (gait_selection_ != transition_gait_);
+    transition_gait_ = GAIT_UNDESIGNATED;
+    ROS_INFO("\nNow using %s mode.\n", params_.gait_type.data.c_str());
+  }
+  // Transition between gaits whilst walking
+  else if (walker_->getWalkState() == MOVING && params_.gait_transition_cycles.data > 0.0)
+  {
+    initGaitParameters(gait_selection_);
+    walker_->startGaitTransition();
+
+    // For auto compensation find associated auto posing parameters for new gait
+    if (params_.auto_posing.data && params_.auto_pose_type.data == "auto")
+    {
+      initAutoPoseParameters();
+      poser_->setAutoPoseParams();
+    }
+
+    transition_gait_ = gait_selection_;
+    ROS_INFO("\nTransitioning to %s mode whilst walking . . .\n", params_.gait_type.data.c_str());
+  }
   // Force Syropod to stop walking
   else
   {
@@ -776,6 +830,17 @@ void StateController::generateExternalTargetTransforms(void)
 
 void StateController::publishDesiredJointState(void)
 {
+  // Desired joint states are published by compliance loop (at higher rate) whilst active
+  if (compliance_loop_ != NULL)
+  {
+    generateComplianceInput();
+    compliance_loop_->setInput(compliance_input_);
+    if (compliance_input_.active_)
+    {
+      return;
+    }
+  }
+
   sensor_msgs::JointState joint_state_msg;
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
@@ -806,8 +871,56 @@ void StateController::publishDesiredJointState(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void StateController::generateComplianceInput(void)
+{
+  compliance_input_.active_ = params_.admittance_control.data && robot_state_ != UNKNOWN;
+  compliance_input_.use_joint_effort_ = params_.use_joint_effort.data;
+  compliance_input_.clamp_joint_positions_ = params_.clamp_joint_positions.data;
+  compliance_input_.time_delta_ = params_.time_delta.data;
+  compliance_input_.integrator_step_time_ = params_.integrator_step_time.data;
+  compliance_input_.mass_ = params_.virtual_mass.current_value;
+  compliance_input_.damping_ratio_ = params_.virtual_damping_ratio.current_value;
+  compliance_input_.force_gain_ = params_.force_gain.current_value;
+
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    ComplianceLegInput &input = compliance_input_.legs_[leg->getIDNumber()];
+    int joint_count = leg->getJointCount();
+    input.joint_count_ = joint_count;
+    input.apply_delta_ = leg->getAdmittanceDeltaApplied();
+    input.force_map_ = leg->getTipForceMap();
+    input.delta_map_ = leg->getTipDeltaMap();
+    input.delta_axis_ = leg->getCurrentTipPose().rotation_._transformVector(Eigen::Vector3d::UnitX());
+    input.admittance_delta_ = leg->getAdmittanceDelta();
+    input.tip_force_measured_ = leg->getTipForceMeasured();
+    bool dynamic_stiffness = params_.dynamic_stiffness.data;
+    input.stiffness_ = dynamic_stiffness ? leg->getVirtualStiffness() : params_.virtual_stiffness.current_value;
+
+    int i = 0;
+    input.desired_position_.resize(joint_count);
+    input.desired_velocity_.resize(joint_count);
+    input.desired_effort_.resize(joint_count);
+    input.min_position_.resize(joint_count);
+    input.max_position_.resize(joint_count);
+    for (joint_it_ = leg->getJointContainer()->begin(); joint_it_ != leg->getJointContainer()->end(); ++joint_it_, ++i)
+    {
+      std::shared_ptr<Joint> joint = joint_it_->second;
+      input.desired_position_[i] = joint->desired_position_;
+      input.desired_velocity_[i] = joint->desired_velocity_;
+      input.desired_effort_[i] = joint->desired_effort_;
+      input.min_position_[i] = joint->min_position_;
+      input.max_position_[i] = joint->max_position_;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void StateController::publishLegState(void)
 {
+  // Actual tip poses of all legs generated together in control loop, leaving model state unmodified
+  PoseArray* actual_tip_poses = model_->getActualTipPoses();
 
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
@@ -837,8 +950,7 @@ void StateController::publishLegState(void)
 
     msg.actual_tip_pose.header.stamp = ros::Time::now();
     msg.actual_tip_pose.header.frame_id = "base_link";
-    msg.actual_tip_pose.pose = leg->applyFK(false, true).toPoseMessage();
-    leg->applyFK();
+    msg.actual_tip_pose.pose = actual_tip_poses->at(leg->getIDNumber()).toPoseMessage();
 
     // Tip velocities
     msg.model_tip_velocity.header.stamp = ros::Time::now();
@@ -860,8 +972,8 @@ void StateController::publishLegState(void)
     msg.swing_progress = leg_stepper->getSwingProgress();
     msg.stance_progress = leg_stepper->getStanceProgress();
     StepCycle step = walker_->getStepCycle();
-    double swing_time = (double(step.swing_period_) / step.period_) / step.frequency_;
-    double stance_time = (double(step.stance_period_) / step.period_) / step.frequency_;
+    double swing_time = (step.swing_period_ / step.period_) / step.frequency_;
+    double stance_time = (step.stance_period_ / step.period_) / step.frequency_;
     double time_to_swing_end;
     if (leg_stepper->getStanceProgress() >= 0.0)
     {
@@ -924,16 +1036,52 @@ void StateController::publishPose(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void StateController::publishOdometry(void)
+{
+  nav_msgs::Odometry msg;
+  msg.header.stamp = ros::Time::now();
+  msg.header.frame_id = "odom";
+  msg.child_frame_id = "base_link";
+  msg.pose.pose = walker_->getOdometry().toPoseMessage();
+
+  // Twist in base_link frame from pose delta over last iteration
+  double time_delta = params_.time_delta.data;
+  Pose odometry_delta = walker_->getOdometryDelta();
+  Eigen::AngleAxisd rotation_delta(odometry_delta.rotation_);
+  Eigen::Vector3d linear_velocity = odometry_delta.position_ / time_delta;
+  Eigen::Vector3d angular_velocity = rotation_delta.axis() * rotation_delta.angle() / time_delta;
+  msg.twist.twist.linear.x = linear_velocity[0];
+  msg.twist.twist.linear.y = linear_velocity[1];
+  msg.twist.twist.linear.z = linear_velocity[2];
+  msg.twist.twist.angular.x = angular_velocity[0];
+  msg.twist.twist.angular.y = angular_velocity[1];
+  msg.twist.twist.angular.z = angular_velocity[2];
+
+  // Covariance matrices in row-major order
+  PoseCovariance pose_covariance = walker_->getOdometryCovariance();
+  PoseCovariance twist_covariance = walker_->getOdometryDeltaCovariance() / (time_delta * time_delta);
+  for (int i = 0; i < 6; ++i)
+  {
+    for (int j = 0; j < 6; ++j)
+    {
+      msg.pose.covariance[i * 6 + j] = pose_covariance(i, j);
+      msg.twist.covariance[i * 6 + j] = twist_covariance(i, j);
+    }
+  }
+  odometry_publisher_.publish(msg);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void StateController::publishWalkspace(void)
 {
   if (robot_state_ == RUNNING)
   {
     std_msgs::Float32MultiArray msg;
-    LimitMap walkspace_map = walker_->getWalkspace();
-    LimitMap::iterator walkspace_it;
-    for (walkspace_it = walkspace_map.begin(); walkspace_it != walkspace_map.end(); ++walkspace_it)
+    LimitMap* walkspace = walker_->getWalkspace();
+    for (int i = 0; i < walkspace->getBearingCount(); ++i)
     {
-      msg.data.push_back(static_cast<float>(walkspace_it->second));
+      msg.data.push_back(static_cast<float>(walkspace->getValue(i)));
     }
 
     walkspace_publisher_.publish(msg);
@@ -1066,7 +1214,7 @@ void StateController::RVIZDebugging(void)
       debug_visualiser_.generateDefaultTipPositions(leg);
       debug_visualiser_.generateTargetTipPositions(leg);
       debug_visualiser_.generateWorkspace(leg, walker_->getBodyClearance());
-      debug_visualiser_.generateWalkspace(leg, walker_->getWalkspace());
+      debug_visualiser_.generateWalkspace(leg, *walker_->getWalkspace());
       debug_visualiser_.generateBezierCurves(leg);
       debug_visualiser_.generateStride(leg);
       if (params_.admittance_control.data)
@@ -1792,9 +1940,16 @@ void StateController::initParameters(void)
   params_.clamp_joint_positions.init("clamp_joint_positions");
   params_.clamp_joint_velocities.init("clamp_joint_velocities");
   params_.ignore_IK_warnings.init("ignore_IK_warnings");
+  params_.use_analytic_IK.init("use_analytic_IK");
+  params_.bisect_workspace_search.init("bisect_workspace_search");
+  params_.workspace_bearing_step.init("workspace_bearing_step");
+  params_.workspace_layers.init("workspace_layers");
 
   // Walk controller parameters
   params_.gait_type.init("gait_type");
+  params_.gait_transition_cycles.init("gait_transition_cycles");
+  params_.free_gait.init("free_gait");
+  params_.free_gait_stability_margin.init("free_gait_stability_margin");
   params_.body_clearance.init("body_clearance");
   params_.step_frequency.init("step_frequency");
   params_.swing_height.init("swing_height");
@@ -1812,6 +1967,9 @@ void StateController::initParameters(void)
   params_.gravity_aligned_tips.init("gravity_aligned_tips");
   params_.liftoff_threshold.init("liftoff_threshold");
   params_.touchdown_threshold.init("touchdown_threshold");
+  params_.walk_plane_outlier_threshold.init("walk_plane_outlier_threshold");
+  params_.footstep_candidates.init("footstep_candidates");
+  params_.footstep_search_radius.init("footstep_search_radius");
 
   // Pose controller parameters
   params_.auto_pose_type.init("auto_pose_type");
@@ -1828,6 +1986,8 @@ void StateController::initParameters(void)
   params_.dynamic_stiffness.init("dynamic_stiffness");
   params_.use_joint_effort.init("use_joint_effort");
   params_.integrator_step_time.init("integrator_step_time");
+  params_.exact_admittance_integrator.init("exact_admittance_integrator");
+  params_.compliance_loop_rate.init("compliance_loop_rate");
   params_.virtual_mass.init("virtual_mass");
   params_.virtual_stiffness.init("virtual_stiffness");
   params_.load_stiffness_scaler.init("load_stiffness_scaler");
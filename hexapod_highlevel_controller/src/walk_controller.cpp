@@ -26,6 +26,15 @@ void WalkController::init(void)
   walk_plane_ = Eigen::Vector3d::Zero();
   walk_plane_normal_ = Eigen::Vector3d::UnitZ();
   odometry_ideal_ = Pose::Identity();
+  joint_angular_speed_limit_ = UNASSIGNED_VALUE;
+  joint_speed_maps_.clear();
+  odometry_ = Pose::Identity();
+  odometry_delta_ = Pose::Identity();
+  odometry_covariance_ = PoseCovariance::Zero();
+  odometry_delta_covariance_ = PoseCovariance::Zero();
+  resetOdometryFootprint();
+  touchdown_history_count_ = 0;
+  touchdown_history_index_ = 0;
 
   // Set default stance tip positions from parameters
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
@@ -56,225 +65,391 @@ void WalkController::init(void)
 
 void WalkController::generateWalkspace(void)
 {
-  // Initially populate walkspace with maximum values (without overlapping between adjacent legs)
-  walkspace_.clear();
-  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  // Discard contribution of all legs to walkspace and regenerate without time limit
+  leg_walkspaces_.clear();
+  walkspace_update_in_progress_ = false;
+  updateWalkspace();
+  regenerate_walkspace_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkController::updateWalkspace(const double &time_limit)
+{
+  ros::WallTime start_time = ros::WallTime::now();
+  int bearing_step = model_->getLegContainer()->begin()->second->getWorkspace()->getBearingStep();
+
+  // Begin regeneration of contribution of each leg whose inputs have changed since last generated
+  if (!walkspace_update_in_progress_)
   {
-    // Get positions of adjacent legs
-    int leg_count = model_->getLegCount();
-    std::shared_ptr<Leg> leg = leg_it_->second;
-    std::shared_ptr<Leg> adjacent_leg_1 = model_->getLegByIDNumber(mod(leg->getIDNumber() + 1, leg_count));
-    std::shared_ptr<Leg> adjacent_leg_2 = model_->getLegByIDNumber(mod(leg->getIDNumber() - 1, leg_count));
-    Eigen::Vector3d default_tip_position = leg->getLegStepper()->getDefaultTipPose().position_;
-    Eigen::Vector3d adjacent_1_tip_position = adjacent_leg_1->getLegStepper()->getDefaultTipPose().position_;
-    Eigen::Vector3d adjacent_2_tip_position = adjacent_leg_2->getLegStepper()->getDefaultTipPose().position_;
-
-    // Get distance and bearing to adjacent legs from this leg
-    double distance_to_adjacent_leg_1 = Eigen::Vector3d(default_tip_position - adjacent_1_tip_position).norm() / 2.0;
-    double distance_to_adjacent_leg_2 = Eigen::Vector3d(default_tip_position - adjacent_2_tip_position).norm() / 2.0;
-    double bearing_to_adjacent_leg_1 = radiansToDegrees(atan2(adjacent_1_tip_position[1] - default_tip_position[1],
-                                                              adjacent_1_tip_position[0] - default_tip_position[0]));
-    double bearing_to_adjacent_leg_2 = radiansToDegrees(atan2(adjacent_2_tip_position[1] - default_tip_position[1],
-                                                              adjacent_2_tip_position[0] - default_tip_position[0]));
-
-    // Populate walkspace
-    for (int bearing = 0; bearing <= 360; bearing += BEARING_STEP)
+    for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
     {
-      int bearing_diff_1 = abs(mod(static_cast<int>(bearing_to_adjacent_leg_1), 360) - bearing);
-      int bearing_diff_2 = abs(mod(static_cast<int>(bearing_to_adjacent_leg_2), 360) - bearing);
-      double distance_to_overlap_1 = UNASSIGNED_VALUE;
-      double distance_to_overlap_2 = UNASSIGNED_VALUE;
-      if ((bearing_diff_1 < 90 || bearing_diff_1 > 270) && distance_to_adjacent_leg_1 > 0.0)
+      std::shared_ptr<Leg> leg = leg_it_->second;
+      LegWalkspace leg_walkspace = generateLegWalkspaceInputs(leg);
+      std::map<int, LegWalkspace>::iterator existing = leg_walkspaces_.find(leg->getIDNumber());
+      if (existing == leg_walkspaces_.end() || !existing->second.hasEqualInputs(leg_walkspace) ||
+          existing->second.radius_.getBearingStep() != bearing_step)
       {
-        distance_to_overlap_1 = distance_to_adjacent_leg_1 / cos(degreesToRadians(bearing_diff_1));
+        leg_walkspace.workplane_ = leg->getWorkplane(leg_walkspace.default_shift_[2]); // Interpolated workplane
+        leg_walkspace.radius_ = LimitMap(bearing_step, UNASSIGNED_VALUE);
+        bool empty_workplane = (leg_walkspace.workplane_.size() == 0);
+        leg_walkspace.bearing_index_ = (empty_workplane ? leg_walkspace.radius_.getBearingCount() : 0);
+        generateWalkspaceOverlap(&leg_walkspace);
+        leg_walkspaces_[leg->getIDNumber()] = leg_walkspace;
+        walkspace_update_in_progress_ = true;
       }
-      if ((bearing_diff_2 < 90 || bearing_diff_2 > 270) && distance_to_adjacent_leg_2 > 0.0)
+      // Continue contribution left incomplete by a restarted regeneration
+      else if (existing->second.bearing_index_ < existing->second.radius_.getBearingCount())
       {
-        distance_to_overlap_2 = distance_to_adjacent_leg_2 / cos(degreesToRadians(bearing_diff_2));
+        walkspace_update_in_progress_ = true;
       }
-      bool overlapping = params_.overlapping_walkspaces.data;
-      double min_distance = overlapping ? MAX_WORKSPACE_RADIUS : std::min(distance_to_overlap_1, distance_to_overlap_2);
-      min_distance = std::min(min_distance, MAX_WORKSPACE_RADIUS);
-      if (walkspace_.find(bearing) != walkspace_.end() && min_distance < walkspace_[bearing])
+    }
+    if (!walkspace_update_in_progress_)
+    {
+      return true;
+    }
+  }
+
+  // Generate walkspace radii of each leg bearing by bearing, suspending generation once time limit is exceeded
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    LegWalkspace &leg_walkspace = leg_walkspaces_[leg->getIDNumber()];
+    while (leg_walkspace.bearing_index_ < leg_walkspace.radius_.getBearingCount())
+    {
+      int j = leg_walkspace.bearing_index_++;
+      leg_walkspace.radius_.getValue(j) = generateWalkspaceRadius(leg, leg_walkspace, j);
+      if ((ros::WallTime::now() - start_time).toSec() > time_limit)
       {
-        walkspace_[bearing] = min_distance;
+        return false;
       }
-      else
+    }
+  }
+
+  // Initially populate walkspace with maximum values (without overlapping between adjacent legs)
+  walkspace_ = LimitMap(bearing_step, UNASSIGNED_VALUE);
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    LegWalkspace &leg_walkspace = leg_walkspaces_[leg_it_->second->getIDNumber()];
+    *walkspace_.getBins() = walkspace_.getBins()->min(*leg_walkspace.overlap_.getBins());
+  }
+
+  // Add radii of each leg to walkspace whilst ensuring symmetry and min values.
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    LegWalkspace &leg_walkspace = leg_walkspaces_[leg_it_->second->getIDNumber()];
+    for (int j = 0; j < walkspace_.getBearingCount(); ++j)
+    {
+      double radius = leg_walkspace.radius_.getValue(j);
+      int opposite_bearing = mod(walkspace_.getBearing(j) + 180, 360);
+      if (radius < walkspace_.getValue(j))
       {
-        walkspace_.insert(LimitMap::value_type(bearing, min_distance));
+        walkspace_.getValue(j) = radius;
+        if (opposite_bearing % bearing_step == 0)
+        {
+          walkspace_.getValue(opposite_bearing / bearing_step) = radius;
+        }
       }
     }
   }
+  walkspace_.getValue(walkspace_.getBearingCount() - 1) = walkspace_.getValue(0);
+  walkspace_update_in_progress_ = false;
+  generateLimits();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  // Generate walkspace for each leg whilst ensuring symmetry and minimum values
+void WalkController::generateJointSpeedMaps(void)
+{
+  joint_speed_maps_.clear();
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
     std::shared_ptr<Leg> leg = leg_it_->second;
-    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
-
-    // Calculate target height of plane within workspace
-    Pose current_pose = model_->getCurrentPose();
-    Eigen::Vector3d identity_tip_position =
-        current_pose.inverseTransformVector(leg_stepper->getIdentityTipPose().position_);
-    Eigen::Vector3d default_tip_position =
-        current_pose.inverseTransformVector(leg_stepper->getDefaultTipPose().position_);
-    Eigen::Vector3d default_shift = default_tip_position - identity_tip_position;
-    double target_workplane_height = default_shift[2];
-    LimitMap workplane = leg->getWorkplane(target_workplane_height); // Interpolated workplane
-    if (workplane.empty())
+    const KinematicState &kinematic_state = leg->getKinematicState();
+    if (leg->getLegState() != WALKING || !kinematic_state.valid)
     {
       continue;
     }
 
-    // Generate walkspace radii
-    LimitMap::iterator walkspace_it;
-    for (walkspace_it = walkspace_.begin(); walkspace_it != walkspace_.end(); ++walkspace_it)
+    // Jacobian is defined in the frame of the first joint of the leg
+    JointSpeedMap joint_speed_map;
+    std::shared_ptr<Joint> first_joint = leg->getJointContainer()->begin()->second;
+    Eigen::Matrix3d rotation = first_joint->getPoseJointFrame().rotation_.toRotationMatrix();
+    joint_speed_map.tip_to_joint_velocity_ = kinematic_state.position_dls_inverse * rotation;
+    joint_speed_map.max_joint_speed_.resize(leg->getJointCount());
+    int i = 0;
+    JointContainer::iterator joint_it;
+    for (joint_it = leg->getJointContainer()->begin(); joint_it != leg->getJointContainer()->end(); ++joint_it, ++i)
     {
-      int bearing = walkspace_it->first;
-      double radius = walkspace_it->second;
+      joint_speed_map.max_joint_speed_[i] = joint_it->second->max_angular_speed_;
+    }
 
-      // If default tip position is equal to identity tip position skip default shift radius generation
-      if (default_shift.norm() == 0.0)
-      {
-        radius = workplane.at(bearing);
-      }
-      // Generate radius from interpolated workplane for shifted default tip position within plane.
-      else
+    // Swing width shifts swing trajectory away from body (see LegStepper::generatePrimarySwingControlNodes)
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    bool positive_y_axis = (Eigen::Vector3d::UnitY().dot(leg_stepper->getIdentityTipPose().position_) > 0.0);
+    joint_speed_map.default_tip_position_ = leg_stepper->getDefaultTipPose().position_;
+    joint_speed_map.swing_width_axis_ = (positive_y_axis ? 1.0 : -1.0) * Eigen::Vector3d::UnitY();
+    joint_speed_maps_[leg->getIDNumber()] = joint_speed_map;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::generateJointSpeedLimits(const StepCycle &step)
+{
+  // Nominal control nodes of each swing curve (per LegStepper::generatePrimarySwingControlNodes and
+  // LegStepper::generateSecondarySwingControlNodes) whilst walking at constant speed on a flat walk plane. Nodes along
+  // the stride are per unit stance tip speed, whilst nodes normal to the walk plane and along the swing width axis are
+  // independent of stance tip speed.
+  double phase_rate = step.period_ * step.frequency_;
+  double stance_time = step.stance_period_ / phase_rate;
+  double half_swing_time = 0.5 * step.swing_period_ / phase_rate;
+  double clearance = getStepClearance();
+  double width = params_.swing_width.current_value;
+  double stride_nodes[2][5] = { { -0.5 * stance_time, -0.5 * stance_time - 0.25 * half_swing_time,
+                                  -0.5 * stance_time - 0.5 * half_swing_time, 0.0, 0.0 },
+                                { 0.0, 0.0, 0.5 * stance_time + 0.5 * half_swing_time,
+                                  0.5 * stance_time + 0.25 * half_swing_time, 0.5 * stance_time } };
+  stride_nodes[0][3] = 0.5 * stride_nodes[0][2];
+  stride_nodes[1][1] = -stride_nodes[0][3];
+  double clearance_nodes[2][5] = { { 0.0, 0.0, 0.0, clearance, clearance }, { clearance, clearance, 0.0, 0.0, 0.0 } };
+  double width_nodes[2][5] = { { 0.0, 0.0, 0.0, 0.5 * width, width }, { width, 1.5 * width, 0.0, 0.0, 0.0 } };
+
+  // Max body speed for which joint velocities are within limits, given the tip velocity in stance per unit body speed
+  // Tip velocity in swing is the stance tip velocity scaled by the negated curve derivative along the stride plus the
+  // speed independent derivatives (beginning of the primary curve matches tip velocity in stance)
+  auto max_body_speed = [&](const JointSpeedMap &joint_speed_map, const Eigen::Vector3d &stance_tip_velocity)
+  {
+    Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> stride_joint_velocities =
+        joint_speed_map.tip_to_joint_velocity_ * stance_tip_velocity;
+    Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> clearance_joint_velocities =
+        joint_speed_map.tip_to_joint_velocity_.col(2);
+    Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_JOINT_COUNT, 1> width_joint_velocities =
+        joint_speed_map.tip_to_joint_velocity_ * joint_speed_map.swing_width_axis_;
+    double max_speed = UNASSIGNED_VALUE;
+    for (int curve = 0; curve < 2; ++curve)
+    {
+      for (int k = 0; k <= SWING_SPEED_SAMPLES; ++k)
       {
-        // Generate new point in walkspace
-        Eigen::Vector3d new_point = Eigen::Vector3d::UnitX() * MAX_WORKSPACE_RADIUS;
-        new_point = Eigen::AngleAxisd(degreesToRadians(bearing), Eigen::Vector3d::UnitZ())._transformVector(new_point);
-        new_point = setPrecision(new_point, 3);
-
-        // Generate radius from finding intersection of new point direction vector and existing workplane limits
-        LimitMap::iterator workplane_it;
-        for (workplane_it = workplane.begin(); workplane_it != workplane.end(); ++workplane_it)
+        double time_input = double(k) / SWING_SPEED_SAMPLES;
+        double stride_rate = -quarticBezierDot(stride_nodes[curve], time_input) / half_swing_time;
+        double clearance_rate = quarticBezierDot(clearance_nodes[curve], time_input) / half_swing_time;
+        double width_rate = quarticBezierDot(width_nodes[curve], time_input) / half_swing_time;
+        for (int j = 0; j < stride_joint_velocities.size(); ++j)
         {
-          // Generate reference point 1
-          int bearing_1 = workplane_it->first;
-          double radius_1 = workplane_it->second;
-          Eigen::Vector3d point_1 = Eigen::Vector3d::UnitX() * radius_1;
-          point_1 = Eigen::AngleAxisd(degreesToRadians(bearing_1), Eigen::Vector3d::UnitZ())._transformVector(point_1);
-          point_1 -= default_shift;
-          point_1[2] = 0.0;
-          point_1 = setPrecision(point_1, 3);
-
-          // Unable to find reference points which bound new walkspace point direction vector therefore set zero radius
-          if (bearing_1 == workplane.rbegin()->first)
+          double speed_rate = std::abs(stride_rate * stride_joint_velocities[j]);
+          double offset = clearance_rate * clearance_joint_velocities[j] + width_rate * width_joint_velocities[j];
+          if (speed_rate > 0.0)
           {
-            ROS_WARN("\n[SHC] Unable to generate radius at bearing %d for leg %s and workplane at height %f.\n",
-                     bearing, leg->getIDName().c_str(), target_workplane_height);
-            radius = 0.0;
-            break;
-          }
-
-          // Generate reference point 2
-          int bearing_2 = next(workplane_it)->first;
-          double radius_2 = next(workplane_it)->second;
-          Eigen::Vector3d point_2 = Eigen::Vector3d::UnitX() * radius_2;
-          point_2 = Eigen::AngleAxisd(degreesToRadians(bearing_2), Eigen::Vector3d::UnitZ())._transformVector(point_2);
-          point_2 -= default_shift;
-          point_2[2] = 0.0;
-          point_2 = setPrecision(point_2, 3);
-
-          // Reference point 1 in same direction as new point
-          if (point_1.cross(new_point).norm() == 0.0)
-          {
-            radius = point_1.norm();
-            break;
-          }
-          // Reference point 2 in same direction as new point
-          else if (point_2.cross(new_point).norm() == 0.0)
-          {
-            radius = point_2.norm();
-            break;
-          }
-          // New point direction is between reference points - calculate distance to line connecting reference points
-          // Ref: stackoverflow.com/questions/13640931/how-to-determine-if-a-vector-is-between-two-other-vectors
-          else if (point_1.cross(new_point).dot(point_1.cross(point_2)) >= 0.0 &&
-                   point_2.cross(new_point).dot(point_2.cross(point_1)) >= 0.0)
-          {
-            // Calculate vector (with same direction as new point) normal to line connecting p1 & p2 on horizontal plane
-            double dx = point_2[0] - point_1[0];
-            double dy = point_2[1] - point_1[1];
-            Eigen::Vector3d normal_1 = Eigen::Vector3d(dy, -dx, 0.0).normalized();
-            Eigen::Vector3d normal_2 = Eigen::Vector3d(-dy, dx, 0.0).normalized();
-            bool same_direction_as_new_point = getProjection(new_point, normal_1).dot(normal_1) >= 0.0;
-            Eigen::Vector3d normal = (same_direction_as_new_point ? normal_1 : normal_2);
-
-            // Use normal to calculate intersection distance of new point vector on line connecting p1 & p2.
-            Eigen::Vector3d new_point_projection = getProjection(new_point, normal);
-            Eigen::Vector3d point_1_projection = getProjection(point_1, normal);
-            double ratio = point_1_projection.norm() / new_point_projection.norm();
-            radius = ratio * MAX_WORKSPACE_RADIUS;
-            break;
+            offset *= (stride_rate * stride_joint_velocities[j] > 0.0 ? 1.0 : -1.0);
+            double available_speed = std::max(0.0, joint_speed_map.max_joint_speed_[j] - offset);
+            max_speed = std::min(max_speed, available_speed / speed_rate);
           }
         }
       }
+    }
+    return max_speed;
+  };
 
-      // Add calculated radius to walkspace whilst ensuring symmetry and min values.
-      int opposite_bearing = mod(bearing + 180, 360);
-      if (radius < walkspace_.at(bearing))
-      {
-        walkspace_[bearing] = radius;
-        walkspace_[opposite_bearing] = radius;
-      }
+  joint_linear_speed_limits_ = LimitMap(walkspace_.getBearingStep(), UNASSIGNED_VALUE);
+  joint_angular_speed_limit_ = UNASSIGNED_VALUE;
+  std::map<int, JointSpeedMap>::iterator it;
+  for (it = joint_speed_maps_.begin(); it != joint_speed_maps_.end(); ++it)
+  {
+    // Tip velocity in stance is opposite to body velocity along each bearing
+    for (int i = 0; i < joint_linear_speed_limits_.getBearingCount(); ++i)
+    {
+      double bearing = degreesToRadians(joint_linear_speed_limits_.getBearing(i));
+      Eigen::Vector3d tip_velocity(-cos(bearing), -sin(bearing), 0.0);
+      double max_speed = max_body_speed(it->second, tip_velocity);
+      joint_linear_speed_limits_.getValue(i) = std::min(joint_linear_speed_limits_.getValue(i), max_speed);
     }
+
+    // Tip velocity in stance from body angular velocity about the z axis
+    Eigen::Vector3d tip_position = it->second.default_tip_position_;
+    Eigen::Vector3d tip_velocity(tip_position[1], -tip_position[0], 0.0); // -z x tip_position
+    joint_angular_speed_limit_ = std::min(joint_angular_speed_limit_, max_body_speed(it->second, tip_velocity));
   }
-  walkspace_[360] = walkspace_[0];
-  regenerate_walkspace_ = false;
-  generateLimits();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void WalkController::generateLimits(StepCycle step,
-                                    LimitMap *max_linear_speed_ptr,
-                                    LimitMap *max_angular_speed_ptr,
-                                    LimitMap *max_linear_acceleration_ptr,
-                                    LimitMap *max_angular_acceleration_ptr)
+LegWalkspace WalkController::generateLegWalkspaceInputs(std::shared_ptr<Leg> leg)
 {
-  int base_step_period = params_.stance_phase.data + params_.swing_phase.data;
-  int normaliser = step.period_ / base_step_period;
-  int base_step_offset = int(params_.phase_offset.data * normaliser);
+  LegWalkspace leg_walkspace;
 
-  bool set_limits = (!max_linear_speed_ptr && !max_linear_acceleration_ptr &&
-                     !max_angular_speed_ptr && !max_angular_acceleration_ptr);
-  if (set_limits)
-  {
-    max_linear_speed_ptr = &max_linear_speed_;
-    max_angular_speed_ptr = &max_angular_speed_;
-    max_linear_acceleration_ptr = &max_linear_acceleration_;
-    max_angular_acceleration_ptr = &max_angular_acceleration_;
-  }
+  // Get positions of adjacent legs
+  int leg_count = model_->getLegCount();
+  std::shared_ptr<Leg> adjacent_leg_1 = model_->getLegByIDNumber(mod(leg->getIDNumber() + 1, leg_count));
+  std::shared_ptr<Leg> adjacent_leg_2 = model_->getLegByIDNumber(mod(leg->getIDNumber() - 1, leg_count));
+  leg_walkspace.default_tip_position_ = leg->getLegStepper()->getDefaultTipPose().position_;
+  leg_walkspace.adjacent_tip_position_1_ = adjacent_leg_1->getLegStepper()->getDefaultTipPose().position_;
+  leg_walkspace.adjacent_tip_position_2_ = adjacent_leg_2->getLegStepper()->getDefaultTipPose().position_;
+  leg_walkspace.overlapping_ = params_.overlapping_walkspaces.data;
+
+  // Calculate shift of default tip position (including target height of plane within workspace)
+  Pose current_pose = model_->getCurrentPose();
+  std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+  Eigen::Vector3d identity_tip_position =
+      current_pose.inverseTransformVector(leg_stepper->getIdentityTipPose().position_);
+  Eigen::Vector3d default_tip_position =
+      current_pose.inverseTransformVector(leg_stepper->getDefaultTipPose().position_);
+  leg_walkspace.default_shift_ = default_tip_position - identity_tip_position;
+  return leg_walkspace;
+}
 
-  if (max_linear_speed_ptr)
-  {
-    max_linear_speed_ptr->clear();
-  }
-  if (max_linear_acceleration_ptr)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::generateWalkspaceOverlap(LegWalkspace *leg_walkspace)
+{
+  Eigen::Vector3d default_tip_position = leg_walkspace->default_tip_position_;
+  Eigen::Vector3d adjacent_1_tip_position = leg_walkspace->adjacent_tip_position_1_;
+  Eigen::Vector3d adjacent_2_tip_position = leg_walkspace->adjacent_tip_position_2_;
+  leg_walkspace->overlap_ = LimitMap(leg_walkspace->radius_.getBearingStep(), UNASSIGNED_VALUE);
+
+  // Get distance and bearing to adjacent legs from this leg
+  double distance_to_adjacent_leg_1 = Eigen::Vector3d(default_tip_position - adjacent_1_tip_position).norm() / 2.0;
+  double distance_to_adjacent_leg_2 = Eigen::Vector3d(default_tip_position - adjacent_2_tip_position).norm() / 2.0;
+  double bearing_to_adjacent_leg_1 = radiansToDegrees(atan2(adjacent_1_tip_position[1] - default_tip_position[1],
+                                                            adjacent_1_tip_position[0] - default_tip_position[0]));
+  double bearing_to_adjacent_leg_2 = radiansToDegrees(atan2(adjacent_2_tip_position[1] - default_tip_position[1],
+                                                            adjacent_2_tip_position[0] - default_tip_position[0]));
+
+  // Populate overlap distances
+  for (int i = 0; i < leg_walkspace->overlap_.getBearingCount(); ++i)
   {
-    max_linear_acceleration_ptr->clear();
+    int bearing = leg_walkspace->overlap_.getBearing(i);
+    int bearing_diff_1 = abs(mod(static_cast<int>(bearing_to_adjacent_leg_1), 360) - bearing);
+    int bearing_diff_2 = abs(mod(static_cast<int>(bearing_to_adjacent_leg_2), 360) - bearing);
+    double distance_to_overlap_1 = UNASSIGNED_VALUE;
+    double distance_to_overlap_2 = UNASSIGNED_VALUE;
+    if ((bearing_diff_1 < 90 || bearing_diff_1 > 270) && distance_to_adjacent_leg_1 > 0.0)
+    {
+      distance_to_overlap_1 = distance_to_adjacent_leg_1 / cos(degreesToRadians(bearing_diff_1));
+    }
+    if ((bearing_diff_2 < 90 || bearing_diff_2 > 270) && distance_to_adjacent_leg_2 > 0.0)
+    {
+      distance_to_overlap_2 = distance_to_adjacent_leg_2 / cos(degreesToRadians(bearing_diff_2));
+    }
+    bool overlapping = leg_walkspace->overlapping_;
+    double min_distance = overlapping ? MAX_WORKSPACE_RADIUS : std::min(distance_to_overlap_1, distance_to_overlap_2);
+    leg_walkspace->overlap_.getValue(i) = std::min(min_distance, MAX_WORKSPACE_RADIUS);
   }
-  if (max_angular_speed_ptr)
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+double WalkController::generateWalkspaceRadius(std::shared_ptr<Leg> leg, const LegWalkspace &leg_walkspace,
+                                               const int &bearing_index)
+{
+  const Workplane &workplane = leg_walkspace.workplane_;
+  Eigen::Vector3d default_shift = leg_walkspace.default_shift_;
+  double target_workplane_height = default_shift[2];
+  int bearing_step = leg_walkspace.radius_.getBearingStep();
+  int bearing = leg_walkspace.radius_.getBearing(bearing_index);
+  double radius = UNASSIGNED_VALUE;
+
+  // If default tip position is equal to identity tip position skip default shift radius generation
+  if (default_shift.norm() == 0.0)
   {
-    max_angular_speed_ptr->clear();
+    radius = workplane[bearing_index];
   }
-  if (max_angular_acceleration_ptr)
+  // Generate radius from interpolated workplane for shifted default tip position within plane.
+  else
   {
-    max_angular_acceleration_ptr->clear();
+    // Generate new point in walkspace
+    Eigen::Vector3d new_point = Eigen::Vector3d::UnitX() * MAX_WORKSPACE_RADIUS;
+    new_point = Eigen::AngleAxisd(degreesToRadians(bearing), Eigen::Vector3d::UnitZ())._transformVector(new_point);
+    new_point = setPrecision(new_point, 3);
+
+    // Generate radius from finding intersection of new point direction vector and existing workplane limits
+    for (int i = 0; i < workplane.size(); ++i)
+    {
+      // Generate reference point 1
+      int bearing_1 = i * bearing_step;
+      double radius_1 = workplane[i];
+      Eigen::Vector3d point_1 = Eigen::Vector3d::UnitX() * radius_1;
+      point_1 = Eigen::AngleAxisd(degreesToRadians(bearing_1), Eigen::Vector3d::UnitZ())._transformVector(point_1);
+      point_1 -= default_shift;
+      point_1[2] = 0.0;
+      point_1 = setPrecision(point_1, 3);
+
+      // Unable to find reference points which bound new walkspace point direction vector therefore set zero radius
+      if (i == workplane.size() - 1)
+      {
+        ROS_WARN("\n[SHC] Unable to generate radius at bearing %d for leg %s and workplane at height %f.\n",
+                 bearing, leg->getIDName().c_str(), target_workplane_height);
+        radius = 0.0;
+        break;
+      }
+
+      // Generate reference point 2
+      int bearing_2 = (i + 1) * bearing_step;
+      double radius_2 = workplane[i + 1];
+      Eigen::Vector3d point_2 = Eigen::Vector3d::UnitX() * radius_2;
+      point_2 = Eigen::AngleAxisd(degreesToRadians(bearing_2), Eigen::Vector3d::UnitZ())._transformVector(point_2);
+      point_2 -= default_shift;
+      point_2[2] = 0.0;
+      point_2 = setPrecision(point_2, 3);
+
+      // Reference point 1 in same direction as new point
+      if (point_1.cross(new_point).norm() == 0.0)
+      {
+        radius = point_1.norm();
+        break;
+      }
+      // Reference point 2 in same direction as new point
+      else if (point_2.cross(new_point).norm() == 0.0)
+      {
+        radius = point_2.norm();
+        break;
+      }
+      // New point direction is between reference points - calculate distance to line connecting reference points
+      // Ref: stackoverflow.com/questions/13640931/how-to-determine-if-a-vector-is-between-two-other-vectors
+      else if (point_1.cross(new_point).dot(point_1.cross(point_2)) >= 0.0 &&
+               point_2.cross(new_point).dot(point_2.cross(point_1)) >= 0.0)
+      {
+        // Calculate vector (with same direction as new point) normal to line connecting p1 & p2 on horizontal plane
+        double dx = point_2[0] - point_1[0];
+        double dy = point_2[1] - point_1[1];
+        Eigen::Vector3d normal_1 = Eigen::Vector3d(dy, -dx, 0.0).normalized();
+        Eigen::Vector3d normal_2 = Eigen::Vector3d(-dy, dx, 0.0).normalized();
+        bool same_direction_as_new_point = getProjection(new_point, normal_1).dot(normal_1) >= 0.0;
+        Eigen::Vector3d normal = (same_direction_as_new_point ? normal_1 : normal_2);
+
+        // Use normal to calculate intersection distance of new point vector on line connecting p1 & p2.
+        Eigen::Vector3d new_point_projection = getProjection(new_point, normal);
+        Eigen::Vector3d point_1_projection = getProjection(point_1, normal);
+        double ratio = point_1_projection.norm() / new_point_projection.norm();
+        radius = ratio * MAX_WORKSPACE_RADIUS;
+        break;
+      }
+    }
   }
+  return radius;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::generateLimits(StepCycle step, LimitTable *limit_table_ptr)
+{
+  double phase_rate = step.period_ * step.frequency_; // Phase advanced per second
+
+  // Set limits in walk controller if no output limit table is given
+  limit_table_ptr = (limit_table_ptr ? limit_table_ptr : &limit_table_);
+  *limit_table_ptr = LimitTable(walkspace_.getBearingStep());
 
   // Set step offset and check if leg starts in swing period (i.e. forced to stance for the 1st step cycle)
   // If so find this max 'stance extension' period which is used in acceleration calculations
-  int max_stance_extension = 0;
+  double max_stance_extension = 0.0;
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
     std::shared_ptr<Leg> leg = leg_it_->second;
     ROS_ASSERT(params_.offset_multiplier.data.count(leg->getIDName()));
     int multiplier = params_.offset_multiplier.data.at(leg->getIDName());
     std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
-    int step_offset = (base_step_offset * multiplier) % step.period_;
+    double step_offset = mod(double(params_.phase_offset.data * multiplier), step.period_);
     leg_stepper->setPhaseOffset(step_offset);
     if (step_offset > step.swing_start_ && step_offset < step.swing_end_) // SWING STATE
     {
@@ -283,14 +458,20 @@ void WalkController::generateLimits(StepCycle step,
   }
 
   // Set max stride (i.e. max body velocity) to occur at end of 1st swing of leg with maximum stance period extension
-  double time_to_max_stride = (max_stance_extension + step.stance_period_ + step.swing_period_) * time_delta_;
+  double time_to_max_stride = (max_stance_extension + step.stance_period_ + step.swing_period_) / phase_rate;
+
+  // Joint velocity maps are generated at default stance (i.e. whilst stopped) and reused for other step cycles
+  if (walk_state_ == STOPPED || joint_speed_maps_.empty())
+  {
+    generateJointSpeedMaps();
+  }
+  generateJointSpeedLimits(step);
 
   // Calculate initial max speed and acceleration of body
-  LimitMap::iterator it;
-  for (it = walkspace_.begin(); it != walkspace_.end(); ++it)
+  for (int i = 0; i < walkspace_.getBearingCount(); ++i)
   {
-    double walkspace_radius = it->second;
-    double on_ground_ratio = double(step.stance_period_) / step.period_;
+    double walkspace_radius = walkspace_.getValue(i);
+    double on_ground_ratio = step.stance_period_ / step.period_;
     double max_speed = (walkspace_radius * 2.0) / (on_ground_ratio / step.frequency_);
     double max_acceleration = max_speed / time_to_max_stride;
 
@@ -302,13 +483,13 @@ void WalkController::generateLimits(StepCycle step,
       std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
       // All referenced swings are the LAST swing period BEFORE the max velocity (stride length) is reached
       double step_offset = leg_stepper->getPhaseOffset();
-      double t = step_offset * time_delta_; // Time between swing end and max velocity being reached
+      double t = step_offset / phase_rate; // Time between swing end and max velocity being reached
       double time_to_swing_end = time_to_max_stride - t;
       double v0 = max_acceleration * time_to_swing_end; // Tip velocity at time of swing end
       double stride_length = v0 * (on_ground_ratio / step.frequency_);
       double d0 = -stride_length / 2.0;                                          // Distance to default tip position at time of swing end
       double d1 = d0 + v0 * t + 0.5 * max_acceleration * sqr(t);                 // Distance from default tip position at max velocity
-      double d2 = max_speed * (step.stance_period_ * time_delta_ - t);           // Distance from default position at stance end
+      double d2 = max_speed * (step.stance_period_ / phase_rate - t);            // Distance from default position at stance end
       stance_overshoot = std::max(stance_overshoot, d1 + d2 - walkspace_radius); // Max overshoot past walkspace limits
     }
 
@@ -327,8 +508,12 @@ void WalkController::generateLimits(StepCycle step,
     // Distance: scaled_walkspace_radius*2.0 (i.e. max stride length)
     // Time: on_ground_ratio*(1/step_frequency_) where step frequency is FULL step cycles/s)
     double max_linear_speed = (scaled_walkspace_radius * 2.0) / (on_ground_ratio / step.frequency_);
-    double max_linear_acceleration = max_linear_speed / time_to_max_stride;
     double max_angular_speed = max_linear_speed / stance_radius;
+
+    // Limit speeds to those for which tip velocities are achievable within joint velocity limits
+    max_linear_speed = std::min(max_linear_speed, joint_linear_speed_limits_.getValue(i));
+    max_angular_speed = std::min(max_angular_speed, joint_angular_speed_limit_);
+    double max_linear_acceleration = max_linear_speed / time_to_max_stride;
     double max_angular_acceleration = max_angular_speed / time_to_max_stride;
 
     // Handle zero walkspace
@@ -340,23 +525,23 @@ void WalkController::generateLimits(StepCycle step,
       max_angular_acceleration = UNASSIGNED_VALUE;
     }
 
-    // Populate limit maps
-    if (max_linear_speed_ptr)
-    {
-      max_linear_speed_ptr->insert(LimitMap::value_type(it->first, max_linear_speed));
-    }
-    if (max_linear_acceleration_ptr)
-    {
-      max_linear_acceleration_ptr->insert(LimitMap::value_type(it->first, max_linear_acceleration));
-    }
-    if (max_angular_speed_ptr)
-    {
-      max_angular_speed_ptr->insert(LimitMap::value_type(it->first, max_angular_speed));
-    }
-    if (max_angular_acceleration_ptr)
-    {
-      max_angular_acceleration_ptr->insert(LimitMap::value_type(it->first, max_angular_acceleration));
-    }
+    // Populate limit table
+    limit_table_ptr->getValue(i, MAX_LINEAR_SPEED) = max_linear_speed;
+    limit_table_ptr->getValue(i, MAX_ANGULAR_SPEED) = max_angular_speed;
+    limit_table_ptr->getValue(i, MAX_LINEAR_ACCELERATION) = max_linear_acceleration;
+    limit_table_ptr->getValue(i, MAX_ANGULAR_ACCELERATION) = max_angular_acceleration;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::setSpeedLimits(const LimitTable &limit_table)
+{
+  ROS_ASSERT(limit_table.getBearingStep() == limit_table_.getBearingStep());
+  for (int i = 0; i < limit_table_.getBearingCount(); ++i)
+  {
+    limit_table_.getValue(i, MAX_LINEAR_SPEED) = limit_table.getValue(i, MAX_LINEAR_SPEED);
+    limit_table_.getValue(i, MAX_ANGULAR_SPEED) = limit_table.getValue(i, MAX_ANGULAR_SPEED);
   }
 }
 
@@ -364,58 +549,248 @@ void WalkController::generateLimits(StepCycle step,
 
 StepCycle WalkController::generateStepCycle(const bool set_step_cycle)
 {
+  // Phase is measured in the base units of the gait parameters, independent of step frequency and control rate
   StepCycle step;
-  step.stance_end_ = static_cast<int>(params_.stance_phase.data * 0.5);
+  step.period_ = params_.stance_phase.data + params_.swing_phase.data;
+  step.stance_end_ = params_.stance_phase.data * 0.5;
   step.swing_start_ = step.stance_end_;
   step.swing_end_ = step.swing_start_ + params_.swing_phase.data;
   step.stance_start_ = step.swing_end_;
-
-  // Normalises the step period to match the total number of iterations over a full step
-  int base_step_period = params_.stance_phase.data + params_.swing_phase.data;
-  double swing_ratio = double(params_.swing_phase.data) / double(base_step_period); // Modifies step frequency
-
-  // Ensure step period is even and divisible by base step period and therefore gives whole even normaliser value
-  double raw_step_period = ((1.0 / params_.step_frequency.current_value) / time_delta_) / swing_ratio;
-  step.period_ = roundToEvenInt(raw_step_period / base_step_period) * base_step_period;
-
-  step.frequency_ = 1.0 / (step.period_ * time_delta_); // adjust step frequency to match corrected step period
-  int normaliser = step.period_ / base_step_period;
-  step.stance_end_ *= normaliser;
-  step.swing_start_ *= normaliser;
-  step.swing_end_ *= normaliser;
-  step.stance_start_ *= normaliser;
-
   step.stance_period_ = mod(step.stance_end_ - step.stance_start_, step.period_);
   step.swing_period_ = step.swing_end_ - step.swing_start_;
+  ROS_ASSERT(step.stance_period_ > 0.0 && step.swing_period_ > 0.0);
 
-  // Ensure stance and swing periods are divisible by two
-  ROS_ASSERT(step.stance_period_ % 2 == 0);
-  ROS_ASSERT(step.swing_period_ % 2 == 0);
+  // Step frequency parameter defines the frequency of swing periods, scale to give frequency of the full step cycle
+  double swing_ratio = step.swing_period_ / step.period_;
+  step.frequency_ = params_.step_frequency.current_value * swing_ratio;
+  step.phase_delta_ = step.period_ * step.frequency_ * time_delta_;
 
-  // Set step cycle in walk controller and update phase in leg steppers for new parameters if required
+  // Set step cycle in walk controller (phase of leg steppers is unaffected since phase units are fixed by the gait)
   if (set_step_cycle)
   {
     step_ = step;
-    if (walk_state_ == MOVING)
+  }
+  return step;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkController::startGaitTransition(void)
+{
+  if (walk_state_ != MOVING || isTransitioningGait())
+  {
+    return false;
+  }
+
+  // Record swing ratio and phase offset of each leg (as ratio of step cycle) of original gait
+  StepCycle origin_step = step_;
+  origin_swing_ratio_ = origin_step.swing_period_ / origin_step.period_;
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    origin_phase_offsets_[leg->getIDNumber()] = leg_stepper->getPhaseOffset() / origin_step.period_;
+  }
+
+  // Phase of a leg with zero phase offset (all legs are at their phase offset from this phase whilst MOVING)
+  std::shared_ptr<LegStepper> reference_leg_stepper = model_->getLegByIDNumber(0)->getLegStepper();
+  master_phase_ = mod(reference_leg_stepper->getPhase() / origin_step.period_ - origin_phase_offsets_[0], 1.0);
+
+  // Generate step cycle and limits of new gait (also sets phase offset of each leg for new gait)
+  StepCycle target_step = generateStepCycle(false);
+  LimitTable target_limit_table;
+  generateLimits(target_step, &target_limit_table);
+
+  // Find change in phase offset of each leg in shortest direction and convert leg phase into units of new gait
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    int id_number = leg->getIDNumber();
+    double target_phase_offset = leg_stepper->getPhaseOffset() / target_step.period_;
+    phase_offset_changes_[id_number] = mod(target_phase_offset - origin_phase_offsets_[id_number] + 0.5, 1.0) - 0.5;
+    leg_stepper->setPhaseOffset(origin_phase_offsets_[id_number] * origin_step.period_);
+    leg_stepper->scalePhase(target_step.period_ / origin_step.period_);
+  }
+
+  // Limit speed and acceleration to that allowable by both gaits until transition is complete
+  *limit_table_.getBins() = limit_table_.getBins()->min(*target_limit_table.getBins());
+
+  gait_transition_progress_ = 0.0;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::endGaitTransition(void)
+{
+  gait_transition_progress_ = -1.0;
+  generateStepCycle();
+  generateLimits();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkController::isSwingPermitted(std::shared_ptr<Leg> leg)
+{
+  bool free_gait = isFreeGait();
+  if (!isTransitioningGait() && !free_gait)
+  {
+    return true;
+  }
+
+  // Local iterator used since function is called from within iteration of legs (in order of id number) by walk
+  // controller. Legs yet to be iterated which will end swing on this iteration are not considered in swing.
+  int leg_count = model_->getLegCount();
+  int swing_count = 0;
+  LegContainer::iterator leg_it;
+  for (leg_it = model_->getLegContainer()->begin(); leg_it != model_->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> other_leg = leg_it->second;
+    std::shared_ptr<LegStepper> other_leg_stepper = other_leg->getLegStepper();
+    bool iterated = other_leg->getIDNumber() < leg->getIDNumber();
+    double remaining_swing = other_leg_stepper->getStepCycle().swing_end_ - other_leg_stepper->getPhase();
+    bool in_swing = (remaining_swing > (iterated ? 0.0 : step_.phase_delta_) + PHASE_TOLERANCE);
+    if (other_leg != leg && other_leg_stepper->getStepState() == SWING && in_swing)
     {
-      for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+      int separation = mod(other_leg->getIDNumber() - leg->getIDNumber(), leg_count);
+      if (separation == 1 || separation == leg_count - 1)
       {
-        std::shared_ptr<Leg> leg = leg_it_->second;
-        std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
-        leg_stepper->updatePhase();
+        return false;
       }
+      swing_count++;
     }
   }
-  return step;
+
+  // Remaining legs in stance must retain stability margin in free gait. A lesser margin is only permitted once the
+  // leg would otherwise leave its walkspace, and only whilst the body origin remains within the support polygon.
+  bool permitted = swing_count < leg_count / 2;
+  if (permitted && free_gait)
+  {
+    double stability_margin = calculateStabilityMargin(leg);
+    bool walkspace_exhausted = leg->getLegStepper()->isWalkspaceExhausted();
+    permitted = (stability_margin >= params_.free_gait_stability_margin.data ||
+                 (walkspace_exhausted && stability_margin >= 0.0));
+  }
+  return permitted;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-double WalkController::getLimit(const Eigen::Vector2d &linear_velocity_input,
-                                const double &angular_velocity_input,
-                                const LimitMap &limit)
+double WalkController::calculateStabilityMargin(std::shared_ptr<Leg> swing_leg)
 {
-  double min_limit = UNASSIGNED_VALUE;
+  // Support polygon vertices (in walk plane frame) in order of leg id number (i.e. clockwise about body)
+  Eigen::Matrix<double, 2, MAX_LEG_COUNT> support_polygon;
+  int vertex_count = 0;
+  LegContainer::iterator leg_it;
+  for (leg_it = model_->getLegContainer()->begin(); leg_it != model_->getLegContainer()->end(); ++leg_it)
+  {
+    std::shared_ptr<Leg> leg = leg_it->second;
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    if (leg != swing_leg && leg->getLegState() == WALKING && leg_stepper->getStepState() != SWING)
+    {
+      support_polygon.col(vertex_count++) = leg_stepper->getCurrentTipPose().position_.head<2>();
+    }
+  }
+  if (vertex_count < 3)
+  {
+    return -UNASSIGNED_VALUE;
+  }
+
+  // Body origin lies inside each edge of a clockwise polygon if on the right hand side of the edge
+  Eigen::Vector3d body_position = model_->getCurrentPose().position_;
+  Eigen::Vector2d body_origin(body_position[0], body_position[1]);
+  double stability_margin = UNASSIGNED_VALUE;
+  for (int i = 0; i < vertex_count; ++i)
+  {
+    Eigen::Vector2d vertex_1 = support_polygon.col(i);
+    Eigen::Vector2d vertex_2 = support_polygon.col((i + 1) % vertex_count);
+    Eigen::Vector2d edge = vertex_2 - vertex_1;
+    Eigen::Vector2d to_origin = body_origin - vertex_1;
+    double distance = -(edge[0] * to_origin[1] - edge[1] * to_origin[0]) / edge.norm();
+    stability_margin = std::min(stability_margin, distance);
+  }
+  return stability_margin;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::updateGaitTransition(void)
+{
+  // Legs restart from phase offsets of new gait once stopped
+  if (walk_state_ == STOPPED)
+  {
+    endGaitTransition();
+    return;
+  }
+
+  // Blend swing ratio of step cycle from original to new gait (in phase units of new gait)
+  double transition_cycles = params_.gait_transition_cycles.data;
+  double progress_delta = (transition_cycles > 0.0 ? step_.frequency_ * time_delta_ / transition_cycles : 1.0);
+  gait_transition_progress_ = std::min(1.0, gait_transition_progress_ + progress_delta);
+  StepCycle step = generateStepCycle(false);
+  double target_swing_ratio = step.swing_period_ / step.period_;
+  double swing_ratio = origin_swing_ratio_ + gait_transition_progress_ * (target_swing_ratio - origin_swing_ratio_);
+  step.swing_period_ = swing_ratio * step.period_;
+  step.stance_period_ = step.period_ - step.swing_period_;
+  step.stance_end_ = step.stance_period_ * 0.5;
+  step.swing_start_ = step.stance_end_;
+  step.swing_end_ = step.swing_start_ + step.swing_period_;
+  step.stance_start_ = step.swing_end_;
+  step.frequency_ = params_.step_frequency.current_value * swing_ratio;
+  step.phase_delta_ = step.period_ * step.frequency_ * time_delta_;
+  step_ = step;
+
+  // Find error of each leg from blended phase offset, removing any error common to all legs (by shifting the phase of
+  // the zero offset leg) since a delay common to all legs (e.g. propagated by holding legs in stance) is not an error
+  std::map<int, double> phase_offset_errors;
+  double mean_phase_offset_error = 0.0;
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    int id_number = leg->getIDNumber();
+    double phase_offset = origin_phase_offsets_[id_number];
+    phase_offset += gait_transition_progress_ * phase_offset_changes_[id_number];
+    double current_phase_offset = leg_stepper->getPhase() / step_.period_ - master_phase_;
+    phase_offset_errors[id_number] = mod(phase_offset - current_phase_offset + 0.5, 1.0) - 0.5;
+    mean_phase_offset_error += phase_offset_errors[id_number] / model_->getLegCount();
+  }
+  master_phase_ = mod(master_phase_ - mean_phase_offset_error, 1.0);
+
+  // Shift phase of legs in stance towards blended phase offset (legs in swing are shifted once returned to stance)
+  bool phase_offsets_reached = true;
+  double max_phase_shift = GAIT_TRANSITION_SHIFT_RATIO * step_.frequency_ * time_delta_;
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
+    double phase_offset_error = phase_offset_errors[leg->getIDNumber()] - mean_phase_offset_error;
+    if (leg_stepper->getStepState() == STANCE)
+    {
+      double phase_shift = clamped(phase_offset_error, -max_phase_shift, max_phase_shift);
+      leg_stepper->shiftPhase(phase_shift * step_.period_);
+      phase_offset_error -= phase_shift;
+    }
+    phase_offsets_reached = phase_offsets_reached && std::abs(phase_offset_error) < PHASE_TOLERANCE;
+  }
+
+  // Advance phase of zero offset leg by that which legs will advance this iteration
+  master_phase_ = mod(master_phase_ + step_.frequency_ * time_delta_, 1.0);
+
+  if (gait_transition_progress_ == 1.0 && phase_offsets_reached)
+  {
+    endGaitTransition();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WalkLimits WalkController::getLimits(const Eigen::Vector2d &linear_velocity_input,
+                                     const double &angular_velocity_input,
+                                     const LimitTable &limit_table)
+{
+  WalkLimits min_limits = WalkLimits::Constant(UNASSIGNED_VALUE);
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
     std::shared_ptr<Leg> leg = leg_it_->second;
@@ -423,16 +798,10 @@ double WalkController::getLimit(const Eigen::Vector2d &linear_velocity_input,
     Eigen::Vector3d tip_position = leg_stepper->getCurrentTipPose().position_;
     Eigen::Vector2d rotation_normal = Eigen::Vector2d(-tip_position[1], tip_position[0]);
     Eigen::Vector2d stride_vector = linear_velocity_input + angular_velocity_input * rotation_normal;
-    int bearing = mod(roundToInt(radiansToDegrees(atan2(stride_vector[1], stride_vector[0]))), 360);
-    int upper_bound = limit.lower_bound(bearing)->first;
-    int lower_bound = mod(upper_bound - BEARING_STEP, 360);
-    bearing += (bearing < lower_bound) ? 360 : 0;
-    upper_bound += (upper_bound < lower_bound) ? 360 : 0;
-    double control_input = (bearing - lower_bound) / (upper_bound - lower_bound);
-    double limit_interpolation = interpolate(limit.at(lower_bound), limit.at(mod(upper_bound, 360)), control_input);
-    min_limit = std::min(min_limit, limit_interpolation);
-  }
-  return min_limit;
+    double bearing = radiansToDegrees(atan2(stride_vector[1], stride_vector[0]));
+    min_limits = min_limits.min(limit_table.interpolate(bearing));
+  }
+  return min_limits;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -442,10 +811,18 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
   Eigen::Vector2d new_linear_velocity;
   double new_angular_velocity;
 
-  double max_linear_speed = getLimit(linear_velocity_input, angular_velocity_input, max_linear_speed_);
-  double max_angular_speed = getLimit(linear_velocity_input, angular_velocity_input, max_angular_speed_);
-  double max_linear_acceleration = getLimit(linear_velocity_input, angular_velocity_input, max_linear_acceleration_);
-  double max_angular_acceleration = getLimit(linear_velocity_input, angular_velocity_input, max_angular_acceleration_);
+  WalkLimits limits = getLimits(linear_velocity_input, angular_velocity_input);
+  double max_linear_speed = limits[MAX_LINEAR_SPEED];
+  double max_angular_speed = limits[MAX_ANGULAR_SPEED];
+  double max_linear_acceleration = limits[MAX_LINEAR_ACCELERATION];
+  double max_angular_acceleration = limits[MAX_ANGULAR_ACCELERATION];
+
+  // Reduce speed limits during gait transition to accomodate stance periods extended by phase shifts
+  if (isTransitioningGait())
+  {
+    max_linear_speed *= (1.0 - GAIT_TRANSITION_SHIFT_RATIO);
+    max_angular_speed *= (1.0 - GAIT_TRANSITION_SHIFT_RATIO);
+  }
 
   // Calculate desired angular/linear velocities according to input mode and max limits
   if (walk_state_ != STOPPING)
@@ -563,6 +940,12 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
     walk_state_ = STOPPED;
   }
 
+  // Blend step cycle and leg phases towards new gait
+  if (isTransitioningGait())
+  {
+    updateGaitTransition();
+  }
+
   // Update walk/step state and tip position along trajectory for each leg
   for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
@@ -575,7 +958,7 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
       // Check if all legs have completed one step
       if (legs_at_correct_phase_ == leg_count)
       {
-        if (leg_stepper->getPhase() == step_.swing_end_ && !leg_stepper->hasCompletedFirstStep())
+        if (leg_stepper->hasReachedPhase(step_.swing_end_) && !leg_stepper->hasCompletedFirstStep())
         {
           leg_stepper->setCompletedFirstStep(true);
           legs_completed_first_step_++;
@@ -586,7 +969,7 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
       {
         if (leg_stepper->getPhaseOffset() > step_.swing_start_ &&
             leg_stepper->getPhaseOffset() < step_.swing_end_ && // SWING STATE
-            leg_stepper->getPhase() != step_.swing_end_)
+            !leg_stepper->hasReachedPhase(step_.swing_end_))
         {
           leg_stepper->setStepState(FORCE_STANCE);
         }
@@ -609,7 +992,8 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
       Eigen::Vector3d error = (leg_stepper->getCurrentTipPose().position_ - leg_stepper->getTargetTipPose().position_);
       error = getRejection(error, walk_plane_normal);
       bool at_target_tip_position = (error.norm() < TIP_TOLERANCE);
-      if (zero_body_velocity && !leg_stepper->isAtCorrectPhase() && leg_stepper->getPhase() == step_.swing_end_)
+      bool swing_ended = leg_stepper->hasReachedPhase(step_.swing_end_) && leg_stepper->getStepState() != SWING;
+      if (zero_body_velocity && !leg_stepper->isAtCorrectPhase() && swing_ended)
       {
         if (at_target_tip_position || return_to_default_attempted_)
         {
@@ -641,9 +1025,17 @@ void WalkController::updateWalk(const Eigen::Vector2d &linear_velocity_input, co
   }
   updateWalkPlane();
   odometry_ideal_ = odometry_ideal_.addPose(calculateOdometry(time_delta_));
-  if (regenerate_walkspace_)
+
+  // Continue regeneration of walkspace within time budget (deferred until gait transitions complete), restarting any
+  // suspended regeneration if requested again since it began such that it includes the latest inputs
+  if ((regenerate_walkspace_ || walkspace_update_in_progress_) && !isTransitioningGait())
   {
-    generateWalkspace();
+    if (regenerate_walkspace_)
+    {
+      regenerate_walkspace_ = false;
+      walkspace_update_in_progress_ = false;
+    }
+    updateWalkspace(WALKSPACE_TIME_BUDGET * time_delta_);
   }
 }
 
@@ -747,35 +1139,26 @@ void WalkController::updateManual(const int &primary_leg_selection_ID, const Pos
 
 void WalkController::updateWalkPlane(void)
 {
-  std::vector<double> raw_A;
-  std::vector<double> raw_B;
-  if (model_->getLegCount() >= 3) // Minimum for plane estimation
+  // Estimate walk plane from legs in stance only, as default tip positions of swinging legs are yet to be reached
+  walk_plane_estimator_.reset();
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
   {
-    for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+    std::shared_ptr<LegStepper> leg_stepper = leg_it_->second->getLegStepper();
+    if (leg_stepper->getStepState() != SWING)
     {
-      std::shared_ptr<Leg> leg = leg_it_->second;
-      std::shared_ptr<LegStepper> leg_stepper = leg->getLegStepper();
-      raw_A.push_back(leg_stepper->getDefaultTipPose().position_[0]);
-      raw_A.push_back(leg_stepper->getDefaultTipPose().position_[1]);
-      raw_A.push_back(1.0);
-      raw_B.push_back(leg_stepper->getDefaultTipPose().position_[2]);
+      walk_plane_estimator_.addPoint(leg_stepper->getDefaultTipPose().position_);
     }
+  }
 
-    // Estimate walk plane
-    Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> A(raw_A.data(),
-                                                                                         model_->getLegCount(), 3);
-    Eigen::Map<Eigen::VectorXd> B(raw_B.data(), model_->getLegCount());
-    Eigen::MatrixXd pseudo_inverse_A = (A.transpose() * A).inverse() * A.transpose();
-    walk_plane_ = (pseudo_inverse_A * B);
+  // Update walk plane only if estimation succeeds, otherwise retain previous estimate
+  Eigen::Vector3d walk_plane;
+  if (walk_plane_estimator_.estimate(&walk_plane, params_.walk_plane_outlier_threshold.data))
+  {
+    walk_plane_ = walk_plane;
     walk_plane_normal_ = Eigen::Vector3d(-walk_plane_[0], -walk_plane_[1], 1.0).normalized();
     ROS_ASSERT(walk_plane_.norm() < UNASSIGNED_VALUE);
     ROS_ASSERT(walk_plane_normal_.norm() < UNASSIGNED_VALUE);
   }
-  else
-  {
-    walk_plane_ = Eigen::Vector3d::Zero();
-    walk_plane_normal_ = Eigen::Vector3d::UnitZ();
-  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -792,6 +1175,241 @@ Pose WalkController::calculateOdometry(const double &time_period)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void WalkController::addTouchdownPosition(const Eigen::Vector3d &tip_position)
+{
+  touchdown_history_.col(touchdown_history_index_) = odometry_.transformVector(tip_position);
+  touchdown_history_index_ = (touchdown_history_index_ + 1) % TERRAIN_HISTORY_SIZE;
+  touchdown_history_count_ = std::min(touchdown_history_count_ + 1, TERRAIN_HISTORY_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkController::estimateTerrainHeight(const Eigen::Vector3d &tip_position, double *height)
+{
+  Eigen::Vector3d world_tip_position = odometry_.transformVector(tip_position);
+  double weighted_height = 0.0;
+  double weight_sum = 0.0;
+  for (int i = 0; i < touchdown_history_count_; ++i)
+  {
+    Eigen::Vector3d touchdown_position = touchdown_history_.col(i);
+    double distance = (touchdown_position - world_tip_position).head<2>().norm();
+    double weight = 1.0 - distance / TERRAIN_ESTIMATE_RADIUS;
+    if (weight > 0.0)
+    {
+      weighted_height += weight * touchdown_position[2];
+      weight_sum += weight;
+    }
+  }
+
+  if (weight_sum == 0.0)
+  {
+    return false;
+  }
+
+  // Transform estimated terrain position back from world frame
+  world_tip_position[2] = weighted_height / weight_sum;
+  *height = odometry_.inverseTransformVector(world_tip_position)[2];
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkController::updateOdometry(const PoseArray &actual_tip_poses)
+{
+  // Find centroids of footprint of legs in stance during both previous and current iteration
+  int stance_count = 0;
+  Eigen::Vector3d previous_centroid = Eigen::Vector3d::Zero();
+  Eigen::Vector3d current_centroid = Eigen::Vector3d::Zero();
+  bool in_stance[MAX_LEG_COUNT];
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    std::shared_ptr<Leg> leg = leg_it_->second;
+    int id_number = leg->getIDNumber();
+    in_stance[id_number] = (leg->getLegState() == WALKING && leg->getLegStepper()->getStepState() != SWING);
+    if (in_stance[id_number] && stance_footprint_valid_[id_number])
+    {
+      previous_centroid += stance_footprint_.col(id_number);
+      current_centroid += actual_tip_poses[id_number].position_;
+      stance_count++;
+    }
+  }
+
+  // Rotation delta from change in IMU orientation (if available)
+  bool imu_available = model_->hasImuData();
+  Eigen::Quaterniond imu_orientation = model_->getImuData().orientation;
+  bool rotation_estimated = (imu_available && !previous_imu_orientation_.isApprox(UNDEFINED_ROTATION));
+  Eigen::Matrix3d rotation_delta = Eigen::Matrix3d::Identity();
+  if (rotation_estimated)
+  {
+    rotation_delta = (previous_imu_orientation_.inverse() * imu_orientation).normalized().toRotationMatrix();
+  }
+
+  // Default to pose delta from commanded body velocity
+  Pose pose_delta = calculateOdometry(time_delta_);
+  PoseCovariance pose_delta_covariance = PoseCovariance::Identity() * ODOMETRY_FALLBACK_VARIANCE;
+  if (stance_count > 0)
+  {
+    previous_centroid /= stance_count;
+    current_centroid /= stance_count;
+
+    // Generate cross-covariance of footprint about centroids
+    Eigen::Matrix3d cross_covariance = Eigen::Matrix3d::Zero();
+    double footprint_spread = 0.0;
+    for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+    {
+      int id_number = leg_it_->second->getIDNumber();
+      if (in_stance[id_number] && stance_footprint_valid_[id_number])
+      {
+        Eigen::Vector3d previous_position = stance_footprint_.col(id_number) - previous_centroid;
+        Eigen::Vector3d current_position = actual_tip_poses[id_number].position_ - current_centroid;
+        cross_covariance += current_position * previous_position.transpose();
+        footprint_spread += current_position.squaredNorm();
+      }
+    }
+
+    // Otherwise estimate rotation delta which best aligns footprint, correcting for reflection (Kabsch algorithm)
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(cross_covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    if (!rotation_estimated && stance_count >= 3 && svd.singularValues()[1] > ODOMETRY_SINGULARITY_TOLERANCE)
+    {
+      Eigen::Matrix3d reflection = Eigen::Matrix3d::Identity();
+      reflection(2, 2) = ((svd.matrixV() * svd.matrixU().transpose()).determinant() < 0.0 ? -1.0 : 1.0);
+      rotation_delta = svd.matrixV() * reflection * svd.matrixU().transpose();
+      rotation_estimated = true;
+    }
+
+    // Estimate translation delta and covariance from residual error of aligned footprint
+    if (rotation_estimated)
+    {
+      Eigen::Vector3d translation_delta = previous_centroid - rotation_delta * current_centroid;
+      double residual = 0.0;
+      for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+      {
+        int id_number = leg_it_->second->getIDNumber();
+        if (in_stance[id_number] && stance_footprint_valid_[id_number])
+        {
+          Eigen::Vector3d aligned_position = rotation_delta * actual_tip_poses[id_number].position_ + translation_delta;
+          residual += (aligned_position - stance_footprint_.col(id_number)).squaredNorm();
+        }
+      }
+      double residual_variance = residual / (3.0 * stance_count); // Per axis
+      double translation_variance = std::max(residual_variance / stance_count, ODOMETRY_MIN_VARIANCE);
+      double rotation_variance = ODOMETRY_MIN_VARIANCE;
+      if (footprint_spread > 0.0)
+      {
+        rotation_variance = std::max(residual_variance / footprint_spread, ODOMETRY_MIN_VARIANCE);
+      }
+      pose_delta = Pose(translation_delta, Eigen::Quaterniond(rotation_delta).normalized());
+      pose_delta_covariance = PoseCovariance::Zero();
+      pose_delta_covariance.topLeftCorner<3, 3>() = Eigen::Matrix3d::Identity() * translation_variance;
+      pose_delta_covariance.bottomRightCorner<3, 3>() = Eigen::Matrix3d::Identity() * rotation_variance;
+    }
+  }
+
+  // Accumulate pose delta and covariance (rotated into world frame) into odometry
+  PoseCovariance jacobian = PoseCovariance::Zero();
+  jacobian.topLeftCorner<3, 3>() = odometry_.rotation_.toRotationMatrix();
+  jacobian.bottomRightCorner<3, 3>() = odometry_.rotation_.toRotationMatrix();
+  odometry_covariance_ += jacobian * pose_delta_covariance * jacobian.transpose();
+  odometry_ = odometry_.addPose(pose_delta);
+  odometry_.rotation_.normalize();
+  odometry_delta_ = pose_delta;
+  odometry_delta_covariance_ = pose_delta_covariance;
+  ROS_ASSERT(odometry_.isValid());
+
+  // Store footprint for next iteration
+  for (leg_it_ = model_->getLegContainer()->begin(); leg_it_ != model_->getLegContainer()->end(); ++leg_it_)
+  {
+    int id_number = leg_it_->second->getIDNumber();
+    stance_footprint_.col(id_number) = actual_tip_poses[id_number].position_;
+    stance_footprint_valid_[id_number] = in_stance[id_number];
+  }
+  previous_imu_orientation_ = (imu_available ? imu_orientation : UNDEFINED_ROTATION);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WalkPlaneEstimator::addPoint(const Eigen::Vector3d &point)
+{
+  ROS_ASSERT(point_count_ < WALK_PLANE_MAX_POINTS);
+  points_.col(point_count_++) = point;
+  Eigen::Vector3d a(point[0], point[1], 1.0); // Row of A matrix
+  normal_matrix_ += a * a.transpose();
+  normal_vector_ += a * point[2];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkPlaneEstimator::estimate(Eigen::Vector3d *walk_plane, const double &outlier_threshold) const
+{
+  // Minimum for plane estimation
+  if (point_count_ < 3 || !solve(normal_matrix_, normal_vector_, walk_plane))
+  {
+    return false;
+  }
+
+  // Iteratively re-weight tip positions according to residual from current estimate (Huber weighting)
+  // Ref: https://en.wikipedia.org/wiki/Iteratively_reweighted_least_squares
+  if (outlier_threshold > 0.0 && point_count_ > 3)
+  {
+    for (int i = 0; i < WALK_PLANE_ROBUST_ITERATIONS; ++i)
+    {
+      Eigen::Matrix3d weighted_normal_matrix = Eigen::Matrix3d::Zero();
+      Eigen::Vector3d weighted_normal_vector = Eigen::Vector3d::Zero();
+      for (int j = 0; j < point_count_; ++j)
+      {
+        Eigen::Vector3d a(points_(0, j), points_(1, j), 1.0);
+        double residual = std::abs(points_(2, j) - a.dot(*walk_plane));
+        double weight = (residual > outlier_threshold ? outlier_threshold / residual : 1.0);
+        weighted_normal_matrix += weight * a * a.transpose();
+        weighted_normal_vector += weight * a * points_(2, j);
+      }
+      Eigen::Vector3d weighted_walk_plane;
+      if (!solve(weighted_normal_matrix, weighted_normal_vector, &weighted_walk_plane))
+      {
+        break;
+      }
+      *walk_plane = weighted_walk_plane;
+    }
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WalkPlaneEstimator::solve(const Eigen::Matrix3d &normal_matrix, const Eigen::Vector3d &normal_vector,
+                               Eigen::Vector3d *walk_plane) const
+{
+  // Closed form (cofactor) inverse of fixed size 3x3 normal matrix
+  Eigen::Matrix3d inverse;
+  bool invertible;
+  normal_matrix.computeInverseWithCheck(inverse, invertible, WALK_PLANE_SINGULARITY_TOLERANCE);
+  if (invertible)
+  {
+    *walk_plane = inverse * normal_vector;
+  }
+  return invertible;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BezierWeightTable::generate(const double &delta_t)
+{
+  ROS_ASSERT(delta_t > 0.0);
+  if (delta_t == delta_t_)
+  {
+    return;
+  }
+  delta_t_ = delta_t;
+  iterations_ = int(1.0 / delta_t + PHASE_TOLERANCE); // Iterations with time input within the curve
+  weights_.resize(5, iterations_);
+  for (int i = 0; i < iterations_; ++i)
+  {
+    weights_.col(i) = quarticBezierDotWeights(std::min(1.0, (i + 1) * delta_t_));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 LegStepper::LegStepper(std::shared_ptr<WalkController> walker, std::shared_ptr<Leg> leg, const Pose &identity_tip_pose)
     : walker_(walker)
     , leg_(leg)
@@ -807,7 +1425,9 @@ LegStepper::LegStepper(std::shared_ptr<WalkController> walker, std::shared_ptr<L
   current_tip_velocity_ = Eigen::Vector3d::Zero();
   swing_origin_tip_position_ = default_tip_pose_.position_;
   stance_origin_tip_position_ = default_tip_pose_.position_;
+  foothold_offset_ = Eigen::Vector3d::Zero();
   swing_clearance_ = Eigen::Vector3d(0.0, 0.0, walker->getStepClearance());
+  stance_node_stride_vector_ = Eigen::Vector3d::Zero();
 
   // Iterate through and initialise control nodes (5 control nodes for quartic (4th order) bezier curves)
   for (int i = 0; i < 5; ++i)
@@ -836,17 +1456,26 @@ LegStepper::LegStepper(std::shared_ptr<LegStepper> leg_stepper)
   swing_origin_tip_position_ = leg_stepper->swing_origin_tip_position_;
   swing_origin_tip_velocity_ = leg_stepper->swing_origin_tip_velocity_;
   stance_origin_tip_position_ = leg_stepper->stance_origin_tip_position_;
+  foothold_offset_ = leg_stepper->foothold_offset_;
   swing_clearance_ = leg_stepper->swing_clearance_;
   at_correct_phase_ = leg_stepper->at_correct_phase_;
   completed_first_step_ = leg_stepper->completed_first_step_;
+  swing_first_half_ = leg_stepper->swing_first_half_;
   phase_ = leg_stepper->phase_;
+  previous_phase_ = leg_stepper->previous_phase_;
   phase_offset_ = leg_stepper->phase_offset_;
   stance_progress_ = leg_stepper->stance_progress_;
   swing_progress_ = leg_stepper->swing_progress_;
   stance_progress_ = leg_stepper->stance_progress_;
   step_state_ = leg_stepper->step_state_;
+  trajectory_step_state_ = leg_stepper->trajectory_step_state_;
+  swing_step_ = leg_stepper->swing_step_;
   swing_delta_t_ = leg_stepper->swing_delta_t_;
   stance_delta_t_ = leg_stepper->stance_delta_t_;
+  swing_weights_ = leg_stepper->swing_weights_;
+  stance_weights_ = leg_stepper->stance_weights_;
+  swing_node_inputs_ = leg_stepper->swing_node_inputs_;
+  stance_node_stride_vector_ = leg_stepper->stance_node_stride_vector_;
 
   // Iterate through and initialise control nodes (5 control nodes for quartic (4th order) bezier curves)
   for (int i = 0; i < 5; ++i)
@@ -859,33 +1488,82 @@ LegStepper::LegStepper(std::shared_ptr<LegStepper> leg_stepper)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void LegStepper::updatePhase(void)
+StepCycle LegStepper::getStepCycle(void)
 {
   StepCycle step = walker_->getStepCycle();
-  phase_ = static_cast<int>(step_progress_ * step.period_);
-  updateStepState();
+  if (step_state_ == SWING)
+  {
+    step.swing_start_ = swing_step_.swing_start_;
+    step.swing_end_ = swing_step_.swing_end_;
+    step.swing_period_ = swing_step_.swing_period_;
+    step.stance_start_ = swing_step_.stance_start_;
+  }
+  return step;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LegStepper::scalePhase(const double &scaler)
+{
+  phase_ *= scaler;
+  previous_phase_ *= scaler;
+  phase_offset_ *= scaler;
+  swing_step_.period_ *= scaler;
+  swing_step_.swing_period_ *= scaler;
+  swing_step_.stance_period_ *= scaler;
+  swing_step_.stance_end_ *= scaler;
+  swing_step_.swing_start_ *= scaler;
+  swing_step_.swing_end_ *= scaler;
+  swing_step_.stance_start_ *= scaler;
+  swing_step_.phase_delta_ *= scaler;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool LegStepper::hasReachedPhase(const double &phase)
+{
+  // Phase is reached if within the (cyclic) range advanced by the latest iteration or equal to the current phase
+  double period = walker_->getStepCycle().period_;
+  double phase_advanced = mod(phase_ - previous_phase_, period);
+  double phase_since_reached = mod(phase_ - phase, period);
+  return phase_since_reached < phase_advanced || phase_since_reached < PHASE_TOLERANCE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void LegStepper::iteratePhase(void)
 {
-  StepCycle step = walker_->getStepCycle();
-  phase_ = (phase_ + 1) % (step.period_);
+  StepState previous_step_state = step_state_;
+  previous_phase_ = phase_;
+  phase_ = mod(phase_ + getPhaseDelta(), walker_->getStepCycle().period_);
   updateStepState();
 
+  // Hold leg at end of stance period whilst starting swing period would violate support constraints
+  if (previous_step_state == STANCE && step_state_ == SWING && !walker_->isSwingPermitted(leg_))
+  {
+    phase_ = previous_phase_;
+    step_state_ = STANCE;
+  }
+
+  // Lift off early in free gait if tip would otherwise leave walkspace (along stride) on next iteration
+  if (step_state_ == STANCE && walker_->isFreeGait() && isWalkspaceExhausted() && walker_->isSwingPermitted(leg_))
+  {
+    setPhase(getStepCycle().swing_start_);
+    updateStepState();
+  }
+
   // Calculate progress of stance/swing periods (0.0->1.0 or -1.0 if not in specific state)
-  step_progress_ = double(phase_) / step.period_;
+  StepCycle step = getStepCycle();
+  step_progress_ = phase_ / step.period_;
   if (step_state_ == SWING)
   {
-    swing_progress_ = double(phase_ - step.swing_start_ + 1) / double(step.swing_end_ - step.swing_start_);
+    swing_progress_ = (phase_ - step.swing_start_ + step.phase_delta_) / step.swing_period_;
     swing_progress_ = clamped(swing_progress_, 0.0, 1.0);
     stance_progress_ = -1.0;
   }
   else if (step_state_ == STANCE)
   {
-    stance_progress_ = double(mod(phase_ + (step.period_ - step.stance_start_), step.period_) + 1) /
-                       double(mod(step.stance_end_ - step.stance_start_, step.period_));
+    stance_progress_ = (mod(phase_ - step.stance_start_, step.period_) + step.phase_delta_) / step.stance_period_;
     stance_progress_ = clamped(stance_progress_, 0.0, 1.0);
     swing_progress_ = -1.0;
   }
@@ -898,16 +1576,100 @@ void LegStepper::iteratePhase(void)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+double LegStepper::calculateWalkspaceMargin(void)
+{
+  // Tip travels opposite to stride vector whilst in stance
+  Eigen::Vector2d stance_direction(-stride_vector_[0], -stride_vector_[1]);
+  if (stance_direction.norm() == 0.0)
+  {
+    return UNASSIGNED_VALUE;
+  }
+  stance_direction.normalize();
+
+  // Walkspace radius (about default tip position) along stride less distance already travelled
+  Eigen::Vector3d displacement = current_tip_pose_.position_ - default_tip_pose_.position_;
+  double distance = Eigen::Vector2d(displacement[0], displacement[1]).dot(stance_direction);
+  double bearing = radiansToDegrees(atan2(stance_direction[1], stance_direction[0]));
+  double walkspace_radius = walker_->getWalkspace()->interpolate(bearing)[0];
+  return walkspace_radius - distance;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool LegStepper::isWalkspaceExhausted(void)
+{
+  double tip_travel = current_tip_velocity_.norm() * walker_->getTimeDelta();
+  return calculateWalkspaceMargin() < tip_travel;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Vector3d LegStepper::planFoothold(const Eigen::Vector3d &nominal_tip_position)
+{
+  int candidate_count = clamped(walker_->getParameters().footstep_candidates.data, 1, MAX_TIP_BATCH_SIZE);
+  double search_radius = walker_->getParameters().footstep_search_radius.data;
+
+  // Generate candidates as nominal target followed by remaining candidates evenly distributed about nominal target
+  TipPositionBatch candidates(3, candidate_count);
+  for (int i = 0; i < candidate_count; ++i)
+  {
+    Eigen::Vector3d candidate = nominal_tip_position;
+    if (i > 0)
+    {
+      double angle = 2.0 * M_PI * (i - 1) / (candidate_count - 1);
+      candidate += search_radius * Eigen::Vector3d(cos(angle), sin(angle), 0.0);
+    }
+
+    // Project candidate onto terrain estimated from past touchdown positions
+    double terrain_height;
+    if (walker_->estimateTerrainHeight(candidate, &terrain_height))
+    {
+      candidate[2] = terrain_height;
+    }
+    candidates.col(i) = candidate;
+  }
+
+  // Evaluate margin of all candidates from leg workspace limit
+  TipMarginBatch margins;
+  leg_->calculateReachabilityMargins(candidates, &margins);
+
+  // Limit margins by walkspace margin at end of following stance (tip travels opposite to stride vector)
+  for (int i = 0; i < candidate_count; ++i)
+  {
+    Eigen::Vector3d stance_end_displacement = candidates.col(i) - stride_vector_ - default_tip_pose_.position_;
+    Eigen::Vector2d displacement = stance_end_displacement.head<2>();
+    double bearing = radiansToDegrees(atan2(displacement[1], displacement[0]));
+    double walkspace_margin = walker_->getWalkspace()->interpolate(bearing)[0] - displacement.norm();
+    double offset = (candidates.col(i) - nominal_tip_position).head<2>().norm();
+    margins[i] = std::min(margins[i], walkspace_margin) - FOOTHOLD_OFFSET_COST * offset;
+  }
+
+  int best_index;
+  margins.maxCoeff(&best_index);
+  return candidates.col(best_index);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void LegStepper::updateStepState(void)
 {
   // Update step state from phase unless force stopped
-  StepCycle step = walker_->getStepCycle();
+  // Swing may only start in the first half of the swing period, such that a leg which has ended swing does not restart
+  // swing if the swing period is extended (e.g. during gait transitions)
+  StepCycle step = getStepCycle();
+  bool swing_period = (phase_ >= step.swing_start_ && phase_ < step.swing_end_);
+  bool swing_started = (step_state_ == SWING || phase_ < step.swing_start_ + step.swing_period_ / 2.0);
   if (step_state_ == FORCE_STOP)
   {
     return;
   }
-  else if (phase_ >= step.swing_start_ && phase_ < step.swing_end_ && step_state_ != FORCE_STANCE)
+  else if (swing_period && swing_started && step_state_ != FORCE_STANCE)
   {
+    // Hold bounds of swing period fixed until swing ends
+    if (step_state_ != SWING)
+    {
+      swing_step_ = walker_->getStepCycle();
+    }
     step_state_ = SWING;
   }
   else if (phase_ < step.stance_end_ || phase_ >= step.stance_start_)
@@ -937,7 +1699,7 @@ void LegStepper::updateStride(void)
   // Combination and scaling
   stride_vector_ = stride_vector_linear + stride_vector_angular;
   StepCycle step = walker_->getStepCycle();
-  double on_ground_ratio = double(step.stance_period_) / step.period_;
+  double on_ground_ratio = step.stance_period_ / step.period_;
   stride_vector_ *= (on_ground_ratio / step.frequency_);
 
   // Swing clearance
@@ -952,30 +1714,12 @@ Eigen::Vector3d LegStepper::calculateStanceSpanChange(void)
   Eigen::Vector3d default_shift = default_tip_pose_.position_ - identity_tip_pose_.position_;
   double target_workplane_height = setPrecision(default_shift[2], 3);
 
-  // Get bounding existing workplanes within workspace
-  Workspace workspace = leg_->getWorkspace();
-  Workspace::iterator upper_bound_it = workspace.upper_bound(target_workplane_height);
-  Workspace::iterator lower_bound_it = prev(upper_bound_it);
-  double upper_workplane_height = setPrecision(upper_bound_it->first, 3);
-  double lower_workplane_height = setPrecision(lower_bound_it->first, 3);
-  LimitMap upper_workplane = upper_bound_it->second;
-  LimitMap lower_workplane = lower_bound_it->second;
-
-  // Calculate interpolation of radii for target workplane height between existing workspace planes
-  double i = (target_workplane_height - lower_workplane_height) / (upper_workplane_height - lower_workplane_height);
+  // Calculate radius of workspace at target height perpendicular to direction of stance span change
   double stance_span_modifier = walker_->getParameters().stance_span_modifier.current_value;
   bool positive_y_axis = (Eigen::Vector3d::UnitY().dot(identity_tip_pose_.position_) > 0.0);
   int bearing = (positive_y_axis ^ (stance_span_modifier > 0.0)) ? 270 : 90;
   stance_span_modifier *= (positive_y_axis ? 1.0 : -1.0);
-  double radius = 0.0;
-  if (workspace.size() == 1)
-  {
-    radius = workspace.at(0.0).at(bearing);
-  }
-  else
-  {
-    radius = lower_workplane.at(bearing) * (1.0 - i) + upper_workplane.at(bearing) * i;
-  }
+  double radius = leg_->getWorkspace()->interpolateRadius(target_workplane_height, bearing);
   return Eigen::Vector3d(0.0, radius * stance_span_modifier, 0.0);
 }
 
@@ -1009,7 +1753,7 @@ void LegStepper::updateDefaultTipPosition(void)
   default_tip_pose_ = new_default_tip_pose;
   if (default_tip_position_delta > IK_TOLERANCE)
   {
-    //walker_->setRegenerateWalkspace();
+    walker_->setRegenerateWalkspace();
   }
 }
 
@@ -1019,26 +1763,26 @@ void LegStepper::updateTipPosition(void)
 {
   bool rough_terrain_mode = walker_->getParameters().rough_terrain_mode.data;
   bool force_normal_touchdown = walker_->getParameters().force_normal_touchdown.data;
-  double time_delta = walker_->getTimeDelta();
-  StepCycle step = walker_->getStepCycle();
+  StepCycle step = getStepCycle();
 
   bool standard_stance_period = (step_state_ == SWING || completed_first_step_);
-  int modified_stance_start = standard_stance_period ? step.stance_start_ : phase_offset_;
-  int modified_stance_period = mod(step.stance_end_ - modified_stance_start, step.period_);
+  double modified_stance_start = standard_stance_period ? step.stance_start_ : phase_offset_;
+  double modified_stance_period = mod(step.stance_end_ - modified_stance_start, step.period_);
   if (step.stance_end_ == modified_stance_start)
   {
     modified_stance_period = step.period_;
   }
   ROS_ASSERT(modified_stance_period != 0);
 
-  // Calculates number of iterations for ENTIRE swing period and time delta used for EACH bezier curve time input
-  int swing_iterations = int((double(step.swing_period_) / step.period_) / (step.frequency_ * time_delta));
-  swing_iterations = roundToEvenInt(swing_iterations); // Must be even
-  swing_delta_t_ = 1.0 / (swing_iterations / 2.0);     // 1 sec divided by number of iterations for each bezier curve
+  // Calculates time input delta of EACH swing bezier curve (half swing period) from the phase advanced per iteration
+  // Control node weight tables are only regenerated when the time input delta changes (i.e. per step cycle)
+  double half_swing_period = step.swing_period_ / 2.0;
+  swing_weights_.generate(step.phase_delta_ / half_swing_period);
+  swing_delta_t_ = swing_weights_.getDeltaT();
 
-  // Calculates number of iterations for stance period and time delta used for bezier curve time input
-  int stance_iterations = int((double(modified_stance_period) / step.period_) / (step.frequency_ * time_delta));
-  stance_delta_t_ = 1.0 / stance_iterations; // 1 second divided by number of iterations
+  // Calculates time input delta of the stance bezier curve from the phase advanced per iteration
+  stance_weights_.generate(step.phase_delta_ / modified_stance_period);
+  stance_delta_t_ = stance_weights_.getDeltaT();
 
   // Generate default target
   target_tip_pose_.position_ = default_tip_pose_.position_ + 0.5 * stride_vector_;
@@ -1047,11 +1791,11 @@ void LegStepper::updateTipPosition(void)
   if (step_state_ == SWING)
   {
     updateStride();
-    int iteration = phase_ - step.swing_start_ + 1;
-    bool first_half = iteration <= swing_iterations / 2;
+    bool swing_start = (trajectory_step_state_ != SWING);
+    bool first_half = phase_ < step.swing_start_ + half_swing_period;
 
     // Save initial tip position/velocity
-    if (iteration == 1)
+    if (swing_start)
     {
       swing_origin_tip_position_ = current_tip_pose_.position_;
       swing_origin_tip_velocity_ = current_tip_velocity_;
@@ -1059,11 +1803,21 @@ void LegStepper::updateTipPosition(void)
       {
         updateDefaultTipPosition();
       }
+
+      // Plan foothold before lift off, held as offset from nominal target as the stride vector updates during swing
+      foothold_offset_ = Eigen::Vector3d::Zero();
+      if (rough_terrain_mode && walker_->getParameters().footstep_candidates.data > 1)
+      {
+        Eigen::Vector3d nominal_tip_position = default_tip_pose_.position_ + 0.5 * stride_vector_;
+        foothold_offset_ = planFoothold(nominal_tip_position) - nominal_tip_position;
+      }
     }
 
     // Update target to externally defined position OR update default to meet step surface
     if (rough_terrain_mode)
     {
+      target_tip_pose_.position_ += foothold_offset_;
+
       // Update target tip pose to externally requested target tip pose transformed based on movement since request
       if (external_target_.defined_)
       {
@@ -1072,7 +1826,7 @@ void LegStepper::updateTipPosition(void)
         // Add lead to compensate for moving target
         if (external_target_.frame_id_ == "odom_ideal")
         {
-          double time_to_swing_end = (swing_iterations - iteration) * time_delta;
+          double time_to_swing_end = (step.swing_end_ - phase_ - step.phase_delta_) / (step.period_ * step.frequency_);
           Eigen::Vector3d target_lead = walker_->calculateOdometry(time_to_swing_end).position_;
           target_tip_pose_.position_ -= target_lead;
         }
@@ -1106,28 +1860,40 @@ void LegStepper::updateTipPosition(void)
       }
     }
 
-    // Generate swing control nodes (once at beginning of 1st half and continuously for 2nd half)
+    // Generate swing control nodes at beginning of swing and whenever inputs which define them change
+    // (Nodes are continuously regenerated following ground contact as they are defined from current tip position)
     bool ground_contact = (leg_->getStepPlanePose() != Pose::Undefined() && rough_terrain_mode);
-    generatePrimarySwingControlNodes();
-    generateSecondarySwingControlNodes(!first_half && ground_contact);
-    // Adjust control nodes to force touchdown normal to walk plane
-    if (force_normal_touchdown && !ground_contact)
+    SwingNodeInputs swing_node_inputs;
+    swing_node_inputs.target_tip_position_ = target_tip_pose_.position_;
+    swing_node_inputs.stride_vector_ = stride_vector_;
+    swing_node_inputs.swing_clearance_ = swing_clearance_;
+    swing_node_inputs.swing_width_ = walker_->getParameters().swing_width.current_value;
+    swing_node_inputs.swing_delta_t_ = swing_delta_t_;
+    swing_node_inputs.stance_delta_t_ = stance_delta_t_;
+    swing_node_inputs.ground_contact_ = !first_half && ground_contact;
+    if (swing_start || swing_node_inputs.ground_contact_ || !(swing_node_inputs == swing_node_inputs_))
     {
-      forceNormalTouchdown();
+      swing_node_inputs_ = swing_node_inputs;
+      generatePrimarySwingControlNodes();
+      generateSecondarySwingControlNodes(swing_node_inputs.ground_contact_);
+      // Adjust control nodes to force touchdown normal to walk plane
+      if (force_normal_touchdown && !ground_contact)
+      {
+        forceNormalTouchdown();
+      }
     }
 
-    Eigen::Vector3d delta_pos(0, 0, 0);
-    double time_input = 0;
-    if (first_half)
-    {
-      time_input = swing_delta_t_ * iteration;
-      delta_pos = swing_delta_t_ * quarticBezierDot(swing_1_nodes_, time_input);
-    }
-    else
-    {
-      time_input = swing_delta_t_ * (iteration - swing_iterations / 2);
-      delta_pos = swing_delta_t_ * quarticBezierDot(swing_2_nodes_, time_input);
-    }
+    // Evaluate bezier curve derivative at time input of curve at end of this iteration, integrating from the start of
+    // the curve on the first iteration of each curve (as phase may be off the phase delta grid) and clamping to the end
+    // of the curve on the final iteration
+    bool curve_first_iteration = swing_start || first_half != swing_first_half_;
+    swing_first_half_ = first_half;
+    double curve_start = first_half ? step.swing_start_ : step.swing_start_ + half_swing_period;
+    double raw_time_input = (phase_ - curve_start + step.phase_delta_) / half_swing_period;
+    double time_input = std::min(1.0, raw_time_input);
+    double delta_t = time_input - (curve_first_iteration ? 0.0 : std::max(0.0, raw_time_input - swing_delta_t_));
+    Eigen::Vector3d* nodes = first_half ? swing_1_nodes_ : swing_2_nodes_;
+    Eigen::Vector3d delta_pos = delta_t * swing_weights_.evaluate(nodes, time_input);
 
     ROS_ASSERT(time_input <= 1.0);
     ROS_ASSERT(delta_pos.norm() < UNASSIGNED_VALUE);
@@ -1135,12 +1901,12 @@ void LegStepper::updateTipPosition(void)
     current_tip_velocity_ = delta_pos / walker_->getTimeDelta();
 
     ROS_DEBUG_COND(walker_->getParameters().debug_swing_trajectory.data && leg_->getIDNumber() == 0,
-                   "SWING TRAJECTORY_DEBUG - ITERATION: %d\t\t"
+                   "SWING TRAJECTORY_DEBUG - PHASE: %f\t\t"
                    "TIME: %f\t\t"
                    "ORIGIN: %f:%f:%f\t\t"
                    "POS: %f:%f:%f\t\t"
                    "TARGET: %f:%f:%f\n",
-                   iteration, setPrecision(time_input, 3),
+                   setPrecision(phase_, 3), setPrecision(time_input, 3),
                    swing_origin_tip_position_[0], swing_origin_tip_position_[1], swing_origin_tip_position_[2],
                    current_tip_pose_.position_[0], current_tip_pose_.position_[1], current_tip_pose_.position_[2],
                    target_tip_pose_.position_[0], target_tip_pose_.position_[1], target_tip_pose_.position_[2]);
@@ -1150,42 +1916,53 @@ void LegStepper::updateTipPosition(void)
   {
     updateStride();
 
-    int iteration = mod(phase_ + (step.period_ - modified_stance_start), step.period_) + 1;
+    bool stance_start = (trajectory_step_state_ != STANCE && trajectory_step_state_ != FORCE_STANCE);
 
     // Save initial tip position at beginning of stance
-    if (iteration == 1)
+    if (stance_start)
     {
       stance_origin_tip_position_ = current_tip_pose_.position_;
       external_target_.defined_ = false; // Reset external target after every swing period
       if (rough_terrain_mode)
       {
+        walker_->addTouchdownPosition(stance_origin_tip_position_);
         updateDefaultTipPosition();
       }
     }
 
     // Scales stride vector according to stance period specifically for STARTING state of walker
-    double stride_scaler = double(modified_stance_period) / (mod(step.stance_end_ - step.stance_start_, step.period_));
-    generateStanceControlNodes(stride_scaler);
+    // Control nodes are regenerated at beginning of stance and whenever the scaled stride vector changes
+    double stride_scaler = modified_stance_period / step.stance_period_;
+    if (stance_start || stride_vector_ * stride_scaler != stance_node_stride_vector_)
+    {
+      stance_node_stride_vector_ = stride_vector_ * stride_scaler;
+      generateStanceControlNodes(stride_scaler);
+    }
 
     // Uses derivative of bezier curve to ensure correct velocity along ground, this means the position may not
     // reach the target but this is less important than ensuring correct velocity according to stride vector
-    double time_input = iteration * stance_delta_t_;
-    Eigen::Vector3d delta_pos = stance_delta_t_ * quarticBezierDot(stance_nodes_, time_input);
+    // (Time input delta is not clamped at the end of the curve such that velocity is maintained if stance is extended)
+    double stance_phase = mod(phase_ - modified_stance_start, step.period_);
+    double time_input = std::min(1.0, (stance_phase + step.phase_delta_) / modified_stance_period);
+    double delta_t = stance_delta_t_;
+    Eigen::Vector3d delta_pos = delta_t * stance_weights_.evaluate(stance_nodes_, time_input);
     ROS_ASSERT(delta_pos.norm() < UNASSIGNED_VALUE);
     current_tip_pose_.position_ += delta_pos;
     current_tip_velocity_ = delta_pos / walker_->getTimeDelta();
 
     ROS_DEBUG_COND(walker_->getParameters().debug_stance_trajectory.data && leg_->getIDNumber() == 0,
-                   "STANCE TRAJECTORY_DEBUG - ITERATION: %d\t\t"
+                   "STANCE TRAJECTORY_DEBUG - PHASE: %f\t\t"
                    "TIME: %f\t\t"
                    "ORIGIN: %f:%f:%f\t\t"
                    "POS: %f:%f:%f\t\t"
                    "TARGET: %f:%f:%f\n",
-                   iteration, setPrecision(time_input, 3),
+                   setPrecision(phase_, 3), setPrecision(time_input, 3),
                    stance_origin_tip_position_[0], stance_origin_tip_position_[1], stance_origin_tip_position_[2],
                    current_tip_pose_.position_[0], current_tip_pose_.position_[1], current_tip_pose_.position_[2],
                    stance_nodes_[4][0], stance_nodes_[4][1], stance_nodes_[4][2]);
   }
+
+  trajectory_step_state_ = step_state_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////